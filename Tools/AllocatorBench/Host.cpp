@@ -0,0 +1,110 @@
+#include "Host.h"
+#include "../../src/kernel/TimerWheel.h"
+#include "../../src/kernel/VirtualMemory.h"
+#include "../../src/kernel/io/UART.h"
+#include <cstdio>
+
+// Everything that MemoryManagement.cpp needs from the rest of the kernel, implemented on top of the host.
+
+namespace Kernel {
+
+// The heap's reservation is a static array, which costs nothing until it is touched, just like on the Pi.
+static constexpr size_t HostHeapReservation = (size_t)1024 * 1024 * 1024;
+alignas(4096) static u8 s_heap[HostHeapReservation];
+
+static uintptr_t s_heap_peak = 0;
+
+VirtualMemory& VirtualMemory::instance()
+{
+    static VirtualMemory instance;
+    if (s_heap_peak == 0) {
+        instance.m_heap_break = (uintptr_t)s_heap;
+        s_heap_peak = (uintptr_t)s_heap;
+    }
+
+    return instance;
+}
+
+void* VirtualMemory::grow_heap(size_t size)
+{
+    size = (size + PageSize - 1) & ~(PageSize - 1);
+    if (size > (uintptr_t)s_heap + HostHeapReservation - m_heap_break) {
+        return nullptr;
+    }
+
+    auto old_break = m_heap_break;
+    m_heap_break += size;
+    m_heap_pages_backed = (m_heap_break - (uintptr_t)s_heap) / PageSize;
+
+    if (m_heap_break > s_heap_peak) {
+        s_heap_peak = m_heap_break;
+    }
+
+    return (void*)old_break;
+}
+
+void VirtualMemory::shrink_heap(size_t size)
+{
+    size &= ~(PageSize - 1);
+
+    m_heap_break -= size;
+    m_heap_pages_backed = (m_heap_break - (uintptr_t)s_heap) / PageSize;
+}
+
+UART& UART::instance()
+{
+    static UART instance;
+    return instance;
+}
+
+UART::UART()
+{
+}
+
+void UART::write(const char* data, size_t size)
+{
+    fwrite(data, 1, size, stdout);
+}
+
+u32 UART::read()
+{
+    return getchar();
+}
+
+bool UART::try_write(const char* data, size_t size)
+{
+    fwrite(data, 1, size, stdout);
+    return true;
+}
+
+void UART::write(u32 value)
+{
+    putchar(value);
+}
+
+void UART::flush()
+{
+    fflush(stdout);
+}
+
+// Nothing calls Log::start_draining() here, the benchmark drains the log itself.
+TimerWheel& TimerWheel::instance()
+{
+    static TimerWheel instance;
+    return instance;
+}
+
+void TimerWheel::start_periodic(Timer&, u64, Timer::Callback, void*)
+{
+}
+
+}
+
+namespace Host {
+
+size_t heap_peak()
+{
+    return Kernel::s_heap_peak - (uintptr_t)Kernel::s_heap;
+}
+
+}
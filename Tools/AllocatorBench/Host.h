@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+// The memory that the kernel heap grows into on the host, see Host.cpp.
+namespace Host {
+
+size_t heap_peak();
+
+}
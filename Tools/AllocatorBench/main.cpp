@@ -0,0 +1,376 @@
+#include "../../src/kernel/Log.h"
+#include "../../src/kernel/MemoryManagement.h"
+#include "Host.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+using Kernel::MemoryManagement;
+
+// Every workload is turned into a list of operations up-front, so that the only thing being timed is the allocator.
+// Allocations are referred to by a slot, which is an index into the table of live pointers.
+struct Operation {
+    enum class Type : u8 {
+        Allocate,
+        AllocateAligned,
+        Free,
+    };
+
+    Type type;
+    u32 slot;
+    u32 size;
+    u32 alignment;
+};
+
+struct Workload {
+    std::string name;
+    std::vector<Operation> operations;
+    u32 slot_count;
+};
+
+struct Options {
+    u64 operations = 1000000;
+    u64 seed = 1;
+    MemoryManagement::ZeroingPolicy zeroing_policy = MemoryManagement::ZeroingPolicy::ScrubOnFree;
+};
+
+// Most kernel allocations are small, with the occasional buffer.
+static u32 random_size(std::mt19937_64& random)
+{
+    auto bucket = random() % 100;
+    if (bucket < 80) {
+        return 16 + random() % 241;
+    }
+
+    if (bucket < 95) {
+        return 256 + random() % 3841;
+    }
+
+    return 4096 + random() % 61441;
+}
+
+// Allocations and frees in a random order, with up to `live_limit` allocations alive at once.
+static Workload random_workload(const Options& options)
+{
+    constexpr u32 live_limit = 10000;
+
+    std::mt19937_64 random(options.seed);
+    Workload workload { "random", {}, live_limit };
+
+    std::vector<u32> live;
+    std::vector<u32> free_slots;
+    for (u32 i = 0; i < live_limit; i++) {
+        free_slots.push_back(live_limit - 1 - i);
+    }
+
+    while (workload.operations.size() < options.operations) {
+        if (!free_slots.empty() && (live.empty() || random() % 2 == 0)) {
+            auto slot = free_slots.back();
+            free_slots.pop_back();
+
+            workload.operations.push_back({ Operation::Type::Allocate, slot, random_size(random), 0 });
+            live.push_back(slot);
+        } else {
+            auto index = random() % live.size();
+            auto slot = live[index];
+            live[index] = live.back();
+            live.pop_back();
+
+            workload.operations.push_back({ Operation::Type::Free, slot, 0, 0 });
+            free_slots.push_back(slot);
+        }
+    }
+
+    return workload;
+}
+
+// Batches of allocations, which are free'd in the opposite order (LIFO) or in the same order (FIFO).
+static Workload batch_workload(const Options& options, bool last_in_first_out)
+{
+    constexpr u32 batch_size = 1000;
+
+    std::mt19937_64 random(options.seed);
+    Workload workload { last_in_first_out ? "lifo" : "fifo", {}, batch_size };
+
+    while (workload.operations.size() < options.operations) {
+        for (u32 slot = 0; slot < batch_size; slot++) {
+            workload.operations.push_back({ Operation::Type::Allocate, slot, random_size(random), 0 });
+        }
+
+        for (u32 i = 0; i < batch_size; i++) {
+            auto slot = last_in_first_out ? batch_size - 1 - i : i;
+            workload.operations.push_back({ Operation::Type::Free, slot, 0, 0 });
+        }
+    }
+
+    return workload;
+}
+
+// A queue of messages, where the consumer falls behind and catches up again at random.
+static Workload producer_consumer_workload(const Options& options)
+{
+    constexpr u32 queue_capacity = 4096;
+
+    std::mt19937_64 random(options.seed);
+    Workload workload { "producer-consumer", {}, queue_capacity };
+
+    u64 head = 0;
+    u64 tail = 0;
+    while (workload.operations.size() < options.operations) {
+        auto produced = random() % 64;
+        for (u64 i = 0; i < produced && head - tail < queue_capacity; i++) {
+            workload.operations.push_back({ Operation::Type::Allocate, (u32)(head++ % queue_capacity), (u32)(32 + random() % 993), 0 });
+        }
+
+        auto consumed = random() % 64;
+        for (u64 i = 0; i < consumed && tail < head; i++) {
+            workload.operations.push_back({ Operation::Type::Free, (u32)(tail++ % queue_capacity), 0, 0 });
+        }
+    }
+
+    return workload;
+}
+
+// Reads a trace that was recorded at MemoryManagement's Trace log level (see src/kernel/Kernel.h). Every line that
+// isn't part of the trace is ignored, so the whole serial log can be passed in as-is.
+static bool trace_workload(const char* path, Workload& workload)
+{
+    auto file = fopen(path, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to open %s!\n", path);
+        return false;
+    }
+
+    workload = Workload { path, {}, 0 };
+
+    std::unordered_map<u64, u32> slots;
+    std::vector<u32> free_slots;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        // Replaying a trace with holes in it would free allocations that it never made, and leak others.
+        if (strstr(line, "records were dropped") != nullptr) {
+            fprintf(stderr, "%s: The kernel's log dropped records, so the trace is incomplete!\n", path);
+            fclose(file);
+            return false;
+        }
+
+        auto trace = strstr(line, "[trace] ");
+        if (trace == nullptr) {
+            continue;
+        }
+
+        char type = 0;
+        unsigned long long address = 0;
+        unsigned int size = 0;
+        unsigned int alignment = 0;
+        if (sscanf(trace + 8, "%c %llx %u %u", &type, &address, &size, &alignment) < 2) {
+            continue;
+        }
+
+        if (type == 'f') {
+            auto slot = slots.find(address);
+            if (slot == slots.end()) {
+                continue;
+            }
+
+            workload.operations.push_back({ Operation::Type::Free, slot->second, 0, 0 });
+            free_slots.push_back(slot->second);
+            slots.erase(slot);
+
+            continue;
+        }
+
+        u32 slot = workload.slot_count;
+        if (!free_slots.empty()) {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            workload.slot_count++;
+        }
+
+        slots[address] = slot;
+
+        if (type == 'A') {
+            workload.operations.push_back({ Operation::Type::AllocateAligned, slot, size, alignment });
+        } else {
+            workload.operations.push_back({ Operation::Type::Allocate, slot, size, 0 });
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void run(const Workload& workload, const Options& options)
+{
+    auto& memory_management = MemoryManagement::instance();
+    memory_management.set_zeroing_policy(options.zeroing_policy);
+
+    std::vector<u8*> slots(workload.slot_count, nullptr);
+    u64 live_bytes = 0;
+    u64 peak_live_bytes = 0;
+    std::vector<u32> sizes(workload.slot_count, 0);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& operation : workload.operations) {
+        switch (operation.type) {
+        case Operation::Type::Allocate:
+        case Operation::Type::AllocateAligned: {
+            auto pointer = operation.type == Operation::Type::Allocate
+                ? memory_management.allocate(operation.size)
+                : memory_management.allocate_aligned(operation.size, operation.alignment);
+
+            if (pointer == nullptr) {
+                Kernel::Log::instance().drain();
+                fprintf(stderr, "%s: Failed to allocate %u bytes!\n", workload.name.c_str(), operation.size);
+                exit(1);
+            }
+
+            // Touch the allocation, like whoever asked for it would.
+            slots[operation.slot] = (u8*)pointer;
+            slots[operation.slot][0] = 1;
+
+            sizes[operation.slot] = operation.size;
+            live_bytes += operation.size;
+            if (live_bytes > peak_live_bytes) {
+                peak_live_bytes = live_bytes;
+            }
+
+            break;
+        }
+
+        case Operation::Type::Free:
+            memory_management.free(slots[operation.slot]);
+            slots[operation.slot] = nullptr;
+            live_bytes -= sizes[operation.slot];
+
+            break;
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    // The fragmentation is taken with whatever the workload left behind still alive.
+    auto statistics = memory_management.statistics();
+
+    printf("%-20s %10zu ops %8.1f ns/op   peak heap %8zu KiB (peak live %8llu KiB)   heap %8zu KiB   free %8zu KiB   fragmentation %3zu%%\n",
+        workload.name.c_str(),
+        workload.operations.size(),
+        (double)nanoseconds / workload.operations.size(),
+        Host::heap_peak() / 1024,
+        (unsigned long long)peak_live_bytes / 1024,
+        statistics.heap_size / 1024,
+        (statistics.free_bytes + statistics.cached_bytes) / 1024,
+        statistics.fragmentation);
+}
+
+// The allocator is a singleton that can't be reset, so every workload runs in a process of its own.
+static void run_in_child(const Workload& workload, const Options& options)
+{
+    fflush(stdout);
+
+    auto child = fork();
+    if (child == 0) {
+        run(workload, options);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+}
+
+static void print_usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [--workload random|lifo|fifo|producer-consumer|all] [--trace <file>] [--ops <count>] [--seed <seed>] [--zeroing scrub|zero|none]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::string workload_name = "all";
+    const char* trace_path = nullptr;
+
+    for (auto i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (argument == "--workload") {
+            workload_name = value;
+        } else if (argument == "--trace") {
+            trace_path = argv[i];
+        } else if (argument == "--ops") {
+            options.operations = std::stoull(value);
+        } else if (argument == "--seed") {
+            options.seed = std::stoull(value);
+        } else if (argument == "--zeroing") {
+            if (value == "scrub") {
+                options.zeroing_policy = MemoryManagement::ZeroingPolicy::ScrubOnFree;
+            } else if (value == "zero") {
+                options.zeroing_policy = MemoryManagement::ZeroingPolicy::ZeroOnAllocate;
+            } else if (value == "none") {
+                options.zeroing_policy = MemoryManagement::ZeroingPolicy::None;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (trace_path != nullptr) {
+        Workload workload;
+        if (!trace_workload(trace_path, workload)) {
+            return 1;
+        }
+
+        run_in_child(workload, options);
+        return 0;
+    }
+
+    auto all = workload_name == "all";
+    auto found = false;
+
+    if (all || workload_name == "random") {
+        run_in_child(random_workload(options), options);
+        found = true;
+    }
+
+    if (all || workload_name == "lifo") {
+        run_in_child(batch_workload(options, true), options);
+        found = true;
+    }
+
+    if (all || workload_name == "fifo") {
+        run_in_child(batch_workload(options, false), options);
+        found = true;
+    }
+
+    if (all || workload_name == "producer-consumer") {
+        run_in_child(producer_consumer_workload(options), options);
+        found = true;
+    }
+
+    if (!found) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    return 0;
+}
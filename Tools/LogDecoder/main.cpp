@@ -0,0 +1,347 @@
+#include "../../src/kernel/Log.h"
+#include <cstdio>
+#include <cstring>
+#include <elf.h>
+#include <string>
+#include <vector>
+
+using Kernel::Log;
+using Kernel::LogLevel;
+
+// Turns the binary records of deferred log messages back into text (see src/kernel/Log.h), and passes everything
+// else in the serial capture through as-is.
+
+struct Options {
+    bool print_statistics = false;
+};
+
+// Timestamps and pointers are sent as the difference from the ones before them.
+struct State {
+    u64 timestamp = 0;
+    u64 pointer = 0;
+};
+
+struct Statistics {
+    u64 records = 0;
+    u64 bytes_in = 0;
+    u64 bytes_out = 0;
+};
+
+static bool read_file(FILE* file, std::vector<u8>& data)
+{
+    u8 buffer[65536];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + size);
+    }
+
+    return !ferror(file);
+}
+
+// Finds the .log_formats section in the kernel's ELF, which is where every deferred message's entry lives.
+static bool read_log_formats(const char* path, std::vector<u8>& section, u64& section_address)
+{
+    auto file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to open %s!\n", path);
+        return false;
+    }
+
+    std::vector<u8> elf;
+    auto success = read_file(file, elf);
+    fclose(file);
+
+    if (!success || elf.size() < sizeof(Elf64_Ehdr) || memcmp(elf.data(), ELFMAG, SELFMAG) != 0 || elf[EI_CLASS] != ELFCLASS64) {
+        fprintf(stderr, "%s is not a 64-bit ELF file!\n", path);
+        return false;
+    }
+
+    auto header = (const Elf64_Ehdr*)elf.data();
+    if (header->e_shoff + (u64)header->e_shnum * sizeof(Elf64_Shdr) > elf.size() || header->e_shstrndx >= header->e_shnum) {
+        fprintf(stderr, "%s has a broken section header table!\n", path);
+        return false;
+    }
+
+    auto sections = (const Elf64_Shdr*)(elf.data() + header->e_shoff);
+    auto& names = sections[header->e_shstrndx];
+
+    for (size_t i = 0; i < header->e_shnum; i++) {
+        auto& candidate = sections[i];
+        if (names.sh_offset + candidate.sh_name >= elf.size() || strcmp((const char*)elf.data() + names.sh_offset + candidate.sh_name, ".log_formats") != 0) {
+            continue;
+        }
+
+        if (candidate.sh_offset + candidate.sh_size > elf.size()) {
+            break;
+        }
+
+        section.assign(elf.begin() + candidate.sh_offset, elf.begin() + candidate.sh_offset + candidate.sh_size);
+        section_address = candidate.sh_addr;
+        return true;
+    }
+
+    fprintf(stderr, "%s doesn't have a .log_formats section, was it built with LOG_DEFERRED?\n", path);
+    return false;
+}
+
+class Reader {
+public:
+    Reader(const std::vector<u8>& data, size_t position)
+        : m_data(data)
+        , m_position(position)
+    {
+    }
+
+    bool read_varint(u64& value)
+    {
+        value = 0;
+        for (u32 shift = 0; shift < 64; shift += 7) {
+            if (m_position >= m_data.size()) {
+                return false;
+            }
+
+            auto byte = m_data[m_position++];
+            value |= (u64)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool read_bytes(std::string& string, size_t size)
+    {
+        if (m_position + size > m_data.size()) {
+            return false;
+        }
+
+        string.assign((const char*)m_data.data() + m_position, size);
+        m_position += size;
+        return true;
+    }
+
+    size_t position() const { return m_position; }
+
+private:
+    const std::vector<u8>& m_data;
+    size_t m_position;
+};
+
+static i64 unzigzag(u64 value)
+{
+    return (i64)(value >> 1) ^ -(i64)(value & 1);
+}
+
+// The same format strings as FormatString accepts, but parsed at runtime.
+static void format_message(FormatBuffer& buffer, const char* string, const FormatArgument* arguments, size_t argument_count)
+{
+    size_t argument = 0;
+
+    for (auto character = string; *character != '\0'; character++) {
+        if (*character == '\\' && character[1] != '\0') {
+            buffer.append(*++character);
+            continue;
+        }
+
+        if (*character != '{') {
+            buffer.append(*character);
+            continue;
+        }
+
+        FormatSpecifier specifier { 0, 0, false };
+        auto end = character + 1;
+
+        if (*end == '0') {
+            specifier.zero_pad = true;
+            end++;
+        }
+
+        while (*end >= '0' && *end <= '9') {
+            specifier.width = specifier.width * 10 + (*end - '0');
+            end++;
+        }
+
+        if (*end != '}' && *end != '\0') {
+            specifier.type = *end++;
+        }
+
+        if (*end != '}' || argument >= argument_count) {
+            buffer.append("<bad format string>", 19);
+            return;
+        }
+
+        format_argument(buffer, specifier, arguments[argument++]);
+        character = end;
+    }
+}
+
+static void write_to_stdout(void* statistics, const char* data, size_t size)
+{
+    ((Statistics*)statistics)->bytes_out += size;
+    fwrite(data, 1, size, stdout);
+}
+
+// Decodes the record that starts after the marker at `position`, and returns where it ends, or 0 if it is broken.
+static size_t decode_record(const std::vector<u8>& capture, size_t position, const std::vector<u8>& formats, u64 formats_address, State& state, Statistics& statistics)
+{
+    Reader reader(capture, position);
+
+    u64 timestamp_delta;
+    u64 entry_id;
+    if (!reader.read_varint(timestamp_delta) || !reader.read_varint(entry_id)) {
+        return 0;
+    }
+
+    auto entry_address = entry_id * Kernel::DeferredLogEntryAlignment;
+
+    // [level] [argument count] [argument types...] [subsystem] \0 [format string] \0
+    if (entry_address < formats_address || entry_address - formats_address + 2 > formats.size()) {
+        return 0;
+    }
+
+    auto entry = formats.data() + (entry_address - formats_address);
+    auto entry_end = formats.data() + formats.size();
+
+    auto level = (LogLevel)entry[0];
+    auto argument_count = entry[1];
+    auto types = entry + 2;
+
+    auto subsystem = (const char*)types + argument_count;
+    if (argument_count > Log::MaxDeferredArguments || (const u8*)subsystem >= entry_end) {
+        return 0;
+    }
+
+    auto subsystem_end = (const u8*)memchr(subsystem, '\0', entry_end - (const u8*)subsystem);
+    if (subsystem_end == nullptr) {
+        return 0;
+    }
+
+    auto string = (const char*)subsystem_end + 1;
+    if (memchr(string, '\0', entry_end - (const u8*)string) == nullptr) {
+        return 0;
+    }
+
+    FormatArgument arguments[Log::MaxDeferredArguments];
+    std::string strings[Log::MaxDeferredArguments];
+
+    for (size_t i = 0; i < argument_count; i++) {
+        auto& argument = arguments[i];
+        argument.type = (FormatArgument::Type)(types[i] & 0xF);
+        argument.size = types[i] >> 4;
+
+        u64 value;
+        if (!reader.read_varint(value)) {
+            return 0;
+        }
+
+        if (argument.type == FormatArgument::Type::Signed) {
+            argument.integer = (u64)unzigzag(value);
+        } else if (argument.type == FormatArgument::Type::Pointer) {
+            state.pointer += (u64)unzigzag(value);
+            argument.integer = state.pointer;
+        } else if (argument.type == FormatArgument::Type::String) {
+            if (!reader.read_bytes(strings[i], value)) {
+                return 0;
+            }
+
+            argument.string = strings[i].c_str();
+        } else {
+            argument.integer = value;
+        }
+    }
+
+    state.timestamp += (u64)unzigzag(timestamp_delta);
+
+    {
+        FormatBuffer buffer(write_to_stdout, &statistics);
+        format(buffer, "[{12i}] [{s}] ", state.timestamp, subsystem);
+
+        if (level == LogLevel::Error) {
+            format(buffer, "ERROR: ");
+        } else if (level == LogLevel::Warning) {
+            format(buffer, "WARNING: ");
+        }
+
+        format_message(buffer, string, arguments, argument_count);
+        buffer.append("\r\n", 2);
+    }
+
+    statistics.records++;
+    statistics.bytes_in += reader.position() - position + 1;
+
+    return reader.position();
+}
+
+static void print_usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [--statistics] <phosphene ELF> [serial capture, or stdin if not given]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::vector<const char*> paths;
+
+    for (auto i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--statistics") == 0) {
+            options.print_statistics = true;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if (paths.empty() || paths.size() > 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<u8> formats;
+    u64 formats_address = 0;
+    if (!read_log_formats(paths[0], formats, formats_address)) {
+        return 1;
+    }
+
+    auto capture_file = paths.size() == 2 ? fopen(paths[1], "rb") : stdin;
+    if (capture_file == nullptr) {
+        fprintf(stderr, "Failed to open %s!\n", paths[1]);
+        return 1;
+    }
+
+    std::vector<u8> capture;
+    if (!read_file(capture_file, capture)) {
+        fprintf(stderr, "Failed to read the serial capture!\n");
+        return 1;
+    }
+
+    State state;
+    Statistics statistics;
+
+    for (size_t position = 0; position < capture.size(); position++) {
+        if (capture[position] != Log::DeferredRecordMarker) {
+            fputc(capture[position], stdout);
+            continue;
+        }
+
+        auto end = decode_record(capture, position + 1, formats, formats_address, state, statistics);
+        if (end == 0) {
+            fprintf(stderr, "Skipping a broken record at offset %zu!\n", position);
+            continue;
+        }
+
+        position = end - 1;
+    }
+
+    if (options.print_statistics && statistics.records != 0) {
+        fprintf(stderr, "Decoded %llu records from %llu bytes into %llu bytes of text (%.1fx smaller on the wire)\n",
+            (unsigned long long)statistics.records,
+            (unsigned long long)statistics.bytes_in,
+            (unsigned long long)statistics.bytes_out,
+            (double)statistics.bytes_out / statistics.bytes_in);
+    }
+
+    return 0;
+}
@@ -1,6 +1,76 @@
+#include "../kernel/Board.h"
+#include "../kernel/Exceptions.h"
+#include "../kernel/InterruptController.h"
 #include "../kernel/Kernel.h"
+#include "../kernel/Log.h"
+#include "../kernel/MMU.h"
+#include "../kernel/MemoryManagement.h"
+#include "../kernel/PageAllocator.h"
+#include "../kernel/Random.h"
+#include "../kernel/SMP.h"
+#include "../kernel/SecureRandom.h"
+#include "../kernel/TimerWheel.h"
+#include "../kernel/VirtualMemory.h"
+#include "../kernel/io/Mailbox.h"
+#include "../kernel/io/UART.h"
 
 extern "C" void init()
 {
+    // Everything that is kept per core (see PerCpu) is found through the core's CoreData.
+    Kernel::SMP::initialize();
+
+    // The MMU's device mappings and every peripheral register depend on where the peripherals are.
+    Kernel::Board::detect();
+
+    // Until the MMU is on, every access is uncached, and has to be aligned.
+    Kernel::MMU::initialize();
+
+    // The heap is backed on demand by the page fault handler, so this has to happen before anything is allocated.
+    Kernel::Exceptions::initialize();
+
+    // Anything logged before this is kept, and written out with everything else.
+    Kernel::Log::instance().initialize();
+
+    // With -fno-threadsafe-statics, two cores that get to a singleton at the same time would both construct it, so
+    // every singleton that is shared between cores has to exist before there is more than one core.
+    Kernel::Mailbox::instance();
+    Kernel::UART::instance();
+    Kernel::PageAllocator::instance();
+    Kernel::VirtualMemory::instance();
+    Kernel::MemoryManagement::instance();
+    Kernel::Random::instance();
+    Kernel::SecureRandom::instance();
+
+    // Every IRQ stays disabled until a driver registers a handler for it.
+    Kernel::InterruptController::instance().initialize();
+    Kernel::TimerWheel::instance().initialize();
+
+    // From here on, the log is written out every few milliseconds, not only when a core has nothing else to do.
+    Kernel::Log::instance().start_draining();
+
+    // The other cores wait for work from SMP::run_on_core() from here on.
+    Kernel::SMP::start_secondary_cores();
+
+    // From here on, printing only costs as much as copying the text into the UART's buffer.
+    Kernel::UART::instance().enable_interrupts();
+    Kernel::Interrupts::enable();
+
     Kernel::main();
 }
+
+// Where secondary_start (see boot.S) goes, on the core's own stack, with its MMU still off.
+extern "C" void secondary_init(u64 core)
+{
+    // Like SMP::initialize() on the boot core, this has to come before anything uses a PerCpu (such as TimerWheel),
+    // or takes an exception.
+    Kernel::SMP::initialize_secondary_core(core);
+
+    Kernel::MMU::enable();
+    Kernel::Exceptions::initialize();
+
+    Kernel::InterruptController::instance().initialize_core();
+    Kernel::TimerWheel::instance().initialize_core();
+    Kernel::Interrupts::enable();
+
+    Kernel::SMP::run_secondary_core(core);
+}
@@ -0,0 +1,98 @@
+#include "ChaCha20.h"
+
+static u32 rotate_left(u32 value, int shift)
+{
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static void quarter_round(u32 (&state)[16], int a, int b, int c, int d)
+{
+    state[a] += state[b];
+    state[d] = rotate_left(state[d] ^ state[a], 16);
+    state[c] += state[d];
+    state[b] = rotate_left(state[b] ^ state[c], 12);
+    state[a] += state[b];
+    state[d] = rotate_left(state[d] ^ state[a], 8);
+    state[c] += state[d];
+    state[b] = rotate_left(state[b] ^ state[c], 7);
+}
+
+// 2.3. The ChaCha20 Block Function
+void ChaCha20::block(const u32 (&key)[8], u32 counter, const u32 (&nonce)[3], u32 (&output)[16])
+{
+    // "expand 32-byte k"
+    u32 state[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3],
+        key[4], key[5], key[6], key[7],
+        counter, nonce[0], nonce[1], nonce[2]
+    };
+
+    for (auto i = 0; i < 16; i++) {
+        output[i] = state[i];
+    }
+
+    // 20 rounds, alternating between the columns and the diagonals.
+    for (auto i = 0; i < 10; i++) {
+        quarter_round(output, 0, 4, 8, 12);
+        quarter_round(output, 1, 5, 9, 13);
+        quarter_round(output, 2, 6, 10, 14);
+        quarter_round(output, 3, 7, 11, 15);
+
+        quarter_round(output, 0, 5, 10, 15);
+        quarter_round(output, 1, 6, 11, 12);
+        quarter_round(output, 2, 7, 8, 13);
+        quarter_round(output, 3, 4, 9, 14);
+    }
+
+    for (auto i = 0; i < 16; i++) {
+        output[i] += state[i];
+    }
+}
+
+void ChaCha20::seed(const u8 (&key)[KeySize])
+{
+    for (size_t i = 0; i < KeySize; i++) {
+        m_key[i / 4] ^= (u32)key[i] << ((i % 4) * 8);
+    }
+
+    // Nothing that was generated with the old key may be handed out anymore.
+    this->generate_batch();
+    m_bytes_since_seed = 0;
+}
+
+void ChaCha20::generate_batch()
+{
+    // Every batch has a key of its own, so the nonce and counter can start over every time.
+    const u32 nonce[3] = { 0, 0, 0 };
+
+    for (size_t i = 0; i < BlocksPerBatch; i++) {
+        block(m_key, i, nonce, *(u32(*)[16])(m_batch + i * 16));
+    }
+
+    // The first 32 bytes are the next key, and are never handed out.
+    for (size_t i = 0; i < 8; i++) {
+        m_key[i] = m_batch[i];
+        m_batch[i] = 0;
+    }
+
+    m_batch_position = 8;
+}
+
+void ChaCha20::fill(void* buffer, size_t size)
+{
+    auto bytes = (u8*)buffer;
+
+    // A whole word is used up even if only some of its bytes are needed.
+    while (size > 0) {
+        auto value = this->next_u32();
+        auto count = size < sizeof(value) ? size : sizeof(value);
+
+        for (size_t i = 0; i < count; i++) {
+            bytes[i] = (u8)(value >> (i * 8));
+        }
+
+        bytes += count;
+        size -= count;
+    }
+}
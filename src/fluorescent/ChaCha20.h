@@ -0,0 +1,58 @@
+#pragma once
+
+#include "../types/integer.h"
+#include "UniformRandom.h"
+
+// A cryptographically secure generator, which is the ChaCha20 keystream of a secret key.
+// https://www.rfc-editor.org/rfc/rfc8439 (ChaCha20 and Poly1305 for IETF Protocols)
+//
+// Blocks are generated a few at a time, and the start of every batch immediately replaces the key ("fast key
+// erasure"), so whatever is handed out later can't be used to work out anything that was handed out earlier.
+// https://blog.cr.yp.to/20170723-random.html
+class ChaCha20 : public UniformRandom<ChaCha20> {
+public:
+    static constexpr size_t KeySize = 32;
+    static constexpr size_t BlockSize = 64;
+    static constexpr size_t BlocksPerBatch = 8;
+
+    // The ChaCha20 block function, with a 32-bit counter and a 96-bit nonce (RFC 8439, 2.3).
+    static void block(const u32 (&key)[8], u32 counter, const u32 (&nonce)[3], u32 (&output)[16]);
+
+    // Mixes `key` into the current key, so reseeding can only ever add to what the generator knows.
+    void seed(const u8 (&key)[KeySize]);
+
+    void fill(void* buffer, size_t size);
+
+    u32 next_u32()
+    {
+        if (m_batch_position == WordsPerBatch) {
+            this->generate_batch();
+        }
+
+        // Whatever has been handed out is wiped, so that it can't be found again later.
+        auto& word = m_batch[m_batch_position++];
+        auto value = word;
+        word = 0;
+
+        m_bytes_since_seed += sizeof(value);
+        return value;
+    }
+
+    u64 next_u64() { return (u64)this->next_u32() << 32 | this->next_u32(); }
+
+    // How many bytes have been handed out since the last seed().
+    u64 bytes_since_seed() const { return m_bytes_since_seed; }
+
+private:
+    static constexpr size_t WordsPerBatch = BlockSize / sizeof(u32) * BlocksPerBatch;
+
+    void generate_batch();
+
+    u32 m_key[8] {};
+
+    // In words, the first 8 of every batch are the next key.
+    u32 m_batch[WordsPerBatch] {};
+    size_t m_batch_position { WordsPerBatch };
+
+    u64 m_bytes_since_seed { 0 };
+};
@@ -1,9 +1,11 @@
 #include "Fluorescent.h"
-#include "../kernel/Random.h"
-#include "../kernel/io/UART.h"
+#include "../kernel/FastRandom.h"
 
 int random(int min, int max)
 {
-    auto random = Kernel::Random::instance()->get();
-    return random % (max - min);
+    if (max <= min) {
+        return min;
+    }
+
+    return (int)Kernel::FastRandom::current().between(min, (i64)max - 1);
 }
@@ -1,3 +1,4 @@
 #pragma once
 
-int random(int min = 0, int max = 0);
\ No newline at end of file
+// A random number in [min, max), or `min` if the range is empty. This isn't secure, see Kernel::SecureRandom.
+int random(int min = 0, int max = 0);
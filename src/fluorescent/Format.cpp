@@ -0,0 +1,157 @@
+#include "Format.h"
+
+void format_error(const char*)
+{
+}
+
+void FormatBuffer::append(const char* data, size_t size)
+{
+    // Anything that doesn't fit in what is left of the buffer goes straight through, there's no point in copying it.
+    if (m_size + size > Capacity) {
+        this->flush();
+
+        if (size > Capacity) {
+            m_flush(m_context, data, size);
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        m_data[m_size + i] = data[i];
+    }
+
+    m_size += size;
+}
+
+// There is no libc to call strlen() from.
+static size_t string_length(const char* string)
+{
+    size_t length = 0;
+    while (string[length] != '\0') {
+        length++;
+    }
+
+    return length;
+}
+
+static void format_padding(FormatBuffer& buffer, FormatSpecifier specifier, size_t length)
+{
+    for (auto i = length; i < specifier.width; i++) {
+        buffer.append(specifier.zero_pad ? '0' : ' ');
+    }
+}
+
+static void format_integer(FormatBuffer& buffer, FormatSpecifier specifier, u64 value, u32 base, bool is_negative, const char* prefix)
+{
+    const char* digits = "0123456789ABCDEF";
+
+    // 64 bits in binary is the longest that this can get, we only go down to base 10 though.
+    char output[24];
+    auto index = sizeof(output);
+
+    do {
+        output[--index] = digits[value % base];
+        value /= base;
+    } while (value > 0);
+
+    auto length = sizeof(output) - index;
+    auto prefix_length = string_length(prefix) + (is_negative ? 1 : 0);
+
+    // Zeros go between the sign (or prefix) and the digits, spaces go before everything.
+    if (!specifier.zero_pad) {
+        format_padding(buffer, specifier, length + prefix_length);
+    }
+
+    if (is_negative) {
+        buffer.append('-');
+    }
+
+    buffer.append(prefix, string_length(prefix));
+
+    if (specifier.zero_pad) {
+        format_padding(buffer, specifier, length + prefix_length);
+    }
+
+    buffer.append(output + index, length);
+}
+
+void format_argument(FormatBuffer& buffer, FormatSpecifier specifier, const FormatArgument& argument)
+{
+    using Type = FormatArgument::Type;
+
+    auto type = specifier.type;
+    if (type == 0) {
+        switch (argument.type) {
+        case Type::Pointer:
+            type = '#';
+            break;
+
+        case Type::String:
+            type = 's';
+            break;
+
+        case Type::Bool:
+            type = 'b';
+            break;
+
+        case Type::Char:
+            type = 'c';
+            break;
+
+        default:
+            type = 'i';
+            break;
+        }
+    }
+
+    // Negative numbers are written in hexadecimal as they are stored, at the width of their original type.
+    auto integer = argument.integer;
+    if (argument.type == Type::Signed && argument.size < 8) {
+        integer &= ((u64)1 << (argument.size * 8)) - 1;
+    }
+
+    switch (type) {
+    case 'i':
+        if (argument.type == Type::Signed && (i64)argument.integer < 0) {
+            format_integer(buffer, specifier, -(u64)argument.integer, 10, true, "");
+        } else {
+            format_integer(buffer, specifier, argument.integer, 10, false, "");
+        }
+
+        break;
+
+    case '#':
+        format_integer(buffer, specifier, integer, 16, false, "0x");
+        break;
+
+    case 'x':
+        format_integer(buffer, specifier, integer, 16, false, "");
+        break;
+
+    case 's': {
+        auto string = argument.string ? argument.string : "(null)";
+        auto length = string_length(string);
+
+        format_padding(buffer, specifier, length);
+        buffer.append(string, length);
+
+        break;
+    }
+
+    case 'b': {
+        auto string = argument.integer ? "true" : "false";
+        auto length = string_length(string);
+
+        format_padding(buffer, specifier, length);
+        buffer.append(string, length);
+
+        break;
+    }
+
+    case 'c':
+        format_padding(buffer, specifier, 1);
+        buffer.append((char)argument.integer);
+
+        break;
+    }
+}
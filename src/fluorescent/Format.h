@@ -0,0 +1,422 @@
+#pragma once
+
+#include "../types/integer.h"
+
+// A type-safe formatter, where the format string is parsed and checked against the arguments at compile time.
+//
+// Arguments are written with `{[0][width]type}`:
+// - `{i}`: An integer (or enum) in decimal
+// - `{#}`: An integer (or pointer) in hexadecimal, prefixed with 0x
+// - `{x}`: An integer (or pointer) in hexadecimal, without a prefix
+// - `{s}`: A string
+// - `{b}`: A boolean, as `true` or `false`
+// - `{c}`: A single character
+// - `{}`: Whatever suits the type of the argument
+//
+// For example, `{08x}` pads the value with zeros to 8 digits, and `{4i}` pads it with spaces to 4 characters.
+// A backslash writes the character after it as-is, so `\\{` writes a `{`.
+
+template <typename T>
+struct TypeIdentityWrapper {
+    using Type = T;
+};
+
+// Stops the compiler from deducing the argument types from the format string, see FormatString.
+template <typename T>
+using TypeIdentity = typename TypeIdentityWrapper<T>::Type;
+
+struct FormatSpecifier {
+    char type;
+    u8 width;
+    bool zero_pad;
+};
+
+// Every argument is turned into one of these before it is written, so that only one copy of the code which writes
+// them exists, no matter how many different types and call sites there are.
+struct FormatArgument {
+    enum class Type : u8 {
+        Unsigned,
+        Signed,
+        Pointer,
+        String,
+        Bool,
+        Char,
+    };
+
+    Type type;
+
+    // The size of the original integer, so that negative numbers can be written in hexadecimal at their own width.
+    u8 size;
+
+    union {
+        u64 integer;
+        const char* string;
+    };
+};
+
+template <typename T>
+struct IsCharacterPointer {
+    static constexpr bool value = false;
+};
+
+template <>
+struct IsCharacterPointer<char*> {
+    static constexpr bool value = true;
+};
+
+template <>
+struct IsCharacterPointer<const char*> {
+    static constexpr bool value = true;
+};
+
+template <typename T>
+struct RemoveConstVolatile {
+    using Type = T;
+};
+
+template <typename T>
+struct RemoveConstVolatile<const T> {
+    using Type = T;
+};
+
+template <typename T>
+struct RemoveConstVolatile<volatile T> {
+    using Type = T;
+};
+
+template <typename T>
+struct RemoveConstVolatile<const volatile T> {
+    using Type = T;
+};
+
+template <typename T>
+struct Decay {
+    using Type = typename RemoveConstVolatile<T>::Type;
+};
+
+template <typename T, size_t N>
+struct Decay<T[N]> {
+    using Type = T*;
+};
+
+template <typename T, size_t N>
+struct Decay<const T[N]> {
+    using Type = const T*;
+};
+
+template <typename T>
+struct IsPointer {
+    static constexpr bool value = false;
+};
+
+template <typename T>
+struct IsPointer<T*> {
+    static constexpr bool value = true;
+};
+
+template <typename T>
+struct IsInteger {
+    static constexpr bool value = false;
+};
+
+#define FORMAT_INTEGER_TYPE(type)                \
+    template <>                                  \
+    struct IsInteger<type> {                     \
+        static constexpr bool value = true;      \
+    };
+
+FORMAT_INTEGER_TYPE(char)
+FORMAT_INTEGER_TYPE(signed char)
+FORMAT_INTEGER_TYPE(unsigned char)
+FORMAT_INTEGER_TYPE(short)
+FORMAT_INTEGER_TYPE(unsigned short)
+FORMAT_INTEGER_TYPE(int)
+FORMAT_INTEGER_TYPE(unsigned int)
+FORMAT_INTEGER_TYPE(long)
+FORMAT_INTEGER_TYPE(unsigned long)
+FORMAT_INTEGER_TYPE(long long)
+FORMAT_INTEGER_TYPE(unsigned long long)
+
+#undef FORMAT_INTEGER_TYPE
+
+template <typename T>
+consteval FormatArgument::Type format_argument_type()
+{
+    using Type = typename Decay<T>::Type;
+
+    if constexpr (IsCharacterPointer<Type>::value) {
+        return FormatArgument::Type::String;
+    } else if constexpr (__is_same(Type, bool)) {
+        return FormatArgument::Type::Bool;
+    } else if constexpr (__is_same(Type, char)) {
+        return FormatArgument::Type::Char;
+    } else if constexpr (IsPointer<Type>::value) {
+        return FormatArgument::Type::Pointer;
+    } else if constexpr (__is_enum(Type)) {
+        return format_argument_type<__underlying_type(Type)>();
+    } else if constexpr (IsInteger<Type>::value) {
+        return (Type)-1 < (Type)0 ? FormatArgument::Type::Signed : FormatArgument::Type::Unsigned;
+    } else {
+        static_assert(__is_same(Type, void), "This type can't be formatted!");
+        return FormatArgument::Type::Unsigned;
+    }
+}
+
+template <typename T>
+FormatArgument make_format_argument(const T& value)
+{
+    constexpr auto type = format_argument_type<T>();
+
+    FormatArgument argument {};
+    argument.type = type;
+    argument.size = sizeof(value);
+
+    if constexpr (type == FormatArgument::Type::String) {
+        argument.string = value;
+    } else if constexpr (type == FormatArgument::Type::Pointer) {
+        argument.integer = (uintptr_t)value;
+    } else if constexpr (type == FormatArgument::Type::Signed) {
+        argument.integer = (u64)(i64)value;
+    } else {
+        argument.integer = (u64)value;
+    }
+
+    return argument;
+}
+
+// This isn't constexpr, so calling it while parsing a format string is what makes a bad format string fail to compile.
+void format_error(const char* message);
+
+// A format string, split up at compile time into chunks of literal text, each followed by (at most) one argument.
+// Escaped characters split the literal text too, as the backslash itself has to be skipped.
+template <typename... Arguments>
+class FormatString {
+public:
+    static constexpr size_t ArgumentCount = sizeof...(Arguments);
+
+    // The most escaped characters that a single format string can have.
+    static constexpr size_t MaxEscapes = 8;
+    static constexpr size_t MaxChunks = ArgumentCount + MaxEscapes + 1;
+
+    struct Chunk {
+        u16 literal_start;
+        u16 literal_length;
+
+        // -1 if this chunk is only literal text
+        i8 argument;
+        FormatSpecifier specifier;
+    };
+
+    template <size_t N>
+    consteval FormatString(const char (&string)[N])
+        : m_string(string)
+    {
+        static_assert(N < 0xFFFF, "Format strings must be shorter than 64 KiB!");
+
+        constexpr FormatArgument::Type argument_types[ArgumentCount + 1] = { format_argument_type<Arguments>()... };
+
+        size_t literal_start = 0;
+        size_t argument = 0;
+
+        for (size_t i = 0; i < N - 1; i++) {
+            auto character = string[i];
+
+            if (character == '}') {
+                format_error("Unmatched '}' in format string, use '\\}' to write a '}'!");
+            }
+
+            if (character != '\\' && character != '{') {
+                continue;
+            }
+
+            if (character == '\\') {
+                if (i + 1 >= N - 1) {
+                    format_error("Format string ends with a '\\'!");
+                }
+
+                // The escaped character starts the next chunk of literal text.
+                this->add_chunk(literal_start, i - literal_start, -1, {});
+                literal_start = ++i;
+
+                continue;
+            }
+
+            // {[0][width]type}
+            FormatSpecifier specifier { 0, 0, false };
+            auto end = i + 1;
+
+            if (string[end] == '0') {
+                specifier.zero_pad = true;
+                end++;
+            }
+
+            while (string[end] >= '0' && string[end] <= '9') {
+                specifier.width = specifier.width * 10 + (string[end] - '0');
+                end++;
+            }
+
+            if (string[end] != '}') {
+                specifier.type = string[end++];
+            }
+
+            if (string[end] != '}') {
+                format_error("Unterminated argument in format string!");
+            }
+
+            if (argument >= ArgumentCount) {
+                format_error("Format string has more arguments than were passed in!");
+            }
+
+            check_specifier(specifier, argument_types[argument]);
+
+            this->add_chunk(literal_start, i - literal_start, argument++, specifier);
+            literal_start = end + 1;
+            i = end;
+        }
+
+        if (argument != ArgumentCount) {
+            format_error("Format string has less arguments than were passed in!");
+        }
+
+        this->add_chunk(literal_start, N - 1 - literal_start, -1, {});
+    }
+
+    const char* string() const { return m_string; }
+    const Chunk* chunks() const { return m_chunks; }
+    size_t chunk_count() const { return m_chunk_count; }
+
+private:
+    consteval void add_chunk(size_t literal_start, size_t literal_length, i8 argument, FormatSpecifier specifier)
+    {
+        // There is no point in keeping empty literals around.
+        if (literal_length == 0 && argument < 0) {
+            return;
+        }
+
+        if (m_chunk_count == MaxChunks) {
+            format_error("Format string has too many escaped characters!");
+        }
+
+        m_chunks[m_chunk_count++] = { (u16)literal_start, (u16)literal_length, argument, specifier };
+    }
+
+    static consteval void check_specifier(FormatSpecifier specifier, FormatArgument::Type type)
+    {
+        using Type = FormatArgument::Type;
+
+        auto is_integer = type == Type::Unsigned || type == Type::Signed || type == Type::Bool || type == Type::Char;
+
+        switch (specifier.type) {
+        case 0:
+            return;
+
+        case 'i':
+            if (!is_integer) {
+                format_error("{i} needs an integer!");
+            }
+
+            return;
+
+        case '#':
+        case 'x':
+            if (!is_integer && type != Type::Pointer) {
+                format_error("{#} and {x} need an integer or a pointer!");
+            }
+
+            return;
+
+        case 's':
+            if (type != Type::String) {
+                format_error("{s} needs a string!");
+            }
+
+            return;
+
+        case 'b':
+            if (!is_integer && type != Type::Pointer) {
+                format_error("{b} needs a boolean!");
+            }
+
+            return;
+
+        case 'c':
+            if (!is_integer) {
+                format_error("{c} needs a character!");
+            }
+
+            return;
+
+        default:
+            format_error("Unsupported format type!");
+        }
+    }
+
+    const char* m_string;
+
+    Chunk m_chunks[MaxChunks] {};
+    size_t m_chunk_count { 0 };
+};
+
+// Formatted text is collected here, and handed to `flush` in as few pieces as possible.
+class FormatBuffer {
+public:
+    static constexpr size_t Capacity = 128;
+
+    using Flush = void (*)(void* context, const char* data, size_t size);
+
+    FormatBuffer(Flush flush, void* context)
+        : m_flush(flush)
+        , m_context(context)
+    {
+    }
+
+    ~FormatBuffer() { this->flush(); }
+
+    FormatBuffer(const FormatBuffer&) = delete;
+    FormatBuffer& operator=(const FormatBuffer&) = delete;
+
+    void append(char character)
+    {
+        if (m_size == Capacity) {
+            this->flush();
+        }
+
+        m_data[m_size++] = character;
+    }
+
+    void append(const char* data, size_t size);
+
+    void flush()
+    {
+        if (m_size != 0) {
+            m_flush(m_context, m_data, m_size);
+            m_size = 0;
+        }
+    }
+
+private:
+    Flush m_flush;
+    void* m_context;
+
+    char m_data[Capacity];
+    size_t m_size { 0 };
+};
+
+// Writes a single argument, this is the only part of formatting which isn't decided at compile time.
+void format_argument(FormatBuffer& buffer, FormatSpecifier specifier, const FormatArgument& argument);
+
+template <typename... Arguments>
+void format(FormatBuffer& buffer, FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments)
+{
+    // The extra element keeps this from being an empty array when there are no arguments.
+    const FormatArgument format_arguments[] = { make_format_argument(arguments)..., {} };
+
+    for (size_t i = 0; i < string.chunk_count(); i++) {
+        auto& chunk = string.chunks()[i];
+        buffer.append(string.string() + chunk.literal_start, chunk.literal_length);
+
+        if (chunk.argument >= 0) {
+            format_argument(buffer, chunk.specifier, format_arguments[chunk.argument]);
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#include "Memory.h"
+
+#ifdef PHOSPHENE_HOST
+
+// The host tools only need this to be correct, the compiler knows how to clear memory quickly on the host.
+void zero_memory(void* destination, size_t size)
+{
+    __builtin_memset(destination, 0, size);
+}
+
+#else
+
+// https://developer.arm.com/documentation/ddi0601/2023-03/AArch64-Registers/DCZID-EL0--Data-Cache-Zero-ID-register?lang=en
+static size_t dc_zva_block_size()
+{
+    u64 dczid;
+    asm volatile("mrs %x0, dczid_el0"
+                 : "=r"(dczid));
+
+    // DZP (bit 4) means that we aren't allowed to use `dc zva`.
+    if (dczid & (1 << 4)) {
+        return 0;
+    }
+
+    // BS is the log2 of the block size in words.
+    return (size_t)4 << (dczid & 0xF);
+}
+
+// `dc zva` faults on Device memory, which is what all memory is treated as while the MMU or data cache is off.
+static bool is_normal_memory()
+{
+    u64 system_control;
+    asm volatile("mrs %x0, sctlr_el1"
+                 : "=r"(system_control));
+
+    // M (bit 0) is the MMU enable, C (bit 2) is the data cache enable.
+    return (system_control & 0b101) == 0b101;
+}
+
+void zero_memory(void* destination, size_t size)
+{
+    auto bytes = (u8*)destination;
+
+    // Everything below works on 16-byte aligned addresses, as unaligned accesses would fault on Device memory.
+    while (size > 0 && ((uintptr_t)bytes & 15) != 0) {
+        *bytes++ = 0;
+        size--;
+    }
+
+    if (size >= 256 && is_normal_memory()) {
+        auto block_size = dc_zva_block_size();
+        if (block_size != 0) {
+            while (size >= 16 && ((uintptr_t)bytes & (block_size - 1)) != 0) {
+                asm volatile("stp xzr, xzr, [%0]" ::"r"(bytes)
+                             : "memory");
+                bytes += 16;
+                size -= 16;
+            }
+
+            while (size >= block_size) {
+                asm volatile("dc zva, %0" ::"r"(bytes)
+                             : "memory");
+                bytes += block_size;
+                size -= block_size;
+            }
+        }
+    }
+
+    typedef u64 u64x2 __attribute__((vector_size(16)));
+    u64x2 zero = { 0, 0 };
+
+    while (size >= 64) {
+        asm volatile("stp %q1, %q1, [%0]\n"
+                     "stp %q1, %q1, [%0, #32]" ::"r"(bytes),
+                     "w"(zero)
+                     : "memory");
+        bytes += 64;
+        size -= 64;
+    }
+
+    while (size >= 16) {
+        asm volatile("stp xzr, xzr, [%0]" ::"r"(bytes)
+                     : "memory");
+        bytes += 16;
+        size -= 16;
+    }
+
+    while (size > 0) {
+        *bytes++ = 0;
+        size--;
+    }
+}
+
+#endif
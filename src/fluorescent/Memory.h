@@ -0,0 +1,8 @@
+#pragma once
+
+#include "../types/integer.h"
+
+// Sets `size` bytes at `destination` to zero.
+// Large, cache-line sized areas are cleared with `dc zva` when the MMU and data cache are on, and with 64-byte
+// NEON stores otherwise, which is a lot faster than clearing a byte at a time.
+void zero_memory(void* destination, size_t size);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../types/integer.h"
+
+#ifdef PHOSPHENE_HOST
+
+// The host tools (see Tools/AllocatorBench) do have a standard library.
+#include <new>
+
+#else
+
+// We don't have the standard library's <new>, so these have to come from somewhere.
+// The compiler looks for std::align_val_t and std::nothrow_t by name, so they have to be declared exactly like this.
+namespace std {
+
+enum class align_val_t : size_t {};
+
+struct nothrow_t {
+    explicit nothrow_t() = default;
+};
+
+inline constexpr nothrow_t nothrow {};
+
+}
+
+// Placement new
+inline void* operator new(size_t, void* pointer) noexcept { return pointer; }
+inline void operator delete(void*, void*) noexcept { }
+
+#endif
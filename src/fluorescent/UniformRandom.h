@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../types/integer.h"
+
+// Bounded numbers for any generator that can produce 64 random bits with `next_u64()`, without the bias (or the
+// division) of `next_u64() % bound`.
+template <typename Generator>
+class UniformRandom {
+public:
+    // A number in [0, bound), or 0 if `bound` is 0.
+    // https://arxiv.org/abs/1805.10941 (Fast Random Integer Generation in an Interval)
+    u64 below(u64 bound)
+    {
+        auto product = (unsigned __int128)this->generator().next_u64() * bound;
+
+        // Only the lowest `2^64 % bound` products can land in an interval that is one short, so the (rare) retries
+        // are the only time we need to divide.
+        if ((u64)product < bound) {
+            auto threshold = -bound % bound;
+            while ((u64)product < threshold) {
+                product = (unsigned __int128)this->generator().next_u64() * bound;
+            }
+        }
+
+        return (u64)(product >> 64);
+    }
+
+    // A number in [min, max], or `min` if `max` is less than it.
+    i64 between(i64 min, i64 max)
+    {
+        if (max <= min) {
+            return min;
+        }
+
+        auto range = (u64)max - (u64)min + 1;
+
+        // The whole range of an i64 wraps around to 0.
+        if (range == 0) {
+            return (i64)this->generator().next_u64();
+        }
+
+        return (i64)((u64)min + this->below(range));
+    }
+
+private:
+    Generator& generator() { return *static_cast<Generator*>(this); }
+};
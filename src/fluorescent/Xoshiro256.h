@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../types/integer.h"
+#include "UniformRandom.h"
+
+// xoshiro256**, a small and very fast generator with good statistical quality. It is completely predictable once
+// a few outputs have been seen, so it must never be used for anything that has to be secure (see ChaCha20.h).
+// https://prng.di.unimi.it/xoshiro256starstar.c
+class Xoshiro256 : public UniformRandom<Xoshiro256> {
+public:
+    // The state must not be all zeroes, which is the only seed that is turned away.
+    bool seed(const u64 (&state)[4])
+    {
+        if ((state[0] | state[1] | state[2] | state[3]) == 0) {
+            return false;
+        }
+
+        for (auto i = 0; i < 4; i++) {
+            m_state[i] = state[i];
+        }
+
+        return true;
+    }
+
+    u64 next_u64()
+    {
+        auto result = rotate_left(m_state[1] * 5, 7) * 9;
+        auto t = m_state[1] << 17;
+
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+
+        m_state[2] ^= t;
+        m_state[3] = rotate_left(m_state[3], 45);
+
+        return result;
+    }
+
+    // The upper bits are the best ones.
+    u32 next_u32() { return (u32)(this->next_u64() >> 32); }
+
+private:
+    static u64 rotate_left(u64 value, int shift) { return (value << shift) | (value >> (64 - shift)); }
+
+    u64 m_state[4] { 0, 0, 0, 0 };
+};
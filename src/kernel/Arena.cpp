@@ -0,0 +1,193 @@
+#include "Arena.h"
+#include "Kernel.h"
+#include "Log.h"
+#include "PageAllocator.h"
+#include "io/UART.h"
+
+namespace Kernel {
+
+static constexpr Logger<ARENA_LOG_LEVEL, "Arena"> logger {};
+
+struct Arena::Chunk {
+    Chunk* previous;
+
+    // The size of the whole chunk, including this header.
+    size_t size;
+
+    // How much of this chunk was used when we moved on to the next one.
+    size_t used;
+
+    // Chunks that were given to us (see Arena(void*, size_t)) must never be given to the PageAllocator.
+    bool owned;
+};
+
+// Fixed-buffer arenas use this as their chunk order, which tells allocate_slow that it isn't allowed to grow.
+static const u8 FixedBufferChunkOrder = 0xFF;
+
+Arena::Arena(void* buffer, size_t size)
+    : m_chunk_order(FixedBufferChunkOrder)
+{
+    auto chunk = (Chunk*)(((uintptr_t)buffer + alignof(Chunk) - 1) & ~(alignof(Chunk) - 1));
+    *chunk = Chunk {
+        .previous = nullptr,
+        .size = size - ((u8*)chunk - (u8*)buffer),
+        .used = 0,
+        .owned = false,
+    };
+
+    this->enter_chunk(chunk);
+}
+
+void* Arena::allocate_slow(size_t size, size_t alignment)
+{
+    if (m_chunk_order == FixedBufferChunkOrder) {
+        logger.debug("Fixed buffer is full! Failed to allocate {i} bytes."_log, size);
+
+        return nullptr;
+    }
+
+    auto required_size = chunk_header_size() + size + alignment;
+
+    Chunk* chunk = nullptr;
+    if (m_spare_chunk != nullptr && m_spare_chunk->size >= required_size) {
+        chunk = m_spare_chunk;
+        m_spare_chunk = nullptr;
+    } else {
+        auto order = PageAllocator::order_for(required_size);
+        if (order < m_chunk_order) {
+            order = m_chunk_order;
+        }
+
+        chunk = (Chunk*)PageAllocator::instance().allocate(order);
+        if (chunk == nullptr) {
+            logger.error("Failed to allocate a chunk for {i} bytes!", size);
+            return nullptr;
+        }
+
+        *chunk = Chunk {
+            .previous = nullptr,
+            .size = PageAllocator::size_of_order(order),
+            .used = 0,
+            .owned = true,
+        };
+
+        m_chunks_allocated++;
+    }
+
+    if (m_current_chunk != nullptr) {
+        m_current_chunk->used = m_position - this->chunk_start(m_current_chunk);
+        m_bytes_in_previous_chunks += m_current_chunk->used;
+    }
+
+    chunk->previous = m_current_chunk;
+    this->enter_chunk(chunk);
+
+    logger.debug("Moved on to a new chunk of {i} bytes at {#}"_log, chunk->size, chunk);
+
+    return this->allocate(size, alignment);
+}
+
+void Arena::reset_to(Marker marker)
+{
+    auto target = (Chunk*)marker.chunk;
+    m_resets++;
+
+    while (m_current_chunk != nullptr && m_current_chunk != target) {
+        auto previous = m_current_chunk->previous;
+
+        // A full reset keeps the first chunk around.
+        if (previous == nullptr) {
+            break;
+        }
+
+        this->free_chunk(m_current_chunk);
+
+        m_bytes_in_previous_chunks -= previous->used;
+        this->enter_chunk(previous);
+    }
+
+    if (marker.position != nullptr && m_current_chunk == target) {
+        m_position = marker.position;
+    } else if (m_current_chunk != nullptr) {
+        m_position = this->chunk_start(m_current_chunk);
+    }
+}
+
+void Arena::release()
+{
+    this->reset();
+
+    if (m_current_chunk != nullptr && m_current_chunk->owned) {
+        this->free_chunk(m_current_chunk);
+
+        m_current_chunk = nullptr;
+        m_position = nullptr;
+        m_end = nullptr;
+    }
+
+    if (m_spare_chunk != nullptr) {
+        PageAllocator::instance().free(m_spare_chunk);
+        m_spare_chunk = nullptr;
+    }
+}
+
+void Arena::enter_chunk(Chunk* chunk)
+{
+    m_current_chunk = chunk;
+    m_position = this->chunk_start(chunk);
+    m_end = (u8*)chunk + chunk->size;
+}
+
+void Arena::free_chunk(Chunk* chunk)
+{
+    if (!chunk->owned) {
+        return;
+    }
+
+    if (m_spare_chunk == nullptr) {
+        m_spare_chunk = chunk;
+        return;
+    }
+
+    PageAllocator::instance().free(chunk);
+}
+
+// The first allocation in a chunk is always 16-byte aligned.
+size_t Arena::chunk_header_size()
+{
+    return (sizeof(Chunk) + 15) & ~(size_t)15;
+}
+
+u8* Arena::chunk_start(Chunk* chunk) const
+{
+    return (u8*)chunk + chunk_header_size();
+}
+
+size_t Arena::bytes_allocated() const
+{
+    if (m_current_chunk == nullptr) {
+        return 0;
+    }
+
+    return m_bytes_in_previous_chunks + (m_position - this->chunk_start(m_current_chunk));
+}
+
+void Arena::print_stats(const char* name)
+{
+    UART::instance().println("[Arena] {s}:", name);
+    UART::instance().println("        - Bytes allocated:   {i}", this->bytes_allocated());
+    UART::instance().println("        - Chunks allocated:  {i}", m_chunks_allocated);
+    UART::instance().println("        - Resets:            {i}", m_resets);
+}
+
+}
+
+void* operator new(size_t size, Kernel::Arena& arena)
+{
+    return arena.allocate(size);
+}
+
+void* operator new[](size_t size, Kernel::Arena& arena)
+{
+    return arena.allocate(size);
+}
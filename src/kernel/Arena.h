@@ -0,0 +1,121 @@
+#pragma once
+
+#include "../fluorescent/New.h"
+#include "../types/integer.h"
+
+namespace Kernel {
+
+// A bump allocator for objects which all die at the same time (boot-time setup, or the work for a single request).
+// Allocating is a pointer increment, and everything allocated since a Marker can be free'd at once by resetting
+// the arena back to it. Destructors are *not* run when the arena is reset!
+//
+// The arena takes chunks of memory from the PageAllocator as it needs them, or can be given a fixed buffer to use.
+// Arena has a constexpr constructor, so it can be used as a global without needing global constructors.
+class Arena {
+public:
+    static constexpr u8 DefaultChunkOrder = 4;
+
+    struct Marker {
+        void* chunk;
+        u8* position;
+    };
+
+    // Resets the arena back to where it was when the scope was created.
+    class Scope {
+    public:
+        explicit Scope(Arena& arena)
+            : m_arena(arena)
+            , m_marker(arena.mark())
+        {
+        }
+
+        ~Scope() { m_arena.reset_to(m_marker); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Arena& m_arena;
+        Marker m_marker;
+    };
+
+    // An arena which grows in chunks of 2^chunk_order pages.
+    constexpr explicit Arena(u8 chunk_order = DefaultChunkOrder)
+        : m_chunk_order(chunk_order)
+    {
+    }
+
+    // An arena which only ever uses `buffer`, and fails once it is full.
+    Arena(void* buffer, size_t size);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment = 16)
+    {
+        auto position = (u8*)(((uintptr_t)m_position + alignment - 1) & ~(alignment - 1));
+        if (position + size > m_end || position < m_position) {
+            return this->allocate_slow(size, alignment);
+        }
+
+        m_position = position + size;
+        return position;
+    }
+
+    template<typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        auto memory = this->allocate(sizeof(T), alignof(T));
+        if (memory == nullptr) {
+            return nullptr;
+        }
+
+        return new (memory) T(static_cast<Args&&>(args)...);
+    }
+
+    Marker mark() const { return { m_current_chunk, m_position }; }
+
+    // Free's everything that was allocated after `marker` was taken.
+    void reset_to(Marker marker);
+
+    // Free's everything in the arena, but holds on to the first chunk.
+    void reset() { this->reset_to({ nullptr, nullptr }); }
+
+    // Free's everything in the arena, and gives all of its memory back to the PageAllocator.
+    void release();
+
+    size_t bytes_allocated() const;
+
+    void print_stats(const char* name);
+
+private:
+    struct Chunk;
+
+    void* allocate_slow(size_t size, size_t alignment);
+
+    void enter_chunk(Chunk* chunk);
+    void free_chunk(Chunk* chunk);
+
+    static size_t chunk_header_size();
+    u8* chunk_start(Chunk* chunk) const;
+
+    u8 m_chunk_order;
+
+    Chunk* m_current_chunk { nullptr };
+    u8* m_position { nullptr };
+    u8* m_end { nullptr };
+
+    // When we reset across a chunk boundary, the newest chunk is kept around so that a scope which keeps crossing
+    // the same boundary doesn't constantly go back to the PageAllocator.
+    Chunk* m_spare_chunk { nullptr };
+
+    size_t m_bytes_in_previous_chunks { 0 };
+    u64 m_chunks_allocated { 0 };
+    u64 m_resets { 0 };
+};
+
+}
+
+// Allows `new (arena) T(...)`. There is no matching delete, as objects in an arena are free'd by resetting it.
+void* operator new(size_t size, Kernel::Arena& arena);
+void* operator new[](size_t size, Kernel::Arena& arena);
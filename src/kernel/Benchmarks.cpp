@@ -0,0 +1,300 @@
+#include "FastRandom.h"
+#include "Kernel.h"
+#include "MemoryManagement.h"
+#include "Processor.h"
+#include "Random.h"
+#include "SMP.h"
+#include "SecureRandom.h"
+#include "Spinlock.h"
+#include "Time.h"
+#include "TimerWheel.h"
+#include "asm/CycleCounter.h"
+#include "io/UART.h"
+
+namespace Kernel {
+
+void benchmark_memory_zeroing()
+{
+    auto& uart = UART::instance();
+    auto& memory_management = MemoryManagement::instance();
+    auto previous_policy = memory_management.zeroing_policy();
+
+    CycleCounter::enable();
+
+    uart.println("[benchmark_memory_zeroing] Cycles per KiB for free() with ZeroingPolicy::ScrubOnFree:");
+    uart.println("[benchmark_memory_zeroing]     size (bytes): byte loop -> zero_memory");
+
+    for (size_t size = 64; size <= 1024 * 1024; size *= 4) {
+        auto iterations = size >= 64 * 1024 ? 4 : 64;
+
+        u64 byte_loop_cycles = 0;
+        u64 zero_memory_cycles = 0;
+
+        for (auto i = 0; i < iterations; i++) {
+            // This is what free() used to do, the memory is volatile so that the loop can't be optimized into anything else.
+            memory_management.set_zeroing_policy(MemoryManagement::ZeroingPolicy::None);
+            auto address = (volatile u8*)memory_management.allocate(size);
+
+            auto start = CycleCounter::read();
+            for (size_t j = 0; j < size; j++) {
+                address[j] = 0;
+            }
+            memory_management.free((void*)address);
+            byte_loop_cycles += CycleCounter::read() - start;
+
+            memory_management.set_zeroing_policy(MemoryManagement::ZeroingPolicy::ScrubOnFree);
+            address = (volatile u8*)memory_management.allocate(size);
+
+            start = CycleCounter::read();
+            memory_management.free((void*)address);
+            zero_memory_cycles += CycleCounter::read() - start;
+        }
+
+        auto total_bytes = size * iterations;
+        uart.println("[benchmark_memory_zeroing]     {i}: {i} -> {i}", size, byte_loop_cycles * 1024 / total_bytes, zero_memory_cycles * 1024 / total_bytes);
+    }
+
+    memory_management.set_zeroing_policy(previous_policy);
+}
+
+void benchmark_random_number_generation()
+{
+    auto& uart = UART::instance();
+    auto& random = Random::instance();
+    auto& secure_random = SecureRandom::instance();
+    auto& fast_random = FastRandom::current();
+
+    CycleCounter::enable();
+
+    constexpr size_t hardware_words = 1024;
+    constexpr size_t words = 64 * 1024;
+
+    // The pool would hide how slow the hardware is.
+    static u32 buffer[hardware_words];
+    random.fill(buffer, sizeof(buffer));
+
+    auto start = CycleCounter::read();
+    random.fill(buffer, sizeof(buffer));
+    auto hardware_cycles = CycleCounter::read() - start;
+
+    // The sum keeps the compiler from throwing any of the work away.
+    u64 sum = 0;
+
+    start = CycleCounter::read();
+    for (size_t i = 0; i < words; i++) {
+        sum += secure_random.next_u32();
+    }
+    auto secure_cycles = CycleCounter::read() - start;
+
+    start = CycleCounter::read();
+    for (size_t i = 0; i < words; i++) {
+        sum += fast_random.next_u32();
+    }
+    auto fast_cycles = CycleCounter::read() - start;
+
+    start = CycleCounter::read();
+    for (size_t i = 0; i < words; i++) {
+        sum += fast_random.below(1000);
+    }
+    auto bounded_cycles = CycleCounter::read() - start;
+
+    uart.println("[benchmark_random_number_generation] Cycles per 32-bit word (checksum: {#}):", sum);
+    uart.println("[benchmark_random_number_generation]     Random (hardware): {i}", hardware_cycles / hardware_words);
+    uart.println("[benchmark_random_number_generation]     SecureRandom (ChaCha20): {i}", secure_cycles / words);
+    uart.println("[benchmark_random_number_generation]     FastRandom (xoshiro256**): {i}", fast_cycles / words);
+    uart.println("[benchmark_random_number_generation]     FastRandom::below(1000): {i}", bounded_cycles / words);
+}
+
+// A mix of small allocations, with up to 64 of them alive at once. The sizes follow a fixed pattern, so every core
+// does exactly the same work.
+static void allocate_and_free(void* argument)
+{
+    constexpr size_t live_limit = 64;
+
+    auto& memory_management = MemoryManagement::instance();
+    auto operations = *(const size_t*)argument;
+    void* pointers[live_limit] = {};
+
+    for (size_t i = 0; i < operations; i++) {
+        auto& pointer = pointers[(i * 37) % live_limit];
+        memory_management.free(pointer);
+
+        pointer = memory_management.allocate(16 + (i * 7919) % 497);
+    }
+
+    for (auto pointer : pointers) {
+        memory_management.free(pointer);
+    }
+}
+
+void benchmark_allocation_scaling()
+{
+    auto& uart = UART::instance();
+    auto& memory_management = MemoryManagement::instance();
+    auto previous_policy = memory_management.zeroing_policy();
+
+    CycleCounter::enable();
+
+    // Clearing memory scales perfectly anyway, it would only hide how the allocator itself scales.
+    memory_management.set_zeroing_policy(MemoryManagement::ZeroingPolicy::None);
+
+    static size_t operations = 100000;
+
+    // Every core's magazines are warmed up first, so that growing the heap isn't part of the measurement.
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        SMP::run_on_core(core, allocate_and_free, &operations);
+        SMP::wait_for_core(core);
+    }
+
+    uart.println("[benchmark_allocation_scaling] Allocations + frees per million cycles, by how many cores are allocating:");
+
+    u64 single_core_throughput = 0;
+    for (size_t core_count = 1; core_count <= SMP::online_core_count(); core_count++) {
+        auto start = CycleCounter::read();
+
+        // This core goes last, as run_on_core() runs its work straight away.
+        size_t cores_started = 0;
+        for (u32 i = 1; i <= Processor::MaxCoreCount && cores_started < core_count - 1; i++) {
+            auto core = (SMP::current().id + i) % Processor::MaxCoreCount;
+            if (core != SMP::current().id && SMP::run_on_core(core, allocate_and_free, &operations)) {
+                cores_started++;
+            }
+        }
+
+        allocate_and_free(&operations);
+
+        for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+            SMP::wait_for_core(core);
+        }
+
+        auto cycles = CycleCounter::read() - start;
+        auto throughput = (cores_started + 1) * operations * 1000000 / cycles;
+        if (single_core_throughput == 0) {
+            single_core_throughput = throughput;
+        }
+
+        uart.println("[benchmark_allocation_scaling]     {i} cores: {i} ({i}.{02i}x)", cores_started + 1, throughput, throughput / single_core_throughput, throughput * 100 / single_core_throughput % 100);
+    }
+
+    memory_management.set_zeroing_policy(previous_policy);
+}
+
+struct SpinlockBenchmark {
+    Spinlock lock;
+    u64 counter;
+    size_t iterations;
+};
+
+static void increment_under_lock(void* argument)
+{
+    auto benchmark = (SpinlockBenchmark*)argument;
+    for (size_t i = 0; i < benchmark->iterations; i++) {
+        Locker locker(benchmark->lock);
+        benchmark->counter++;
+    }
+}
+
+void benchmark_spinlock()
+{
+    auto& uart = UART::instance();
+
+    CycleCounter::enable();
+
+    constexpr size_t iterations = 100000;
+
+    static SpinlockBenchmark benchmark;
+    benchmark.iterations = iterations;
+
+    auto start = CycleCounter::read();
+    increment_under_lock(&benchmark);
+    auto uncontended_cycles = CycleCounter::read() - start;
+
+    static ReadWriteSpinlock read_write_lock;
+
+    start = CycleCounter::read();
+    for (size_t i = 0; i < iterations; i++) {
+        SharedLocker locker(read_write_lock);
+        asm volatile("" ::
+                         : "memory");
+    }
+    auto shared_cycles = CycleCounter::read() - start;
+
+    start = CycleCounter::read();
+    for (size_t i = 0; i < iterations; i++) {
+        InterruptSafeLocker locker(benchmark.lock);
+        benchmark.counter++;
+    }
+    auto interrupt_safe_cycles = CycleCounter::read() - start;
+
+    uart.println("[benchmark_spinlock] Cycles per uncontended lock + unlock:");
+    uart.println("[benchmark_spinlock]     Spinlock:                  {i}", uncontended_cycles / iterations);
+    uart.println("[benchmark_spinlock]     Spinlock (saving IRQs):    {i}", interrupt_safe_cycles / iterations);
+    uart.println("[benchmark_spinlock]     ReadWriteSpinlock (read):  {i}", shared_cycles / iterations);
+
+    // Every core hammers the same lock.
+    auto contentions = benchmark.lock.statistics().contentions;
+    start = CycleCounter::read();
+
+    size_t cores = 0;
+    // This core goes last, as run_on_core() runs its work straight away.
+    for (u32 i = 1; i <= Processor::MaxCoreCount; i++) {
+        auto core = (SMP::current().id + i) % Processor::MaxCoreCount;
+        if (SMP::run_on_core(core, increment_under_lock, &benchmark)) {
+            cores++;
+        }
+    }
+
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        SMP::wait_for_core(core);
+    }
+
+    auto contended_cycles = CycleCounter::read() - start;
+    contentions = benchmark.lock.statistics().contentions - contentions;
+
+    uart.println("[benchmark_spinlock] {i} cores sharing one Spinlock: {i} cycles per lock + unlock, {i} of {i} acquisitions had to wait", cores, contended_cycles / (iterations * cores), contentions, iterations * cores);
+}
+
+void benchmark_timer_wheel()
+{
+    auto& uart = UART::instance();
+    auto& timer_wheel = TimerWheel::instance();
+
+    CycleCounter::enable();
+
+    constexpr size_t count = 1024;
+    static Timer timers[count];
+
+    auto callback = [](void*) {};
+
+    // Spread over every level of the wheel, and far enough away that none of them fire while we're busy.
+    auto now = Time::now();
+    u64 deadlines[count];
+    for (size_t i = 0; i < count; i++) {
+        deadlines[i] = now + Time::Second + (i * 2654435761u) % (3600 * Time::Second);
+    }
+
+    auto start = CycleCounter::read();
+    for (size_t i = 0; i < count; i++) {
+        timer_wheel.start_one_shot(timers[i], deadlines[i], callback, nullptr);
+    }
+    auto start_cycles = CycleCounter::read() - start;
+
+    start = CycleCounter::read();
+    for (size_t i = 0; i < count; i++) {
+        timer_wheel.cancel(timers[i]);
+    }
+    auto cancel_cycles = CycleCounter::read() - start;
+
+    start = CycleCounter::read();
+    for (size_t i = 0; i < count; i++) {
+        asm volatile("" ::"r"(Time::now()));
+    }
+    auto clock_cycles = CycleCounter::read() - start;
+
+    uart.println("[benchmark_timer_wheel] Cycles per operation, with {i} timers:", count);
+    uart.println("[benchmark_timer_wheel]     start:       {i}", start_cycles / count);
+    uart.println("[benchmark_timer_wheel]     cancel:      {i}", cancel_cycles / count);
+    uart.println("[benchmark_timer_wheel]     Time::now(): {i}", clock_cycles / count);
+}
+
+}
@@ -0,0 +1,29 @@
+#include "Board.h"
+
+namespace Kernel {
+
+// https://wiki.osdev.org/Detecting_Raspberry_Pi_Board
+void Board::detect()
+{
+    MainIdRegister id_register;
+    s_part_number = id_register.part_number();
+
+    // The Pi 2 has the same peripherals as the Pi 3, and anything else isn't supported anyway (see main()).
+    s_model = s_part_number == PartNumber::Pi4 ? BoardModel::RPi4 : BoardModel::RPi3;
+
+    visit([](auto board) {
+        s_peripheral_base = board.PeripheralBase;
+        s_peripheral_window_start = board.PeripheralWindowStart;
+    });
+}
+
+bool Board::is_supported()
+{
+    if (s_part_number != PartNumber::Pi3 && s_part_number != PartNumber::Pi4) {
+        return false;
+    }
+
+    return !IsBoardFixed || s_model == FixedBoardModel;
+}
+
+}
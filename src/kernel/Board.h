@@ -0,0 +1,114 @@
+#pragma once
+
+#include "../types/integer.h"
+#include "asm/MainIdRegister.h"
+
+namespace Kernel {
+
+namespace RPi3 {
+class InterruptControllerImplementation;
+class RandomImplementation;
+}
+
+namespace RPi4 {
+class InterruptControllerImplementation;
+class RandomImplementation;
+}
+
+enum class BoardModel : u8 {
+    RPi3,
+    RPi4,
+};
+
+// Everything that differs between the boards that we support.
+template <BoardModel Model>
+struct BoardDefinition;
+
+template <>
+struct BoardDefinition<BoardModel::RPi3> {
+    static constexpr BoardModel Model = BoardModel::RPi3;
+
+    // The physical address that all peripheral registers are relative to.
+    static constexpr uintptr_t PeripheralBase = 0x3F000000;
+
+    // Everything from here up to 4 GiB is peripherals, and must never be treated as RAM.
+    static constexpr uintptr_t PeripheralWindowStart = 0x3F000000;
+
+    // What the firmware sets the generic timer's counter up to run at, in case it didn't (see Time).
+    static constexpr u64 CounterFrequency = 19200000;
+
+    using InterruptControllerImplementation = RPi3::InterruptControllerImplementation;
+    using RandomImplementation = RPi3::RandomImplementation;
+};
+
+template <>
+struct BoardDefinition<BoardModel::RPi4> {
+    static constexpr BoardModel Model = BoardModel::RPi4;
+
+    static constexpr uintptr_t PeripheralBase = 0xFE000000;
+
+    // The Pi 4 has more peripherals (PCIe, etc.) below the ones that we use.
+    static constexpr uintptr_t PeripheralWindowStart = 0xFC000000;
+
+    static constexpr u64 CounterFrequency = 54000000;
+
+    using InterruptControllerImplementation = RPi4::InterruptControllerImplementation;
+    using RandomImplementation = RPi4::RandomImplementation;
+};
+
+// The phosphene-rpi3 and phosphene-rpi4 targets (see CMakeLists.txt) are built for a single board, so everything
+// board-specific is a constant there. The plain phosphene target works out which board it is on at boot instead.
+#if defined(PHOSPHENE_BOARD_RPI3)
+static constexpr bool IsBoardFixed = true;
+static constexpr BoardModel FixedBoardModel = BoardModel::RPi3;
+#elif defined(PHOSPHENE_BOARD_RPI4)
+static constexpr bool IsBoardFixed = true;
+static constexpr BoardModel FixedBoardModel = BoardModel::RPi4;
+#else
+static constexpr bool IsBoardFixed = false;
+static constexpr BoardModel FixedBoardModel = BoardModel::RPi3;
+#endif
+
+// The board that we are running on, which is only detected once.
+class Board {
+public:
+    // Reads the processor's part number, and works out which board we're on from it. This must be called before
+    // any register is touched (or the MMU is set up), see init().
+    static void detect();
+
+    static BoardModel model() { return IsBoardFixed ? FixedBoardModel : s_model; }
+    static PartNumber part_number() { return s_part_number; }
+    static const char* name() { return MainIdRegister::part_number_as_string(s_part_number); }
+
+    // Our OS only supports the Pi 3 and Pi 4 at the moment, and a board-specific kernel only supports its own board.
+    static bool is_supported();
+
+    static uintptr_t peripheral_base() { return IsBoardFixed ? BoardDefinition<FixedBoardModel>::PeripheralBase : s_peripheral_base; }
+    static uintptr_t peripheral_window_start() { return IsBoardFixed ? BoardDefinition<FixedBoardModel>::PeripheralWindowStart : s_peripheral_window_start; }
+
+    // Calls `function` with the BoardDefinition of the board that we're on, e.g. to pick a driver:
+    //
+    //     Board::visit([](auto board) { return decltype(board)::RandomImplementation::instance().get(); });
+    //
+    // On a board-specific kernel, this is a direct call to the only instantiation that is needed.
+    template <typename Function>
+    [[gnu::always_inline]] static auto visit(Function function)
+    {
+        if constexpr (IsBoardFixed) {
+            return function(BoardDefinition<FixedBoardModel> {});
+        } else if (s_model == BoardModel::RPi4) {
+            return function(BoardDefinition<BoardModel::RPi4> {});
+        } else {
+            return function(BoardDefinition<BoardModel::RPi3> {});
+        }
+    }
+
+private:
+    // These are zero-initialized, so they don't need a constructor to run.
+    static inline PartNumber s_part_number {};
+    static inline BoardModel s_model {};
+    static inline uintptr_t s_peripheral_base { 0 };
+    static inline uintptr_t s_peripheral_window_start { 0 };
+};
+
+}
@@ -0,0 +1,63 @@
+#include "Exceptions.h"
+#include "InterruptController.h"
+#include "Processor.h"
+#include "VirtualMemory.h"
+#include "io/UART.h"
+
+// Defined in ExceptionVectors.S
+extern "C" u8 exception_vectors;
+
+namespace Kernel {
+
+// https://developer.arm.com/documentation/ddi0601/2023-03/AArch64-Registers/ESR-EL1--Exception-Syndrome-Register--EL1-?lang=en
+struct ExceptionClass {
+    static const u64 InstructionAbortCurrentEL = 0x21;
+    static const u64 DataAbortCurrentEL = 0x25;
+};
+
+struct FaultStatus {
+    static const u64 Mask = 0b111111;
+
+    // Translation faults are 0b0001LL, where LL is the level of the table that didn't have an entry.
+    static const u64 TranslationFaultMask = 0b111100;
+    static const u64 TranslationFault = 0b000100;
+};
+
+void Exceptions::initialize()
+{
+    asm volatile("msr vbar_el1, %x0\n"
+                 "isb" ::"r"(&exception_vectors));
+}
+
+extern "C" void handle_exception(ExceptionFrame* frame, ExceptionType type)
+{
+    if (type == ExceptionType::CurrentELWithSPxIRQ || type == ExceptionType::LowerEL64IRQ) {
+        return InterruptController::instance().handle_irq();
+    }
+
+    u64 syndrome;
+    u64 fault_address;
+    asm volatile("mrs %x0, esr_el1\n"
+                 "mrs %x1, far_el1"
+                 : "=r"(syndrome), "=r"(fault_address));
+
+    auto exception_class = (syndrome >> 26) & 0x3F;
+    auto fault_status = syndrome & FaultStatus::Mask;
+
+    // A translation fault may just be the heap being touched for the first time.
+    if (type == ExceptionType::CurrentELWithSPxSynchronous && exception_class == ExceptionClass::DataAbortCurrentEL
+        && (fault_status & FaultStatus::TranslationFaultMask) == FaultStatus::TranslationFault) {
+        if (VirtualMemory::instance().handle_page_fault(fault_address)) {
+            return;
+        }
+    }
+
+    UART::instance().println("[Exceptions] Unhandled exception of type {i}!", (u32)type);
+    UART::instance().println("             - ESR: {#} (class {#}, status {#})", syndrome, exception_class, fault_status);
+    UART::instance().println("             - FAR: {#}", fault_address);
+    UART::instance().println("             - ELR: {#}", frame->exception_link_register);
+
+    Processor::panic("Unhandled exception!");
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../types/integer.h"
+
+namespace Kernel {
+
+// The registers of whatever was running when the exception was taken, see ExceptionVectors.S.
+struct ExceptionFrame {
+    u64 registers[31];
+    u64 exception_link_register;
+    u64 saved_program_status_register;
+    u64 padding;
+
+    u64 floating_point_status_register;
+    u64 floating_point_control_register;
+
+    // q0-q31
+    u64 simd_registers[32 * 2];
+};
+
+static_assert(sizeof(ExceptionFrame) == 800, "ExceptionFrame must match the layout in ExceptionVectors.S!");
+
+// https://developer.arm.com/documentation/100933/0100/AArch64-exception-vector-table
+enum class ExceptionType : u64 {
+    CurrentELWithSP0Synchronous = 0,
+    CurrentELWithSP0IRQ = 1,
+    CurrentELWithSP0FIQ = 2,
+    CurrentELWithSP0SError = 3,
+
+    CurrentELWithSPxSynchronous = 4,
+    CurrentELWithSPxIRQ = 5,
+    CurrentELWithSPxFIQ = 6,
+    CurrentELWithSPxSError = 7,
+
+    LowerEL64Synchronous = 8,
+    LowerEL64IRQ = 9,
+    LowerEL64FIQ = 10,
+    LowerEL64SError = 11,
+
+    LowerEL32Synchronous = 12,
+    LowerEL32IRQ = 13,
+    LowerEL32FIQ = 14,
+    LowerEL32SError = 15,
+};
+
+class Exceptions {
+public:
+    // Points VBAR_EL1 at our vector table on this core.
+    static void initialize();
+};
+
+}
@@ -0,0 +1,30 @@
+#include "FastRandom.h"
+#include "PerCpu.h"
+#include "SecureRandom.h"
+
+namespace Kernel {
+
+struct CoreGenerator {
+    Xoshiro256 generator;
+    bool is_seeded;
+};
+
+static PerCpu<CoreGenerator> s_generators;
+
+Xoshiro256& FastRandom::current()
+{
+    auto& core = s_generators.current();
+
+    if (!core.is_seeded) {
+        u64 state[4] = { 0, 0, 0, 0 };
+        do {
+            SecureRandom::instance().fill(state, sizeof(state));
+        } while (!core.generator.seed(state));
+
+        core.is_seeded = true;
+    }
+
+    return core.generator;
+}
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../fluorescent/Xoshiro256.h"
+#include "../types/integer.h"
+
+namespace Kernel {
+
+// Random numbers for anything that doesn't have to be secure (sampling, jitter, tests, etc.), from a xoshiro256**
+// generator of each core's own, so using them never waits on the hardware or on another core.
+class FastRandom {
+public:
+    // The generator of the core that we're running on, which is seeded from SecureRandom the first time it's used.
+    // NOTE: This must not be used from an interrupt handler, as it may have interrupted this core's generator.
+    static Xoshiro256& current();
+};
+
+}
@@ -0,0 +1,186 @@
+#include "InterruptController.h"
+#include "Board.h"
+#include "Log.h"
+#include "RPi3/InterruptControllerImplementation.h"
+#include "RPi4/InterruptControllerImplementation.h"
+#include "asm/CycleCounter.h"
+#include "io/UART.h"
+
+namespace Kernel {
+
+static constexpr Logger<INTERRUPTS_LOG_LEVEL, "Interrupts"> logger {};
+
+InterruptController& InterruptController::instance()
+{
+    static InterruptController instance;
+    return instance;
+}
+
+void InterruptController::initialize()
+{
+    InterruptSafeLocker locker(m_lock);
+
+    Board::visit([](auto board) { decltype(board)::InterruptControllerImplementation::instance().initialize(); });
+    Board::visit([](auto board) { decltype(board)::InterruptControllerImplementation::instance().initialize_core(); });
+}
+
+void InterruptController::initialize_core()
+{
+    Board::visit([](auto board) { decltype(board)::InterruptControllerImplementation::instance().initialize_core(); });
+}
+
+bool InterruptController::is_valid(u32 irq)
+{
+    return irq < MaxIRQCount && Board::visit([irq](auto board) { return decltype(board)::InterruptControllerImplementation::instance().has_irq(irq); });
+}
+
+bool InterruptController::register_handler(u32 irq, Handler handler, void* context, u8 priority)
+{
+    if (!this->is_valid(irq) || handler == nullptr) {
+        logger.warning("Can't register a handler for IRQ {i}!", irq);
+        return false;
+    }
+
+    InterruptSafeLocker locker(m_lock);
+
+    auto& entry = m_handlers[irq];
+    if (entry.handler != nullptr) {
+        logger.warning("IRQ {i} already has a handler!", irq);
+        return false;
+    }
+
+    entry.context = context;
+    entry.priority = priority;
+    __atomic_store_n(&entry.handler, handler, __ATOMIC_RELEASE);
+
+    Board::visit([irq, priority](auto board) { decltype(board)::InterruptControllerImplementation::instance().enable(irq, priority); });
+
+    logger.debug("Registered a handler for IRQ {i} (priority {#})", irq, priority);
+    return true;
+}
+
+void InterruptController::unregister_handler(u32 irq)
+{
+    if (!this->is_valid(irq)) {
+        return;
+    }
+
+    InterruptSafeLocker locker(m_lock);
+
+    Board::visit([irq](auto board) { decltype(board)::InterruptControllerImplementation::instance().disable(irq); });
+    __atomic_store_n(&m_handlers[irq].handler, nullptr, __ATOMIC_RELEASE);
+}
+
+void InterruptController::enable(u32 irq)
+{
+    if (!this->is_valid(irq)) {
+        return;
+    }
+
+    InterruptSafeLocker locker(m_lock);
+
+    auto& entry = m_handlers[irq];
+    if (entry.handler == nullptr) {
+        logger.warning("Not enabling IRQ {i}, as it doesn't have a handler", irq);
+        return;
+    }
+
+    auto priority = entry.priority;
+    Board::visit([irq, priority](auto board) { decltype(board)::InterruptControllerImplementation::instance().enable(irq, priority); });
+}
+
+void InterruptController::disable(u32 irq)
+{
+    if (!this->is_valid(irq)) {
+        return;
+    }
+
+    InterruptSafeLocker locker(m_lock);
+    Board::visit([irq](auto board) { decltype(board)::InterruptControllerImplementation::instance().disable(irq); });
+}
+
+void InterruptController::handle_irq()
+{
+    auto& statistics = m_statistics.current();
+
+    Board::visit([this, &statistics](auto board) {
+        auto& controller = decltype(board)::InterruptControllerImplementation::instance();
+
+        // Anything that became pending while we were busy is handled before we return, instead of taking the
+        // exception all over again.
+        for (auto irq = controller.acknowledge(); irq != IRQ::Spurious; irq = controller.acknowledge()) {
+            auto& entry = m_handlers[irq];
+
+            auto handler = __atomic_load_n(&entry.handler, __ATOMIC_ACQUIRE);
+            if (handler == nullptr) [[unlikely]] {
+                // It would only keep on firing.
+                controller.disable(irq);
+                controller.end_of_interrupt(irq);
+
+                statistics.unhandled++;
+                logger.warning("Disabled IRQ {i}, which fired without a handler"_log, irq);
+                continue;
+            }
+
+            auto start = CycleCounter::read();
+            handler(entry.context);
+
+            statistics.cycles[irq] += CycleCounter::read() - start;
+            statistics.dispatches[irq]++;
+
+            controller.end_of_interrupt(irq);
+        }
+    });
+}
+
+u64 InterruptController::dispatch_count(u32 irq)
+{
+    if (irq >= MaxIRQCount) {
+        return 0;
+    }
+
+    u64 count = 0;
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        count += __atomic_load_n(&m_statistics.for_core(core).dispatches[irq], __ATOMIC_RELAXED);
+    }
+
+    return count;
+}
+
+u64 InterruptController::dispatch_cycles(u32 irq)
+{
+    if (irq >= MaxIRQCount) {
+        return 0;
+    }
+
+    u64 cycles = 0;
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        cycles += __atomic_load_n(&m_statistics.for_core(core).cycles[irq], __ATOMIC_RELAXED);
+    }
+
+    return cycles;
+}
+
+void InterruptController::print_stats()
+{
+    auto& uart = UART::instance();
+
+    u64 unhandled = 0;
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        unhandled += m_statistics.for_core(core).unhandled;
+    }
+
+    uart.println("[Interrupts] Statistics:");
+    uart.println("             - Unhandled: {i}", unhandled);
+
+    for (u32 irq = 0; irq < MaxIRQCount; irq++) {
+        auto count = this->dispatch_count(irq);
+        if (count == 0) {
+            continue;
+        }
+
+        uart.println("             - IRQ {i}: {i} dispatches, {i} cycles each on average", irq, count, this->dispatch_cycles(irq) / count);
+    }
+}
+
+}
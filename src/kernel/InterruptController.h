@@ -0,0 +1,113 @@
+#pragma once
+
+#include "../types/integer.h"
+#include "PerCpu.h"
+#include "Spinlock.h"
+
+namespace Kernel {
+
+// The interrupts that we know about. These are the GIC-400's numbers (see RPi4/InterruptControllerImplementation.h)
+// on every board, and the Pi 3's controller translates its own sources into them.
+struct IRQ {
+    // 0-31 are private to each core, so every core has to enable them for itself.
+    static constexpr u32 HypervisorTimer = 26;
+    static constexpr u32 VirtualTimer = 27;
+    static constexpr u32 SecurePhysicalTimer = 29;
+    static constexpr u32 PhysicalTimer = 30;
+
+    // The VideoCore's interrupts start at 96, and are shared by every core (but only ever delivered to core 0).
+    static constexpr u32 VideoCoreBase = 96;
+    static constexpr u32 UART = VideoCoreBase + 57;
+
+    static constexpr u32 FirstShared = 32;
+
+    // What the controller hands out when there is nothing (left) to handle.
+    static constexpr u32 Spurious = 1023;
+};
+
+// Routes IRQs to the handlers that drivers register for them, on top of whichever controller the board has: a GIC-400
+// on the Pi 4, or the BCM2836 per-core controller in front of the BCM2835 one on the Pi 3 (and QEMU's raspi3b).
+//
+//     InterruptController::instance().register_handler(IRQ::UART, handle_uart_interrupt, &uart);
+//     Interrupts::enable();
+//
+// Handlers run with IRQs masked, on whichever core the IRQ was delivered to, and must not wait for anything that code
+// they may have interrupted could be holding (see Spinlock). A lower priority is more urgent, like on the GIC: when
+// more than one IRQ is pending, the most urgent one is handled first. IRQs don't nest.
+class InterruptController {
+public:
+    using Handler = void (*)(void* context);
+
+    // The GIC-400 on the Pi 4 has 256 interrupt lines, and the Pi 3's sources all fit below that.
+    static constexpr size_t MaxIRQCount = 256;
+
+    // Only the top 4 bits are kept by the GIC (from non-secure code), so priorities that differ less than that are
+    // treated the same.
+    static constexpr u8 HighPriority = 0x40;
+    static constexpr u8 DefaultPriority = 0x80;
+    static constexpr u8 LowPriority = 0xC0;
+
+    static InterruptController& instance();
+
+    InterruptController(const InterruptController&) = delete;
+    InterruptController& operator=(const InterruptController&) = delete;
+
+    // Puts the controller into a known state, with every IRQ disabled, and does initialize_core() for the boot core.
+    // This takes a lock, so it has to wait until the MMU is on.
+    void initialize();
+
+    // The part of the controller that is private to each core (the GIC's CPU interface, and the private IRQs) has to
+    // be set up by every core for itself, before it unmasks IRQs.
+    void initialize_core();
+
+    // Calls `handler(context)` whenever `irq` fires, and enables it. A private IRQ is only enabled on the core that
+    // calls this, every other core has to call enable() for itself. Returns false if `irq` doesn't exist on this
+    // board, or already has a handler.
+    bool register_handler(u32 irq, Handler handler, void* context, u8 priority = DefaultPriority);
+
+    // Disables `irq`, and forgets its handler. The handler may still be running on another core when this returns.
+    void unregister_handler(u32 irq);
+
+    // Enables or disables an IRQ that already has a handler, on this core if it is a private one.
+    void enable(u32 irq);
+    void disable(u32 irq);
+
+    // Handles every IRQ that is pending on this core, called by handle_exception() (see Exceptions.cpp).
+    void handle_irq();
+
+    // How many times `irq` was handled, and how many cycles its handler took, on every core put together.
+    u64 dispatch_count(u32 irq);
+    u64 dispatch_cycles(u32 irq);
+
+    void print_stats();
+
+private:
+    InterruptController() = default;
+
+    struct HandlerEntry {
+        Handler handler;
+        void* context;
+        u8 priority;
+    };
+
+    // Every core only counts what it has handled itself, so the timer (which fires on every core) doesn't bounce a
+    // shared counter between them.
+    struct CoreStatistics {
+        u64 dispatches[MaxIRQCount];
+        u64 cycles[MaxIRQCount];
+
+        // IRQs that were still enabled without a handler, which are disabled as soon as they fire.
+        u64 unhandled;
+    };
+
+    bool is_valid(u32 irq);
+
+    // Held while handlers are registered (and IRQs are enabled or disabled), but never while they're dispatched.
+    // `handler` is only set once the rest of its entry is, so that handle_irq() doesn't need the lock.
+    Spinlock m_lock;
+
+    HandlerEntry m_handlers[MaxIRQCount] {};
+    PerCpu<CoreStatistics> m_statistics;
+};
+
+}
@@ -2,11 +2,45 @@
 
 namespace Kernel {
 
-#define MEMORY_MANAGEMENT_DEBUG 0
-#define MEMORY_MANAGEMENT_ALLOCATION_DEBUG 0
+// How much each subsystem logs, anything more detailed than this is compiled out (see Log.h).
+// MemoryManagement's Trace level records every allocation and free, which Tools/AllocatorBench can replay.
+#define MEMORY_MANAGEMENT_LOG_LEVEL LogLevel::Info
+#define PAGE_ALLOCATOR_LOG_LEVEL LogLevel::Info
+#define MAILBOX_LOG_LEVEL LogLevel::Info
+#define ARENA_LOG_LEVEL LogLevel::Info
+#define SLAB_CACHE_LOG_LEVEL LogLevel::Info
+#define VIRTUAL_MEMORY_LOG_LEVEL LogLevel::Info
+#define SMP_LOG_LEVEL LogLevel::Info
+#define INTERRUPTS_LOG_LEVEL LogLevel::Info
+#define TIMER_LOG_LEVEL LogLevel::Info
+
+// Log messages written with `_log` (see Log.h) go out as compact binary records instead of text, which have to be
+// decoded with Tools/LogDecoder.
+#define LOG_DEFERRED 0
+
+// Every lock (see Spinlock.h) keeps track of how long it is held for, which costs two cycle counter reads per lock.
+#define LOCK_STATISTICS 0
+
+#define RUN_BENCHMARKS 0
 
 void main();
+void test_format();
 void test_memory_management();
+void test_page_allocator();
+void test_virtual_memory();
+void test_slab_cache();
+void test_arena();
 void test_random_number_generation();
+void test_smp();
+void test_spinlock();
+void test_interrupts();
+void test_timers();
+void test_log();
+
+void benchmark_memory_zeroing();
+void benchmark_random_number_generation();
+void benchmark_spinlock();
+void benchmark_allocation_scaling();
+void benchmark_timer_wheel();
 
 }
\ No newline at end of file
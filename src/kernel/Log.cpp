@@ -0,0 +1,324 @@
+#include "Log.h"
+#include "Time.h"
+#include "TimerWheel.h"
+#include "asm/CycleCounter.h"
+#include "io/UART.h"
+
+namespace Kernel {
+
+// How often the timer moves records into the UART's transmit buffer. At 115200 baud, the UART sends about 1 KiB in
+// that time, and the buffer holds four times that, so it doesn't run dry in between.
+static constexpr u64 DrainInterval = 10 * Time::Millisecond;
+
+static Timer s_drain_timer;
+
+Log& Log::instance()
+{
+    static Log instance;
+    return instance;
+}
+
+Log::Log()
+{
+    for (size_t i = 0; i < RecordCount; i++) {
+        m_records[i].sequence = i;
+    }
+}
+
+void Log::initialize()
+{
+    CycleCounter::enable();
+
+    __atomic_store_n(&m_is_initialized, true, __ATOMIC_RELEASE);
+}
+
+Log::Record* Log::claim_record()
+{
+    auto timestamp = CycleCounter::read();
+
+    if (!m_is_initialized) {
+        auto record = &m_records[m_write_position % RecordCount];
+        if (record->sequence != m_write_position) {
+            m_records_dropped++;
+            return nullptr;
+        }
+
+        m_write_position++;
+        record->timestamp = timestamp;
+        return record;
+    }
+
+    auto position = __atomic_load_n(&m_write_position, __ATOMIC_RELAXED);
+    while (true) {
+        auto record = &m_records[position % RecordCount];
+        auto sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+
+        if (sequence == position) {
+            // On failure, `position` is updated to wherever another writer moved it.
+            if (__atomic_compare_exchange_n(&m_write_position, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                record->timestamp = timestamp;
+                return record;
+            }
+        } else if (sequence < position) {
+            // This record hasn't been drained since the last time around the ring, so the ring is full.
+            __atomic_fetch_add(&m_records_dropped, 1, __ATOMIC_RELAXED);
+            return nullptr;
+        } else {
+            position = __atomic_load_n(&m_write_position, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void Log::publish_record(Record* record)
+{
+    // Nobody else touches the sequence number while we own the record.
+    __atomic_store_n(&record->sequence, record->sequence + 1, __ATOMIC_RELEASE);
+}
+
+void Log::append_to_record(void* context, const char* data, size_t size)
+{
+    auto record = (Record*)context;
+
+    for (size_t i = 0; i < size && record->length < sizeof(record->message); i++) {
+        record->message[record->length++] = data[i];
+    }
+
+    // Long messages are cut short, but it should at least be obvious that they were.
+    if (record->length == sizeof(record->message)) {
+        for (size_t i = sizeof(record->message) - 3; i < sizeof(record->message); i++) {
+            record->message[i] = '.';
+        }
+    }
+}
+
+// A varint is at most 10 bytes long.
+static constexpr size_t MaxVarintSize = 10;
+
+static size_t encode_varint(char* buffer, u64 value)
+{
+    size_t size = 0;
+
+    do {
+        auto byte = (u8)(value & 0x7F);
+        value >>= 7;
+
+        buffer[size++] = (char)(value != 0 ? byte | 0x80 : byte);
+    } while (value != 0);
+
+    return size;
+}
+
+static u64 zigzag(i64 value)
+{
+    return ((u64)value << 1) ^ (u64)(value >> 63);
+}
+
+// Byte by byte, as the record may not be aligned for anything bigger (and this can run before the MMU is on).
+static void store_u64(char* buffer, u64 value)
+{
+    for (size_t i = 0; i < sizeof(value); i++) {
+        buffer[i] = (char)(value >> (i * 8));
+    }
+}
+
+static u64 load_u64(const char* buffer)
+{
+    u64 value = 0;
+    for (size_t i = 0; i < sizeof(value); i++) {
+        value |= (u64)(u8)buffer[i] << (i * 8);
+    }
+
+    return value;
+}
+
+// Writing a record only copies the arguments as they are: [type] [value] for numbers, and [type] [length]
+// [characters...] for strings. Encoding them for the wire is left to the drain.
+void Log::store_deferred_record(Record* record, const FormatArgument* arguments, size_t argument_count)
+{
+    static_assert(sizeof(Record::message) > (1 + sizeof(u64)) * MaxDeferredArguments, "There is no room left for strings!");
+
+    for (size_t i = 0; i < argument_count; i++) {
+        auto& argument = arguments[i];
+        record->message[record->length++] = (char)argument.type;
+
+        if (argument.type != FormatArgument::Type::String) {
+            store_u64(record->message + record->length, argument.integer);
+            record->length += sizeof(u64);
+            continue;
+        }
+
+        // Strings get whatever is left once every argument after them has its space.
+        auto string = argument.string ? argument.string : "(null)";
+        auto space = sizeof(record->message) - record->length - 1 - (1 + sizeof(u64)) * (argument_count - i - 1);
+
+        size_t length = 0;
+        while (string[length] != '\0' && length < space && length < 0x7F) {
+            length++;
+        }
+
+        record->message[record->length++] = (char)length;
+        for (size_t j = 0; j < length; j++) {
+            record->message[record->length++] = string[j];
+        }
+    }
+}
+
+size_t Log::encode_deferred_record(const Record& record, char* buffer)
+{
+    size_t size = 0;
+    buffer[size++] = (char)DeferredRecordMarker;
+
+    size += encode_varint(buffer + size, zigzag((i64)(record.timestamp - m_last_deferred_timestamp)));
+    m_last_deferred_timestamp = record.timestamp;
+
+    size += encode_varint(buffer + size, (uintptr_t)record.entry / DeferredLogEntryAlignment);
+
+    for (size_t position = 0; position < record.length;) {
+        auto type = (FormatArgument::Type)record.message[position++];
+
+        if (type == FormatArgument::Type::String) {
+            auto length = (u8)record.message[position++];
+            size += encode_varint(buffer + size, length);
+
+            for (size_t i = 0; i < length; i++) {
+                buffer[size++] = record.message[position++];
+            }
+
+            continue;
+        }
+
+        auto value = load_u64(record.message + position);
+        position += sizeof(u64);
+
+        if (type == FormatArgument::Type::Signed) {
+            size += encode_varint(buffer + size, zigzag((i64)value));
+        } else if (type == FormatArgument::Type::Pointer) {
+            // Pointers tend to be close to the one before them, so only the difference is sent.
+            size += encode_varint(buffer + size, zigzag((i64)(value - m_last_deferred_pointer)));
+            m_last_deferred_pointer = value;
+        } else {
+            size += encode_varint(buffer + size, value);
+        }
+    }
+
+    return size;
+}
+
+// A record as it goes out over the UART. Every string in a deferred record is shorter than its varint would be at
+// most, so one of those always fits. A text record is cut short if its subsystem's name is unreasonably long.
+struct OutgoingRecord {
+    char data[256];
+    size_t size;
+};
+
+static_assert(sizeof(OutgoingRecord::data) >= 1 + MaxVarintSize * (2 + Log::MaxDeferredArguments) + sizeof(Log::Record::message));
+
+static void append_to_outgoing_record(void* context, const char* data, size_t size)
+{
+    auto record = (OutgoingRecord*)context;
+
+    for (size_t i = 0; i < size && record->size < sizeof(record->data); i++) {
+        record->data[record->size++] = data[i];
+    }
+}
+
+template <typename... Arguments>
+static void format_outgoing_record(OutgoingRecord& record, FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments)
+{
+    record.size = 0;
+
+    FormatBuffer buffer(append_to_outgoing_record, &record);
+    format(buffer, string, arguments...);
+}
+
+void Log::drain()
+{
+    this->drain_records(true);
+}
+
+void Log::drain_without_waiting()
+{
+    this->drain_records(false);
+}
+
+void Log::drain_records(bool wait_for_uart)
+{
+    if (!m_is_initialized) {
+        if (m_is_draining) {
+            return;
+        }
+
+        m_is_draining = true;
+    } else if (__atomic_exchange_n(&m_is_draining, true, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    auto& uart = UART::instance();
+
+    // Without waiting, a record only goes out if all of it fits in the UART's transmit buffer, otherwise it is left
+    // for next time.
+    auto write_out = [&](const OutgoingRecord& outgoing) {
+        if (!wait_for_uart) {
+            return uart.try_write(outgoing.data, outgoing.size);
+        }
+
+        uart.write(outgoing.data, outgoing.size);
+        return true;
+    };
+
+    OutgoingRecord outgoing;
+
+    while (true) {
+        auto record = &m_records[m_read_position % RecordCount];
+        if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != m_read_position + 1) {
+            break;
+        }
+
+        auto last_deferred_timestamp = m_last_deferred_timestamp;
+        auto last_deferred_pointer = m_last_deferred_pointer;
+
+        if (record->is_deferred) {
+            outgoing.size = this->encode_deferred_record(*record, outgoing.data);
+        } else {
+            const char* prefix = "";
+            if (record->level == LogLevel::Error) {
+                prefix = "ERROR: ";
+            } else if (record->level == LogLevel::Warning) {
+                prefix = "WARNING: ";
+            }
+
+            format_outgoing_record(outgoing, "[{12i}] [{s}] {s}", record->timestamp, record->subsystem, prefix);
+            append_to_outgoing_record(&outgoing, record->message, record->length);
+            append_to_outgoing_record(&outgoing, "\r\n", 2);
+        }
+
+        if (!write_out(outgoing)) {
+            // The record is encoded again next time, relative to the same records before it.
+            m_last_deferred_timestamp = last_deferred_timestamp;
+            m_last_deferred_pointer = last_deferred_pointer;
+            break;
+        }
+
+        // Hand the record back to the writers for the next time around the ring.
+        __atomic_store_n(&record->sequence, m_read_position + RecordCount, __ATOMIC_RELEASE);
+        m_read_position++;
+    }
+
+    auto records_dropped = __atomic_load_n(&m_records_dropped, __ATOMIC_RELAXED);
+    if (records_dropped != m_records_dropped_reported) {
+        format_outgoing_record(outgoing, "[Log] WARNING: {i} records were dropped because the log was full!\r\n", records_dropped - m_records_dropped_reported);
+        if (write_out(outgoing)) {
+            m_records_dropped_reported = records_dropped;
+        }
+    }
+
+    __atomic_store_n(&m_is_draining, false, __ATOMIC_RELEASE);
+}
+
+void Log::start_draining()
+{
+    auto drain = [](void*) { Log::instance().drain_without_waiting(); };
+    TimerWheel::instance().start_periodic(s_drain_timer, DrainInterval, drain, nullptr);
+}
+
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include "../fluorescent/Format.h"
+#include "../types/integer.h"
+#include "Kernel.h"
+
+namespace Kernel {
+
+// From most to least important, a subsystem logs everything up to (and including) its own level.
+enum class LogLevel : u8 {
+    Error,
+    Warning,
+    Info,
+    Debug,
+    Trace,
+};
+
+// A string literal that can be passed as a template argument.
+template <size_t N>
+struct LogString {
+    consteval LogString(const char (&string)[N])
+    {
+        for (size_t i = 0; i < N; i++) {
+            data[i] = string[i];
+        }
+    }
+
+    char data[N];
+};
+
+// The format string of a message that can be deferred, see `operator""_log`.
+template <LogString String>
+struct LogFormat {
+};
+
+// A deferred message's format string, along with everything else that is needed to turn it back into text. These
+// are collected into the .log_formats section, which is kept in the ELF but never loaded (see linker.ld), and the
+// address of an entry (divided by its alignment, to keep it short) is what identifies it in a binary record.
+//
+// Layout: [level] [argument count] [argument types...] [subsystem] \0 [format string] \0
+// The low nibble of an argument type is its FormatArgument::Type, and the high nibble is its size in bytes.
+//
+// GCC ignores section attributes on members of templates, so linker.ld picks these out by their (mangled) name.
+static constexpr size_t DeferredLogEntryAlignment = 16;
+
+template <LogLevel Level, LogString Subsystem, LogString String, typename... Arguments>
+struct DeferredLogEntry {
+    struct alignas(DeferredLogEntryAlignment) Data {
+        u8 bytes[2 + sizeof...(Arguments) + sizeof(Subsystem.data) + sizeof(String.data)];
+    };
+
+    static consteval Data make()
+    {
+        Data entry {};
+        size_t size = 0;
+
+        entry.bytes[size++] = (u8)Level;
+        entry.bytes[size++] = sizeof...(Arguments);
+
+        // The extra element keeps this from being an empty array when there are no arguments.
+        const u8 types[] = { (u8)((u8)format_argument_type<Arguments>() | sizeof(typename Decay<Arguments>::Type) << 4)..., 0 };
+        for (size_t i = 0; i < sizeof...(Arguments); i++) {
+            entry.bytes[size++] = types[i];
+        }
+
+        for (auto character : Subsystem.data) {
+            entry.bytes[size++] = character;
+        }
+
+        for (auto character : String.data) {
+            entry.bytes[size++] = character;
+        }
+
+        return entry;
+    }
+
+    static constexpr Data data = make();
+};
+
+// The kernel's log.
+// Messages are formatted into a record in a ring buffer, stamped with the cycle counter, and only written out to the
+// UART once the log is drained. Writing a record never waits on anything, so it's cheap enough for hot paths.
+//
+// Once start_draining() has been called, a timer on the boot core moves as many records as fit into the UART's
+// transmit buffer every few milliseconds, without waiting for it, and so does any core that goes idle (see
+// SMP::idle()). Until then, the ring only holds on to the first RecordCount records.
+//
+// With LOG_DEFERRED, messages written with `_log` aren't formatted at all: the record only holds the address of the
+// message's DeferredLogEntry and the raw arguments, which the drain writes to the UART as a binary record:
+//
+//     [0x1E] [timestamp - previous timestamp] [entry address / 16] [arguments...]
+//
+// Every number is a LEB128 varint (zigzag encoded if it can be negative), pointers are sent as the difference from
+// the pointer before them, and strings are a length followed by their characters. Tools/LogDecoder turns these
+// back into text, with the help of the kernel's ELF.
+//
+// The ring is a bounded multi-producer queue: a writer claims a record by moving the write position forward, and
+// publishes it by bumping the record's sequence number, so writers can interrupt (or run alongside) each other and
+// the drain. When the ring is full, new records are dropped (and counted) instead of overwriting unread ones, which
+// the drain reports with a warning. Nothing slows a writer down to the UART's speed, so anything that writes more
+// than the UART can send (about 1 KiB every 10 ms at 115200 baud) for long enough will lose records, such as
+// MemoryManagement's Trace level under an allocation-heavy workload. Tools/AllocatorBench rejects a trace like that.
+class Log {
+public:
+    static constexpr size_t RecordCount = 256;
+    static constexpr size_t RecordSize = 128;
+
+    struct Record {
+        // `position` while the record is free to be written, `position + 1` once it has been written.
+        u64 sequence;
+
+        u64 timestamp;
+
+        union {
+            const char* subsystem;
+
+            // The DeferredLogEntry of a deferred message.
+            const void* entry;
+        };
+
+        LogLevel level;
+        bool is_deferred;
+        u8 length;
+
+        // The formatted text, or the arguments of a deferred message.
+        char message[RecordSize - 27];
+    };
+
+    // Starts a binary record on the wire, this can't appear anywhere in text.
+    static constexpr u8 DeferredRecordMarker = 0x1E;
+
+    // Every argument of a deferred message has to fit in a record.
+    static constexpr size_t MaxDeferredArguments = 8;
+
+    static_assert(sizeof(Record) == RecordSize);
+
+    static Log& instance();
+
+    Log(const Log&) = delete;
+    Log& operator=(const Log&) = delete;
+
+    // Starts the cycle counter, and switches the ring over to atomic accesses. Exclusive loads and stores don't work
+    // on Device memory, so this has to wait until the MMU is on. Until then, the kernel runs on a single core with
+    // interrupts masked, so plain accesses are enough.
+    void initialize();
+
+    template <typename... Arguments>
+    void write(LogLevel level, const char* subsystem, FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments)
+    {
+        auto record = this->claim_record();
+        if (record == nullptr) {
+            return;
+        }
+
+        record->level = level;
+        record->subsystem = subsystem;
+        record->is_deferred = false;
+        record->length = 0;
+
+        {
+            FormatBuffer buffer(append_to_record, record);
+            format(buffer, string, arguments...);
+        }
+
+        this->publish_record(record);
+    }
+
+    template <typename... Arguments>
+    void write_deferred(const void* entry, const Arguments&... arguments)
+    {
+        static_assert(sizeof...(Arguments) <= MaxDeferredArguments, "Too many arguments for a deferred message!");
+
+        auto record = this->claim_record();
+        if (record == nullptr) {
+            return;
+        }
+
+        record->entry = entry;
+        record->is_deferred = true;
+        record->length = 0;
+
+        // The extra element keeps this from being an empty array when there are no arguments.
+        const FormatArgument format_arguments[] = { make_format_argument(arguments)..., {} };
+        store_deferred_record(record, format_arguments, sizeof...(Arguments));
+
+        this->publish_record(record);
+    }
+
+    // Writes every record that has been published so far to the UART, oldest first, waiting for the UART to make
+    // room if it has to. If the log is already being drained somewhere else, this returns straight away.
+    void drain();
+
+    // Like drain(), but stops at the first record that doesn't fit in the UART's transmit buffer, so it never waits
+    // for the UART, and can be used from an interrupt handler. Nothing is written until the UART's interrupt is on.
+    void drain_without_waiting();
+
+    // Starts draining the log from a timer, see above. This needs the UART and the TimerWheel.
+    void start_draining();
+
+    u64 records_dropped() const { return m_records_dropped; }
+
+private:
+    Log();
+
+    Record* claim_record();
+    void publish_record(Record*);
+
+    void drain_records(bool wait_for_uart);
+
+    static void append_to_record(void* record, const char* data, size_t size);
+    static void store_deferred_record(Record*, const FormatArgument* arguments, size_t argument_count);
+    size_t encode_deferred_record(const Record&, char* buffer);
+
+    Record m_records[RecordCount];
+
+    u64 m_write_position { 0 };
+    u64 m_read_position { 0 };
+
+    bool m_is_draining { false };
+    bool m_is_initialized { false };
+
+    u64 m_records_dropped { 0 };
+    u64 m_records_dropped_reported { 0 };
+
+    // Deferred records only carry the difference from the timestamp (and pointer) before them.
+    u64 m_last_deferred_timestamp { 0 };
+    u64 m_last_deferred_pointer { 0 };
+};
+
+// Marks a message as one that can be deferred, e.g. `logger.trace("Freed {#}"_log, pointer)`.
+template <LogString String>
+consteval LogFormat<String> operator""_log()
+{
+    return {};
+}
+
+// A subsystem's handle on the log. Anything more detailed than `Level` is discarded at compile time, and everything
+// else is always inlined, so a disabled call site doesn't even cost a function call.
+//
+//     static constexpr Logger<PAGE_ALLOCATOR_LOG_LEVEL, "PageAllocator"> logger {};
+//     logger.warning("Ignoring invalid free of {#}", pointer);
+//     logger.debug("Allocated order {i} block at {#}"_log, order, block);
+//
+// Messages on hot paths should use `_log`, so that they can be deferred (see LOG_DEFERRED in Kernel.h).
+template <LogLevel Level, LogString Subsystem>
+class Logger {
+public:
+    template <typename... Arguments>
+    [[gnu::always_inline]] void error(FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments) const
+    {
+        this->log<LogLevel::Error>(string, arguments...);
+    }
+
+    template <LogString String, typename... Arguments>
+    [[gnu::always_inline]] void error(LogFormat<String> format, const Arguments&... arguments) const
+    {
+        this->log<LogLevel::Error>(format, arguments...);
+    }
+
+    template <typename... Arguments>
+    [[gnu::always_inline]] void warning(FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments) const
+    {
+        this->log<LogLevel::Warning>(string, arguments...);
+    }
+
+    template <LogString String, typename... Arguments>
+    [[gnu::always_inline]] void warning(LogFormat<String> format, const Arguments&... arguments) const
+    {
+        this->log<LogLevel::Warning>(format, arguments...);
+    }
+
+    template <typename... Arguments>
+    [[gnu::always_inline]] void info(FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments) const
+    {
+        this->log<LogLevel::Info>(string, arguments...);
+    }
+
+    template <LogString String, typename... Arguments>
+    [[gnu::always_inline]] void info(LogFormat<String> format, const Arguments&... arguments) const
+    {
+        this->log<LogLevel::Info>(format, arguments...);
+    }
+
+    template <typename... Arguments>
+    [[gnu::always_inline]] void debug(FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments) const
+    {
+        this->log<LogLevel::Debug>(string, arguments...);
+    }
+
+    template <LogString String, typename... Arguments>
+    [[gnu::always_inline]] void debug(LogFormat<String> format, const Arguments&... arguments) const
+    {
+        this->log<LogLevel::Debug>(format, arguments...);
+    }
+
+    template <typename... Arguments>
+    [[gnu::always_inline]] void trace(FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments) const
+    {
+        this->log<LogLevel::Trace>(string, arguments...);
+    }
+
+    template <LogString String, typename... Arguments>
+    [[gnu::always_inline]] void trace(LogFormat<String> format, const Arguments&... arguments) const
+    {
+        this->log<LogLevel::Trace>(format, arguments...);
+    }
+
+    static constexpr bool is_enabled(LogLevel level) { return level <= Level; }
+
+private:
+    template <LogLevel MessageLevel, typename... Arguments>
+    [[gnu::always_inline]] void log(FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments) const
+    {
+        if constexpr (MessageLevel <= Level) {
+            Log::instance().write(MessageLevel, Subsystem.data, string, arguments...);
+        }
+    }
+
+    template <LogLevel MessageLevel, LogString String, typename... Arguments>
+    [[gnu::always_inline]] void log(LogFormat<String>, const Arguments&... arguments) const
+    {
+        // Deferred or not, the format string is checked against the arguments.
+        constexpr FormatString<Arguments...> string(String.data);
+
+        if constexpr (MessageLevel <= Level) {
+            if constexpr (LOG_DEFERRED) {
+                Log::instance().write_deferred(&DeferredLogEntry<MessageLevel, Subsystem, String, Arguments...>::data, arguments...);
+            } else {
+                Log::instance().write(MessageLevel, Subsystem.data, string, arguments...);
+            }
+        }
+    }
+};
+
+}
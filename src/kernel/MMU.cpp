@@ -0,0 +1,158 @@
+#include "MMU.h"
+#include "Board.h"
+
+// Most of the magic numbers you see here are from:
+// https://developer.arm.com/documentation/101811/0103/Translation-granule
+// https://developer.arm.com/documentation/ddi0487/latest (D8: The AArch64 Virtual Memory System Architecture)
+
+namespace Kernel {
+
+using Descriptor = MMU::Descriptor;
+
+struct SystemControl {
+    static const u64 MMUEnable = 1 << 0;
+    static const u64 DataCacheEnable = 1 << 2;
+    static const u64 InstructionCacheEnable = 1 << 12;
+};
+
+static const u64 GiB = 1024 * 1024 * 1024;
+static const u64 BlockSize = 2 * 1024 * 1024;
+
+// The tables live in the BSS, which is zeroed (invalid) before we get here.
+alignas(4096) static u64 s_level1_table[512];
+alignas(4096) static u64 s_level2_table[512];
+
+static u64 block_descriptor(u64 address, bool is_device)
+{
+    if (is_device) {
+        return address | Descriptor::Block | Descriptor::attribute(MMU::Attribute::Device) | Descriptor::AccessFlag
+            | Descriptor::PrivilegedExecuteNever | Descriptor::UnprivilegedExecuteNever;
+    }
+
+    return address | Descriptor::Block | Descriptor::attribute(MMU::Attribute::Normal) | Descriptor::Shareability::Inner
+        | Descriptor::AccessFlag;
+}
+
+void MMU::initialize()
+{
+    // Everything from the start of the peripherals up to 4 GiB is treated as a device.
+    // On the Pi 3, this also covers the ARM local peripherals at 0x40000000.
+    auto device_start = (u64)Board::peripheral_window_start();
+
+    for (u64 i = 0; i < 4; i++) {
+        auto address = i * GiB;
+
+        // The gigabyte that the peripherals start in has to be mapped with 2 MiB blocks.
+        if (address < device_start && device_start < address + GiB) {
+            for (u64 j = 0; j < 512; j++) {
+                auto block_address = address + j * BlockSize;
+                s_level2_table[j] = block_descriptor(block_address, block_address >= device_start);
+            }
+
+            s_level1_table[i] = (u64)s_level2_table | Descriptor::Table;
+            continue;
+        }
+
+        s_level1_table[i] = block_descriptor(address, address >= device_start);
+    }
+
+    enable();
+}
+
+void MMU::enable()
+{
+    // Device-nGnRE, Normal write-back read/write-allocate, and Normal non-cacheable.
+    u64 memory_attributes = (0x04 << (8 * Attribute::Device)) | (0xFF << (8 * Attribute::Normal)) | (0x44 << (8 * Attribute::NormalNonCacheable));
+    asm volatile("msr mair_el1, %x0" ::"r"(memory_attributes));
+
+    // The physical address size that we tell the MMU about has to be one that the CPU supports.
+    u64 memory_model_features;
+    asm volatile("mrs %x0, id_aa64mmfr0_el1"
+                 : "=r"(memory_model_features));
+
+    auto physical_address_range = memory_model_features & 0xF;
+
+    u64 translation_control = (64 - VirtualAddressBits) // T0SZ
+        | (0b01 << 8) // IRGN0: Table walks are write-back cacheable...
+        | (0b01 << 10) // ORGN0: ...in both the inner and outer caches
+        | (0b11 << 12) // SH0: Inner shareable
+        | (0b00 << 14) // TG0: 4 KiB granule
+        | (1 << 23) // EPD1: We don't use TTBR1
+        | (physical_address_range << 32); // IPS
+    asm volatile("msr tcr_el1, %x0" ::"r"(translation_control));
+
+    asm volatile("msr ttbr0_el1, %x0" ::"r"((u64)s_level1_table));
+
+    // Make sure that the tables are visible to the table walker, and that nothing stale is in the TLB.
+    asm volatile("dsb ish\n"
+                 "isb\n"
+                 "tlbi vmalle1\n"
+                 "dsb ish\n"
+                 "isb");
+
+    u64 system_control;
+    asm volatile("mrs %x0, sctlr_el1"
+                 : "=r"(system_control));
+
+    system_control |= SystemControl::MMUEnable | SystemControl::DataCacheEnable | SystemControl::InstructionCacheEnable;
+
+    asm volatile("ic iallu\n"
+                 "dsb ish\n"
+                 "msr sctlr_el1, %x0\n"
+                 "isb" ::"r"(system_control));
+}
+
+u64* MMU::level1_table()
+{
+    return s_level1_table;
+}
+
+bool MMU::is_enabled()
+{
+    u64 system_control;
+    asm volatile("mrs %x0, sctlr_el1"
+                 : "=r"(system_control));
+
+    return system_control & SystemControl::MMUEnable;
+}
+
+// DminLine in CTR_EL0 is the log2 of the smallest data cache line in words.
+static size_t data_cache_line_size()
+{
+    u64 cache_type;
+    asm volatile("mrs %x0, ctr_el0"
+                 : "=r"(cache_type));
+
+    return (size_t)4 << ((cache_type >> 16) & 0xF);
+}
+
+void MMU::clean_data_cache(const volatile void* address, size_t size)
+{
+    auto line_size = data_cache_line_size();
+    auto end = (uintptr_t)address + size;
+
+    for (auto line = (uintptr_t)address & ~(line_size - 1); line < end; line += line_size) {
+        asm volatile("dc cvac, %0" ::"r"(line)
+                     : "memory");
+    }
+
+    asm volatile("dsb sy" ::
+                     : "memory");
+}
+
+void MMU::invalidate_data_cache(const volatile void* address, size_t size)
+{
+    auto line_size = data_cache_line_size();
+    auto end = (uintptr_t)address + size;
+
+    // `dc civac` instead of `dc ivac`, so that partial lines at either end don't lose anything that we wrote.
+    for (auto line = (uintptr_t)address & ~(line_size - 1); line < end; line += line_size) {
+        asm volatile("dc civac, %0" ::"r"(line)
+                     : "memory");
+    }
+
+    asm volatile("dsb sy" ::
+                     : "memory");
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "../types/integer.h"
+
+namespace Kernel {
+
+// Sets up an identity map of the whole 4 GiB physical address space, and turns on the MMU and caches.
+// RAM is mapped as Normal (write-back cacheable) memory, and the peripherals as Device-nGnRE memory.
+// Everything is mapped with 1 GiB and 2 MiB blocks, so the whole map only takes two tables.
+class MMU {
+public:
+    // The virtual address space is 2^39 bytes (512 GiB), which means that translation starts at level 1.
+    static constexpr u64 VirtualAddressBits = 39;
+
+    // Indices into MAIR_EL1, see MMU::enable().
+    struct Attribute {
+        static const u64 Device = 0;
+        static const u64 Normal = 1;
+        static const u64 NormalNonCacheable = 2;
+    };
+
+    // https://developer.arm.com/documentation/101811/0103/Translation-tables-in-ARMv8-A
+    struct Descriptor {
+        static const u64 Valid = 1 << 0;
+
+        // Level 1 and 2 only
+        static const u64 Block = 0b01;
+        static const u64 Table = 0b11;
+
+        // Level 3 only
+        static const u64 Page = 0b11;
+
+        static u64 attribute(u64 index) { return index << 2; }
+
+        struct Shareability {
+            static const u64 Inner = 0b11 << 8;
+        };
+
+        static const u64 ReadOnly = 0b10 << 6;
+        static const u64 AccessFlag = 1 << 10;
+        static const u64 PrivilegedExecuteNever = (u64)1 << 53;
+        static const u64 UnprivilegedExecuteNever = (u64)1 << 54;
+
+        static const u64 AddressMask = 0x0000FFFFFFFFF000;
+    };
+
+    // Builds the page tables, and enables the MMU on this core. This must be called before anything else runs!
+    static void initialize();
+
+    // Enables the MMU on this core, using the tables built by initialize().
+    static void enable();
+
+    static bool is_enabled();
+
+    // The table that all translations start from, see VirtualMemory for mapping anything outside of the identity map.
+    static u64* level1_table();
+
+    // Cache maintenance for memory that is shared with something that doesn't go through our caches (the
+    // VideoCore, DMA, or a core with its MMU still off).
+    static void clean_data_cache(const volatile void* address, size_t size);
+    static void invalidate_data_cache(const volatile void* address, size_t size);
+};
+
+}
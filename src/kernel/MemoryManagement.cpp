@@ -1,13 +1,15 @@
 #include "MemoryManagement.h"
+#include "../fluorescent/Memory.h"
 #include "Kernel.h"
+#include "Log.h"
 #include "Processor.h"
+#include "VirtualMemory.h"
 #include "io/UART.h"
 
-// Defined in the linker script
-extern "C" u8 __bss_end;
-
 namespace Kernel {
 
+static constexpr Logger<MEMORY_MANAGEMENT_LOG_LEVEL, "MemoryManagement"> logger {};
+
 MemoryManagement& MemoryManagement::instance()
 {
     static MemoryManagement instance;
@@ -16,33 +18,177 @@ MemoryManagement& MemoryManagement::instance()
 
 void* MemoryManagement::allocate(size_t size)
 {
-    auto optional_region = this->find_next_free_region(size);
-    if (optional_region) {
-        auto region = optional_region.get();
+    Region* region;
+    if (size <= MaxSizeClassSize) {
+        // Small allocations have their own free lists, which means that we never have to walk the free list for them
+        // (and usually don't even need the lock).
+        region = this->allocate_from_magazine(size_class_for(size));
+    } else {
+        Locker locker(m_lock);
+        region = this->allocate_region(align_size(size));
+    }
 
-        if (MEMORY_MANAGEMENT_DEBUG || MEMORY_MANAGEMENT_ALLOCATION_DEBUG) {
-            UART::instance().println("[MemoryManagement] Reused {i} bytes. ({#} -> {#})", region.size, region.start, (u8*)region.start + region.size);
-        }
+    if (region == nullptr) {
+        return nullptr;
+    }
+
+    if (m_zeroing_policy == ZeroingPolicy::ZeroOnAllocate) {
+        zero_memory(region->start, region->size);
+    }
+
+    logger.trace("[trace] a {#} {i}"_log, region->start, size);
+
+    return region->start;
+}
+
+void* MemoryManagement::allocate_aligned(size_t size, size_t alignment)
+{
+    if (alignment <= DefaultAlignment) {
+        return this->allocate(size);
+    }
+
+    // A region of size 0 would look like the heap's end marker (see physical_next), so nothing is smaller than the
+    // smallest size class.
+    auto aligned_size = align_size(size);
+    if (aligned_size < DefaultAlignment) {
+        aligned_size = DefaultAlignment;
+    }
+
+    Region* region;
+    {
+        Locker locker(m_lock);
+        region = this->allocate_aligned_region(aligned_size, alignment);
+    }
+
+    if (region == nullptr) {
+        return nullptr;
+    }
+
+    logger.debug("Aligned {i} bytes to {i} bytes. ({#} -> {#})"_log, region->size, alignment, region->start, (u8*)region->start + region->size);
+
+    if (m_zeroing_policy == ZeroingPolicy::ZeroOnAllocate) {
+        zero_memory(region->start, region->size);
+    }
+
+    logger.trace("[trace] A {#} {i} {i}"_log, region->start, size, alignment);
+
+    return region->start;
+}
+
+Region* MemoryManagement::allocate_aligned_region(size_t aligned_size, size_t alignment)
+{
+    // We need enough room to move the start up to the next aligned address, while leaving enough space in front of
+    // it for a region of its own.
+    auto region = this->allocate_region(aligned_size + alignment + RegionOverhead + MinimumSplitSize);
+    if (region == nullptr) {
+        return nullptr;
+    }
+
+    auto start = (uintptr_t)region->start;
+    auto aligned_start = align(start, alignment);
+    while (aligned_start != start && aligned_start - start < RegionOverhead + MinimumSplitSize) {
+        aligned_start += alignment;
+    }
+
+    // The space in front of the aligned address becomes a free region, the rest becomes the aligned region.
+    if (aligned_start != start) {
+        auto leading_size = aligned_start - start - RegionOverhead;
+        auto total_size = region->size;
+
+        auto leading_region = this->write_region((u8*)region, leading_size);
+        region = this->write_region((u8*)aligned_start - sizeof(Region), total_size - leading_size - RegionOverhead);
+
+        leading_region->is_free = true;
+        this->insert_free_region(this->coalesce_region(leading_region));
+    }
+
+    this->split_region(region, aligned_size);
+
+    return region;
+}
 
-        m_bytes_reused += region.size;
-        return region.start;
+Region* MemoryManagement::allocate_region(size_t size)
+{
+    auto reused_region = this->find_next_free_region(size);
+
+    // If nothing fits, the size classes may be holding on to something that does.
+    if (!reused_region) {
+        this->release_size_class_caches();
+        reused_region = this->find_next_free_region(size);
+    }
+
+    if (reused_region) {
+        logger.debug("Reused {i} bytes. ({#} -> {#})"_log, reused_region->size, reused_region->start, (u8*)reused_region->start + reused_region->size);
+
+        m_bytes_reused += reused_region->size;
+        return reused_region;
     }
 
     auto region = this->allocate_new_region(size);
-    region.is_free = false;
+    if (region == nullptr) {
+        logger.error("Failed to allocate {i} bytes!", size);
+        return nullptr;
+    }
+
+    m_bytes_allocated += region->size;
+
+    logger.debug("Allocated {i} bytes. ({#} -> {#})"_log, region->size, region->start, (u8*)region->start + region->size);
+
+    return region;
+}
+
+Region* MemoryManagement::allocate_from_size_class(size_t size)
+{
+    auto size_class_index = size_class_for(size);
+    auto& size_class = m_size_classes[size_class_index];
+
+    // If something of this size class has been free'd before, we can just pop it off of the free list.
+    if (size_class.free_list != nullptr) {
+        auto region = size_class.free_list;
+        size_class.free_list = region->next_free;
+        size_class.hits++;
+
+        region->next_free = nullptr;
+        region->is_free = false;
 
-    m_bytes_allocated += region.size;
+        logger.debug("Reused {i} bytes from size class {i}. ({#} -> {#})"_log, region->size, size_class_index, region->start, (u8*)region->start + region->size);
 
-    if (MEMORY_MANAGEMENT_DEBUG || MEMORY_MANAGEMENT_ALLOCATION_DEBUG) {
-        UART::instance().println("[MemoryManagement] Allocated {i} bytes. ({#} -> {#})", region.size, region.start, (u8*)region.start + region.size);
+        m_bytes_reused += region->size;
+        return region;
     }
 
-    return region.start;
+    // Otherwise, we need a region which is the size of the class, so that it can be re-used by anything else in this
+    // class once it has been free'd. We prefer carving it out of an existing free region over growing the heap.
+    size_class.misses++;
+
+    auto class_size = size_of_size_class(size_class_index);
+    auto region = this->find_next_free_region(class_size);
+    if (!region) {
+        this->release_size_class_caches();
+        region = this->find_next_free_region(class_size);
+    }
+
+    if (region) {
+        m_bytes_reused += region->size;
+    } else {
+        region = this->allocate_new_region(class_size);
+        if (region == nullptr) {
+            logger.error("Failed to allocate {i} bytes!", class_size);
+            return nullptr;
+        }
+
+        m_bytes_allocated += region->size;
+    }
+
+    region->size_class = size_class_index;
+
+    logger.debug("Allocated {i} bytes for size class {i}. ({#} -> {#})"_log, region->size, size_class_index, region->start, (u8*)region->start + region->size);
+
+    return region;
 }
 
-// Our memory management approach has a pretty big issue at the moment...
-// We don't fill the gaps of memory that has been free()'d, meaning that we will just exponentially grow,
-// meaning that free() has no real benefits apart from scrubbing out sensitive data.
+// Free'd regions are merged with their free neighbours (see coalesce_region), and a large free region at the end of
+// the heap gives its pages back (see trim_heap), so a long-running workload will stay at roughly its peak heap size.
 void MemoryManagement::free(void* pointer)
 {
     if (pointer == nullptr) {
@@ -53,153 +199,640 @@ void MemoryManagement::free(void* pointer)
     auto region = (Region*)region_pointer;
 
     // We don't do anything with invalid regions
-    if (region->start == nullptr || region->size == 0 || region->is_free) {
+    if (region->start != pointer || region->size == 0 || region->is_free) {
         return;
     }
 
+    logger.trace("[trace] f {#}"_log, pointer);
+
+    // Scrub out the data. The region is still in use until it is marked as free, so this can happen without the lock.
+    if (m_zeroing_policy == ZeroingPolicy::ScrubOnFree) {
+        zero_memory(region->start, region->size);
+    }
+
+    logger.debug("Free'd {i} bytes. ({#} -> {#})"_log, region->size, region->start, (u8*)region->start + region->size);
+
+    // Regions that belong to a size class go back into this core's magazine, they are only merged with their
+    // neighbours once the heap runs out of space (see release_size_class_caches).
+    if (region->size_class != NoSizeClass) {
+        return this->free_to_magazine(region, region->size_class);
+    }
+
+    Locker locker(m_lock);
+
     // Mark the region as free
     region->is_free = true;
 
-    // Scrub out the data
-    for (auto i = 0; i < region->size; i++) {
-        *((u8*)region->start + i) = 0;
+    m_bytes_freed += region->size;
+
+    region = this->coalesce_region(region);
+    this->trim_heap(region);
+    this->insert_free_region(region);
+}
+
+void MemoryManagement::free(void* pointer, size_t size)
+{
+    if (pointer == nullptr || size > MaxSizeClassSize) {
+        return this->free(pointer);
+    }
+
+    // The size tells us the size class, so there is nothing to validate or look up.
+    auto region = (Region*)((u8*)pointer - sizeof(Region));
+    auto size_class_index = size_class_for(size);
+
+    if (logger.is_enabled(LogLevel::Debug) && (region->start != pointer || region->is_free || region->size_class != size_class_index)) {
+        logger.error("Sized free of {i} bytes doesn't match the region at {#}!", size, pointer);
+        return;
+    }
+
+    logger.trace("[trace] f {#}"_log, pointer);
+
+    if (m_zeroing_policy == ZeroingPolicy::ScrubOnFree) {
+        zero_memory(pointer, size_of_size_class(size_class_index));
+    }
+
+    this->free_to_magazine(region, size_class_index);
+}
+
+Region* MemoryManagement::allocate_from_magazine(u8 size_class_index)
+{
+    auto& magazine = m_core_caches.current().magazines[size_class_index];
+    if (magazine.count == 0 && !this->refill_magazine(magazine, size_class_index)) {
+        return nullptr;
+    }
+
+    auto region = magazine.regions;
+    magazine.regions = region->next_free;
+    magazine.count--;
+    magazine.allocations++;
+
+    region->next_free = nullptr;
+    region->is_free = false;
+
+    return region;
+}
+
+void MemoryManagement::free_to_magazine(Region* region, u8 size_class_index)
+{
+    auto& cache = m_core_caches.current();
+    auto& magazine = cache.magazines[size_class_index];
+
+    region->is_free = true;
+    region->next_free = magazine.regions;
+    magazine.regions = region;
+    magazine.count++;
+
+    cache.bytes_freed += size_of_size_class(size_class_index);
+
+    if (magazine.count >= 2 * batch_size_for(size_class_index)) {
+        this->drain_magazine(magazine, size_class_index);
     }
+}
 
-    m_bytes_freed += region->size;
+bool MemoryManagement::refill_magazine(Magazine& magazine, u8 size_class_index)
+{
+    auto batch_size = batch_size_for(size_class_index);
+    auto class_size = size_of_size_class(size_class_index);
+
+    // The batch is only put into the magazine once we have all of it, as running out of space on the way flushes
+    // this core's magazines (see release_size_class_caches).
+    Region* batch = nullptr;
+    u32 count = 0;
+    {
+        Locker locker(m_lock);
+
+        for (; count < batch_size; count++) {
+            auto region = this->allocate_from_size_class(class_size);
+            if (region == nullptr) {
+                break;
+            }
 
-    if (MEMORY_MANAGEMENT_DEBUG || MEMORY_MANAGEMENT_ALLOCATION_DEBUG) {
-        UART::instance().println("[MemoryManagement] Free'd {i} bytes. ({#} -> {#})", region->size, region->start, (u8*)region->start + region->size);
+            region->is_free = true;
+            region->next_free = batch;
+            batch = region;
+        }
     }
+
+    m_core_caches.current().refills++;
+
+    magazine.regions = batch;
+    magazine.count = count;
+
+    return count != 0;
 }
 
-Region MemoryManagement::allocate_new_region(size_t size)
+void MemoryManagement::drain_magazine(Magazine& magazine, u8 size_class_index)
 {
-    // This has gotten quite messy, and there's a bit of alignment and stuff involved,
-    // but hey, it works!
+    // The regions at the front were free'd most recently, and are the most likely to still be in the cache, so it's
+    // the ones at the back that go.
+    auto keep = magazine.count - batch_size_for(size_class_index);
 
-    int* start_position = nullptr;
-    if (m_last_allocated_region) {
-        auto last_allocated_region = m_last_allocated_region.get();
+    auto last_kept = magazine.regions;
+    for (u32 i = 1; i < keep; i++) {
+        last_kept = last_kept->next_free;
+    }
 
-        // FIXME: Why wasn't region.end working here?
-        start_position = (int*)last_allocated_region.start + sizeof(Region) + last_allocated_region.size;
-    } else {
-        if (MEMORY_MANAGEMENT_DEBUG) {
-            UART::instance().println("[MemoryManagement] Last region was invalid! Starting from the end of the BSS.");
+    auto region = last_kept->next_free;
+    last_kept->next_free = nullptr;
+    magazine.count = keep;
+
+    m_core_caches.current().drains++;
+
+    Locker locker(m_lock);
+
+    while (region != nullptr) {
+        auto next = region->next_free;
+        this->free_to_size_class(region, size_class_index);
+        region = next;
+    }
+}
+
+void MemoryManagement::flush_magazines()
+{
+    for (u8 i = 0; i < SizeClassCount; i++) {
+        auto& magazine = m_core_caches.current().magazines[i];
+
+        auto region = magazine.regions;
+        while (region != nullptr) {
+            auto next = region->next_free;
+            this->free_to_size_class(region, i);
+            region = next;
         }
 
-        start_position = (int*)&__bss_end;
+        magazine.regions = nullptr;
+        magazine.count = 0;
     }
+}
+
+void MemoryManagement::free_to_size_class(Region* region, u8 size_class_index)
+{
+    auto& size_class = m_size_classes[size_class_index];
+    region->next_free = size_class.free_list;
+    size_class.free_list = region;
+}
+
+// Moves every region that is sitting in a size class' free list (or in this core's magazines) back into the general
+// free list, merging them with their neighbours on the way. This is only done when we are about to grow the heap.
+// Other cores' magazines are left alone, they belong to those cores.
+void MemoryManagement::release_size_class_caches()
+{
+    this->flush_magazines();
+
+    for (u8 i = 0; i < SizeClassCount; i++) {
+        auto& size_class = m_size_classes[i];
+
+        auto region = size_class.free_list;
+        size_class.free_list = nullptr;
 
-    if (start_position == nullptr) {
-        Processor::panic("MemoryManagement::find_next_free_region failed to locate a valid start position!");
-        return {};
+        while (region != nullptr) {
+            auto next = region->next_free;
+
+            region->next_free = nullptr;
+            region->size_class = NoSizeClass;
+
+            region = this->coalesce_region(region);
+            this->trim_heap(region);
+            this->insert_free_region(region);
+
+            region = next;
+        }
     }
+}
 
-    // TODO: Check if we are near the peripheral base address.
-    //       It's not something we want to overwrite, but we should be fine for now.
+// Moves the heap's break up far enough to hold `size` bytes, and carves a region out of the new space.
+// The new space is only backed by physical pages once something touches it.
+Region* MemoryManagement::allocate_new_region(size_t size)
+{
+    auto& virtual_memory = VirtualMemory::instance();
+
+    // If the last region is free, it only has to be extended. It can't already be large enough, otherwise
+    // find_next_free_region() would have found it.
+    size_t needed = RegionOverhead + size;
+    if (m_end_marker == nullptr) {
+        needed += sizeof(RegionFooter) + sizeof(Region);
+    } else if (auto last_region = this->physical_previous(m_end_marker); is_coalescable(last_region)) {
+        needed -= RegionOverhead + last_region->size;
+    }
 
-    auto aligned_start = align(start_position);
-    auto region = Region {
-        .start = (u8*)aligned_start + sizeof(Region),
-        .next = nullptr,
-        // FIXME: Why wasn't region.end working here?
-        // .end = .start + size
-        .size = size,
-        .is_free = false
-    };
+    auto growth = (needed + HeapGrowthStep - 1) & ~(HeapGrowthStep - 1);
 
-    *(Region*)aligned_start = region;
-    m_last_allocated_region = region;
+    auto old_break = (u8*)virtual_memory.grow_heap(growth);
+    if (old_break == nullptr) {
+        return nullptr;
+    }
+
+    // The new region takes the place of the old end marker, or of everything after the prologue footer.
+    u8* region_location = (u8*)m_end_marker;
+    if (m_heap_start == nullptr) {
+        m_heap_start = old_break;
+        ((RegionFooter*)m_heap_start)->region = nullptr;
 
-    if (m_first_region != nullptr) {
-        m_first_region->next = (Region*)aligned_start;
+        region_location = m_heap_start + sizeof(RegionFooter);
     }
 
-    m_first_region = (Region*)aligned_start;
+    auto new_break = (u8*)virtual_memory.heap_break();
+    this->write_end_marker(new_break - sizeof(Region));
+
+    logger.debug("Grew the heap by {i} bytes. ({#} -> {#})"_log, growth, old_break, new_break);
+
+    auto region = this->write_region(region_location, (u8*)m_end_marker - region_location - RegionOverhead);
+
+    // Merge with the last region if it was free, this has to be done while the new region is marked as free.
+    region->is_free = true;
+    region = this->coalesce_region(region);
+    region->is_free = false;
+
+    this->split_region(region, size);
     return region;
 }
 
-Optional<Region> MemoryManagement::find_next_free_region(size_t size)
+// The end marker is never free, so nothing will ever try to merge with it.
+void MemoryManagement::write_end_marker(u8* location)
 {
-    if (m_first_region == nullptr) {
-        if (MEMORY_MANAGEMENT_DEBUG) {
-            UART::instance().println("[MemoryManagement] Failed to find existing region to adopt as m_first_region was null!");
-        }
-        return {};
+    m_end_marker = (Region*)location;
+    *m_end_marker = Region {
+        .start = nullptr,
+        .next_free = nullptr,
+        .previous_free = nullptr,
+        .size = 0,
+        .size_class = NoSizeClass,
+        .is_free = false
+    };
+}
+
+// If a free region is the last region in the heap, and it is large enough, the break is moved down and the pages
+// are given back to the PageAllocator. We keep HeapGrowthStep bytes of it, so that a single allocate/free pair at
+// the end of the heap doesn't move the break back and forth. The region must not be in a free list.
+void MemoryManagement::trim_heap(Region* region)
+{
+    if (region->size < HeapTrimThreshold || this->physical_next(region) != nullptr) {
+        return;
     }
 
-    for (auto region = m_first_region; region != nullptr; region = region->next) {
-        if (!region->is_free) {
-            continue;
-        }
+    auto old_break = (u8*)m_end_marker + sizeof(Region);
+    auto new_break = (u8*)(((uintptr_t)region->start + HeapGrowthStep + sizeof(RegionFooter) + sizeof(Region) + VirtualMemory::PageSize - 1) & ~(VirtualMemory::PageSize - 1));
 
-        if (MEMORY_MANAGEMENT_DEBUG) {
-            UART::instance().println("[MemoryManagement] Checking if the region is suitable: \\{ start = {#}, next = {#}, size = {i}, is_free = {b} \\}...", region->start, region->next, region->size, region->is_free);
-        }
+    logger.debug("Shrinking the heap by {i} bytes..."_log, old_break - new_break);
+
+    this->write_end_marker(new_break - sizeof(Region));
+    this->write_region((u8*)region, (u8*)m_end_marker - (u8*)region->start - sizeof(RegionFooter));
+    region->is_free = true;
+
+    VirtualMemory::instance().shrink_heap(old_break - new_break);
+}
+
+Region* MemoryManagement::find_next_free_region(size_t size)
+{
+    for (auto region = m_first_free_region; region != nullptr; region = region->next_free) {
+        logger.debug("Checking if the region is suitable: \\{ start = {#}, next_free = {#}, size = {i}, is_free = {b} \\}..."_log, region->start, region->next_free, region->size, region->is_free);
 
         // If this region is too small, we can't use it for anything.
         if (region->size < size) {
             continue;
         }
 
-        // If the region is the same size as our requirement, we can just adopt it!
-        if (region->size == size) {
-            region->is_free = false;
+        // The region has to be marked as in-use before splitting, otherwise the remainder would merge back into it.
+        this->remove_free_region(region);
+        region->is_free = false;
+        this->split_region(region, size);
+
+        return region;
+    }
 
-            if (MEMORY_MANAGEMENT_DEBUG) {
-                UART::instance().println("[MemoryManagement] Adopting region of {i} bytes...", size);
-            }
+    return nullptr;
+}
+
+Region* MemoryManagement::write_region(u8* location, size_t size)
+{
+    auto region = (Region*)location;
+    *region = Region {
+        .start = location + sizeof(Region),
+        .next_free = nullptr,
+        .previous_free = nullptr,
+        .size = size,
+        .size_class = NoSizeClass,
+        .is_free = false
+    };
+
+    auto footer = (RegionFooter*)((u8*)region->start + size);
+    footer->region = region;
+
+    return region;
+}
+
+void MemoryManagement::split_region(Region* region, size_t size)
+{
+    // If the remainder would be too small to be useful, the region is handed out as-is.
+    if (region->size < size + RegionOverhead + MinimumSplitSize) {
+        logger.debug("Adopting region of {i} bytes..."_log, region->size);
+
+        return;
+    }
+
+    auto remaining_size = region->size - size - RegionOverhead;
+
+    logger.debug("Splitting region of {i} bytes into {i} and {i} bytes..."_log, region->size, size, remaining_size);
+
+    region = this->write_region((u8*)region, size);
+
+    auto remainder = this->write_region((u8*)region->start + size + sizeof(RegionFooter), remaining_size);
+    remainder->is_free = true;
+
+    this->insert_free_region(this->coalesce_region(remainder));
+}
+
+// Merges a free region with the free regions around it. The region must not be in a free list.
+Region* MemoryManagement::coalesce_region(Region* region)
+{
+    auto next = this->physical_next(region);
+    if (is_coalescable(next)) {
+        this->remove_free_region(next);
+
+        region->size += RegionOverhead + next->size;
+        ((RegionFooter*)((u8*)region->start + region->size))->region = region;
+
+        m_regions_coalesced++;
+    }
+
+    auto previous = this->physical_previous(region);
+    if (is_coalescable(previous)) {
+        this->remove_free_region(previous);
+
+        previous->size += RegionOverhead + region->size;
+        ((RegionFooter*)((u8*)previous->start + previous->size))->region = previous;
+
+        region = previous;
+        m_regions_coalesced++;
+    }
+
+    return region;
+}
+
+Region* MemoryManagement::physical_next(Region* region)
+{
+    auto next = (Region*)((u8*)region + RegionOverhead + region->size);
+
+    // The end marker is the only region with a size of 0.
+    if (next->size == 0) {
+        return nullptr;
+    }
+
+    return next;
+}
+
+Region* MemoryManagement::physical_previous(Region* region)
+{
+    return ((RegionFooter*)region - 1)->region;
+}
+
+void MemoryManagement::insert_free_region(Region* region)
+{
+    region->previous_free = nullptr;
+    region->next_free = m_first_free_region;
+
+    if (m_first_free_region != nullptr) {
+        m_first_free_region->previous_free = region;
+    }
 
-            return *region;
+    m_first_free_region = region;
+}
+
+void MemoryManagement::remove_free_region(Region* region)
+{
+    if (region->previous_free != nullptr) {
+        region->previous_free->next_free = region->next_free;
+    } else {
+        m_first_free_region = region->next_free;
+    }
+
+    if (region->next_free != nullptr) {
+        region->next_free->previous_free = region->previous_free;
+    }
+
+    region->next_free = nullptr;
+    region->previous_free = nullptr;
+}
+
+MemoryManagement::Statistics MemoryManagement::statistics()
+{
+    Locker locker(m_lock);
+
+    Statistics statistics {};
+
+    if (m_heap_start != nullptr) {
+        statistics.heap_size = (u8*)m_end_marker + sizeof(Region) - m_heap_start;
+
+        auto first_region = (Region*)(m_heap_start + sizeof(RegionFooter));
+        for (auto region = first_region; region != nullptr; region = this->physical_next(region)) {
+            statistics.regions++;
         }
+    }
 
-        if (MEMORY_MANAGEMENT_DEBUG) {
-            UART::instance().println("[MemoryManagement] Shrinking region of {i} bytes to {i} bytes...", region->size, region->size - size);
+    for (auto region = m_first_free_region; region != nullptr; region = region->next_free) {
+        statistics.free_bytes += region->size;
+        if (region->size > statistics.largest_free_region) {
+            statistics.largest_free_region = region->size;
         }
+    }
 
-        // Adjust the old header, and write it at the end of the area for our new one
-        auto free_chunk_location = (u8*)region + sizeof(Region) + size;
-        *(Region*)free_chunk_location = Region {
-            .start = (u8*)region->start + size,
-            .next = region->next,
-            .size = size,
-            .is_free = true
-        };
-
-        // Overwrite a little bit of the header's data...
-        region->size = size;
-        region->next = (Region*)free_chunk_location;
-        region->is_free = false;
+    for (u8 i = 0; i < SizeClassCount; i++) {
+        for (auto region = m_size_classes[i].free_list; region != nullptr; region = region->next_free) {
+            statistics.cached_bytes += region->size;
+        }
 
-        return *region;
+        // Other cores may be using their magazines right now, so this is only a rough count.
+        for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+            statistics.cached_bytes += __atomic_load_n(&m_core_caches.for_core(core).magazines[i].count, __ATOMIC_RELAXED) * size_of_size_class(i);
+        }
     }
 
-    return {};
+    // The fragmentation is how much of the free memory can *not* be used for a single allocation.
+    if (statistics.free_bytes != 0) {
+        statistics.fragmentation = (statistics.free_bytes - statistics.largest_free_region) * 100 / statistics.free_bytes;
+    }
+
+    return statistics;
 }
 
 void MemoryManagement::print_stats()
 {
-    auto regions = 0;
-    for (auto region = m_first_region; region != nullptr; region = region->next) {
-        regions++;
+    auto statistics = this->statistics();
+
+    // Small regions are free'd into the magazines, which keep their own count.
+    auto bytes_freed = m_bytes_freed;
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        bytes_freed += m_core_caches.for_core(core).bytes_freed;
+    }
+
+    const char* zeroing_policy = "none";
+    switch (m_zeroing_policy) {
+    case ZeroingPolicy::ScrubOnFree:
+        zeroing_policy = "scrub on free";
+        break;
+
+    case ZeroingPolicy::ZeroOnAllocate:
+        zeroing_policy = "zero on allocate";
+        break;
+
+    case ZeroingPolicy::None:
+        break;
     }
 
     UART::instance().println("[MemoryManagement] Statistics:");
-    UART::instance().println("                   - Total regions remaining:  {i}", regions);
-    UART::instance().println("                   - Total bytes free'd:       {i}", m_bytes_freed);
+    UART::instance().println("                   - Zeroing policy:           {s}", zeroing_policy);
+    UART::instance().println("                   - Heap size:                {i} ({i} bytes backed)", statistics.heap_size, VirtualMemory::instance().heap_pages_backed() * VirtualMemory::PageSize);
+    UART::instance().println("                   - Total regions remaining:  {i}", statistics.regions);
+    UART::instance().println("                   - Total bytes free'd:       {i}", bytes_freed);
     UART::instance().println("                   - Total bytes allocated:    {i}", m_bytes_allocated);
     UART::instance().println("                   - Total bytes re-used:      {i}", m_bytes_reused);
+    UART::instance().println("                   - Regions coalesced:        {i}", m_regions_coalesced);
+    UART::instance().println("                   - Free bytes:               {i} (largest region: {i}, fragmentation: {i}%)", statistics.free_bytes, statistics.largest_free_region, statistics.fragmentation);
+    UART::instance().println("                   - Cached in size classes:   {i}", statistics.cached_bytes);
+    UART::instance().println("                   - Lock contentions:         {i} ({i} cycles spent waiting)", m_lock.statistics().contentions, m_lock.statistics().cycles_waited);
+    UART::instance().println("                   - Magazines:");
+
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        auto& cache = m_core_caches.for_core(core);
+        if (cache.refills == 0) {
+            continue;
+        }
+
+        u64 allocations = 0;
+        for (auto& magazine : cache.magazines) {
+            allocations += magazine.allocations;
+        }
+
+        UART::instance().println("                       Core {i}: {i} allocations, {i} refills, {i} drains", core, allocations, cache.refills, cache.drains);
+    }
+
+    UART::instance().println("                   - Size classes (refills from the shared free lists):");
+
+    for (u8 i = 0; i < SizeClassCount; i++) {
+        auto& size_class = m_size_classes[i];
+        if (size_class.hits == 0 && size_class.misses == 0) {
+            continue;
+        }
+
+        UART::instance().println("                       {i} bytes: {i} hits, {i} misses", size_of_size_class(i), size_class.hits, size_class.misses);
+    }
 }
 
 }
 
+// The host tools (see Tools/AllocatorBench) keep the host's own operator new.
+#ifndef PHOSPHENE_HOST
+
+static void* allocate_or_panic(size_t size, size_t alignment)
+{
+    auto pointer = Kernel::MemoryManagement::instance().allocate_aligned(size, alignment);
+    if (pointer == nullptr) {
+        Kernel::Processor::panic("operator new: Out of memory!");
+    }
+
+    return pointer;
+}
+
 void* operator new(size_t size)
+{
+    return allocate_or_panic(size, Kernel::MemoryManagement::DefaultAlignment);
+}
+
+void* operator new[](size_t size)
+{
+    return allocate_or_panic(size, Kernel::MemoryManagement::DefaultAlignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return allocate_or_panic(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return allocate_or_panic(size, (size_t)alignment);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
 {
     return Kernel::MemoryManagement::instance().allocate(size);
 }
 
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return Kernel::MemoryManagement::instance().allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return Kernel::MemoryManagement::instance().allocate_aligned(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return Kernel::MemoryManagement::instance().allocate_aligned(size, (size_t)alignment);
+}
+
 void operator delete(void* pointer) noexcept
 {
-    return Kernel::MemoryManagement::instance().free(pointer);
+    Kernel::MemoryManagement::instance().free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer);
+}
+
+void operator delete(void* pointer, size_t size) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer, size);
+}
+
+// The compiler passes the same size (and pointer) that operator new[] got, cookie included, so arrays can take the
+// fast path too.
+void operator delete[](void* pointer, size_t size) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer, size);
+}
+
+// Aligned allocations don't belong to a size class, so their size is no use to us.
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer);
 }
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    Kernel::MemoryManagement::instance().free(pointer);
+}
+
+#endif
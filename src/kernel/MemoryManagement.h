@@ -1,55 +1,282 @@
 #pragma once
 
-#include "../fluorescent/Optional.h"
+#include "../fluorescent/New.h"
 #include "../types/integer.h"
+#include "PerCpu.h"
+#include "Spinlock.h"
 
 namespace Kernel {
 
+// Every region in the heap is laid out as [Region][region->size bytes][RegionFooter], with no gaps between regions.
+// The footer (a "boundary tag") allows us to find the region before us in O(1), which is what makes coalescing cheap.
 struct Region {
     void* start;
 
-    Region* next;
+    // Only valid while the region is free, see MemoryManagement::m_first_free_region and MemoryManagement::m_size_classes
+    Region* next_free;
+    Region* previous_free;
 
     size_t size;
+    u8 size_class;
     bool is_free;
 };
 
+struct RegionFooter {
+    Region* region;
+};
+
+// The heap is a single, contiguous range of virtual memory that grows upwards (see VirtualMemory::grow_heap).
+// It is laid out as [prologue footer][regions...][end marker], where the end marker is an in-use Region of size 0 that
+// sits right below the break. The prologue footer always points to nullptr, which is how we know that the first
+// region has nothing before it.
+//
+// The heap is behind a single lock, but most small allocations never get that far: each core keeps a "magazine" of
+// free regions for every size class, which it allocates from and frees to on its own. A magazine that runs dry is
+// refilled from its size class with a whole batch at once, and one that fills up hands a batch back, so the lock is
+// only taken once every few allocations (see batch_size_for). Memory is only cleared (see ZeroingPolicy) outside of
+// the lock, and growing the heap takes VirtualMemory's lock while holding this one, which is the only order that
+// they are ever taken in.
+// NOTE: This must not be used from an interrupt handler, as it may have interrupted this core's magazines, or
+// someone holding the lock.
 class MemoryManagement {
 public:
+    // When (if ever) heap memory is cleared. Whatever the policy, memory is cleared with zero_memory().
+    enum class ZeroingPolicy {
+        // Free'd memory is cleared straight away, so nothing sensitive is left lying around in the heap.
+        ScrubOnFree,
+
+        // Memory is cleared right before it is handed out, so every allocation starts out zeroed.
+        ZeroOnAllocate,
+
+        // Memory is never cleared by the heap, although fresh pages (including ones that the heap gave back, and has
+        // grown into again) still come from the page fault handler zeroed, whatever the policy.
+        None,
+    };
+
     static MemoryManagement& instance();
 
+    // Every allocation is aligned to at least this many bytes. This is what the compiler expects from operator new
+    // (__STDCPP_DEFAULT_NEW_ALIGNMENT__), and is enough for a NEON register.
+    static constexpr size_t DefaultAlignment = 16;
+
     void* allocate(size_t size);
+
+    // `alignment` must be a power of two. Anything above DefaultAlignment is carved out of a larger free region, so
+    // the space in front of the aligned address goes back to the heap instead of being wasted.
+    void* allocate_aligned(size_t size, size_t alignment);
+
     void free(void* pointer);
 
+    // `size` must be the size that was passed to allocate() (not allocate_aligned()). Small regions go straight back
+    // to their size class, without looking at the rest of the region's header.
+    void free(void* pointer, size_t size);
+
+    ZeroingPolicy zeroing_policy() const { return m_zeroing_policy; }
+    void set_zeroing_policy(ZeroingPolicy policy) { m_zeroing_policy = policy; }
+
+    struct Statistics {
+        size_t heap_size;
+        size_t regions;
+
+        // Free regions which are not in a size class.
+        size_t free_bytes;
+        size_t largest_free_region;
+        size_t fragmentation;
+
+        // Free regions which are sitting in a size class' free list.
+        size_t cached_bytes;
+    };
+
+    // Walks the whole heap, so this is not something to call in a hot path.
+    Statistics statistics();
+
     void print_stats();
 
 private:
+    // Small allocations are rounded up to one of these sizes, and are kept in a per-class free list when free'd.
+    // The classes are powers of two, with a half-step in-between (16, 32, 48, 64, 96, ...), so past 32 bytes the most
+    // we can waste on rounding is a third of the allocation. Every class is a multiple of DefaultAlignment.
+    static constexpr size_t SizeClassCount = 14;
+    static constexpr size_t MaxSizeClassSize = 2048;
+    static constexpr u8 NoSizeClass = 0xFF;
+
+    // A free region is only split if the remainder would be able to hold at least this many bytes.
+    static constexpr size_t MinimumSplitSize = 16;
+    static constexpr size_t RegionOverhead = sizeof(Region) + sizeof(RegionFooter);
+
+    // Every region's size is a multiple of DefaultAlignment, so as long as the first region's start is aligned, and
+    // the space between the end of a region and the start of the next one is too, every region's start is aligned.
+    static_assert(RegionOverhead % DefaultAlignment == 0);
+
+    // The heap's break is moved in steps of at least this many bytes. None of it costs anything until it is touched.
+    static constexpr size_t HeapGrowthStep = 64 * 1024;
+
+    // A free region at the end of the heap which is at least this large gives its pages back, down to HeapGrowthStep.
+    static constexpr size_t HeapTrimThreshold = 256 * 1024;
+
+    struct SizeClass {
+        Region* free_list;
+
+        u64 hits;
+        u64 misses;
+    };
+
+    // A core's own free regions of a single size class, see free_to_magazine(). Regions in here are free, but keep
+    // their size class, so that they are never coalesced.
+    struct Magazine {
+        Region* regions;
+        u32 count;
+
+        u64 allocations;
+    };
+
+    // Everything in here is only ever touched by the core that it belongs to (apart from statistics()).
+    struct CoreCache {
+        Magazine magazines[SizeClassCount];
+
+        u64 bytes_freed;
+        u64 refills;
+        u64 drains;
+    };
+
+    // How many regions move between a magazine and its size class at once. Smaller classes move more of them, so that
+    // a batch is always around a page, and a magazine holds at most two batches.
+    static constexpr size_t MagazineBatchBytes = 4096;
+    static constexpr u32 MaxMagazineBatch = 16;
+
+    static u32 batch_size_for(u8 size_class)
+    {
+        auto batch_size = MagazineBatchBytes / size_of_size_class(size_class);
+        if (batch_size < 2) {
+            return 2;
+        }
+
+        return batch_size < MaxMagazineBatch ? batch_size : MaxMagazineBatch;
+    }
+
     MemoryManagement()
     {
     }
 
-    void* align(void* pointer)
+    static uintptr_t align(uintptr_t address, size_t alignment)
     {
-        auto address = (uintptr_t)pointer;
-        auto alignment = 8;
+        return (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+
+    static size_t align_size(size_t size)
+    {
+        return align(size, DefaultAlignment);
+    }
+
+    static u8 size_class_for(size_t size)
+    {
+        if (size <= 16) {
+            return 0;
+        }
+
+        if (size <= 32) {
+            return 1;
+        }
+
+        // `size` is somewhere in (2^bit, 2^(bit + 1)], the bit below `bit` tells us which half of that range it is in.
+        auto bit = 63 - __builtin_clzl(size - 1);
+        auto upper_half = ((size - 1) >> (bit - 1)) & 1;
+
+        return 2 + (bit - 5) * 2 + upper_half;
+    }
+
+    static size_t size_of_size_class(u8 size_class)
+    {
+        if (size_class < 2) {
+            return 16 << size_class;
+        }
+
+        auto bit = 5 + (size_class - 2) / 2;
+        auto upper_half = (size_class - 2) % 2;
+
+        return upper_half ? (size_t)1 << (bit + 1) : (size_t)3 << (bit - 1);
+    }
 
-        return (void*)((address + alignment - 1) & ~(alignment - 1));
+    Region* allocate_region(size_t size);
+    Region* allocate_aligned_region(size_t aligned_size, size_t alignment);
+    Region* allocate_from_size_class(size_t size);
+    void free_to_size_class(Region* region, u8 size_class_index);
+    void release_size_class_caches();
+
+    // These don't need the lock, unless they have to refill or drain the magazine.
+    Region* allocate_from_magazine(u8 size_class_index);
+    void free_to_magazine(Region* region, u8 size_class_index);
+
+    bool refill_magazine(Magazine& magazine, u8 size_class_index);
+    void drain_magazine(Magazine& magazine, u8 size_class_index);
+
+    // Hands everything in this core's magazines back to their size classes, the lock must be held.
+    void flush_magazines();
+
+    Region* allocate_new_region(size_t size);
+    Region* find_next_free_region(size_t size);
+
+    void write_end_marker(u8* location);
+    void trim_heap(Region* region);
+
+    Region* write_region(u8* location, size_t size);
+    void split_region(Region* region, size_t size);
+    Region* coalesce_region(Region* region);
+
+    Region* physical_next(Region* region);
+    Region* physical_previous(Region* region);
+
+    void insert_free_region(Region* region);
+    void remove_free_region(Region* region);
+
+    bool is_coalescable(Region* region)
+    {
+        return region != nullptr && region->is_free && region->size_class == NoSizeClass;
     }
 
-    Region allocate_new_region(size_t size);
-    Optional<Region> find_next_free_region(size_t size);
+    // Both are nullptr until the first time that the heap grows.
+    Spinlock m_lock;
+
+    u8* m_heap_start { nullptr };
+    Region* m_end_marker { nullptr };
+
+    // Free regions which do not belong to a size class, in no particular order.
+    Region* m_first_free_region { nullptr };
 
-    bool is_region_invalid(Region region);
+    SizeClass m_size_classes[SizeClassCount] {};
+
+    PerCpu<CoreCache> m_core_caches;
+
+    ZeroingPolicy m_zeroing_policy { ZeroingPolicy::ScrubOnFree };
 
-    // Linked-list approach, see Region::next
-    Region* m_first_region { nullptr };
-    Optional<Region> m_last_allocated_region {};
     u64 m_bytes_allocated = 0;
     u64 m_bytes_freed = 0;
     u64 m_bytes_reused = 0;
+    u64 m_regions_coalesced = 0;
 };
 
 }
 
+// The whole family of replaceable allocation functions, see https://en.cppreference.com/w/cpp/memory/new/operator_new
+// There are no exceptions, so the throwing versions panic if the heap runs out.
 void* operator new(size_t size);
+void* operator new[](size_t size);
+void* operator new(size_t size, std::align_val_t alignment);
+void* operator new[](size_t size, std::align_val_t alignment);
+void* operator new(size_t size, const std::nothrow_t&) noexcept;
+void* operator new[](size_t size, const std::nothrow_t&) noexcept;
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept;
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept;
+
 void operator delete(void* pointer) noexcept;
+void operator delete[](void* pointer) noexcept;
+void operator delete(void* pointer, size_t size) noexcept;
+void operator delete[](void* pointer, size_t size) noexcept;
+void operator delete(void* pointer, std::align_val_t alignment) noexcept;
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept;
+void operator delete(void* pointer, size_t size, std::align_val_t alignment) noexcept;
+void operator delete[](void* pointer, size_t size, std::align_val_t alignment) noexcept;
+void operator delete(void* pointer, const std::nothrow_t&) noexcept;
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept;
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept;
+void operator delete[](void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept;
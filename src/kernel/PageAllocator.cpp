@@ -0,0 +1,212 @@
+#include "PageAllocator.h"
+#include "Board.h"
+#include "Kernel.h"
+#include "Log.h"
+#include "Processor.h"
+#include "io/Mailbox.h"
+#include "io/UART.h"
+
+// Defined in the linker script
+extern "C" u8 __bss_end;
+
+namespace Kernel {
+
+static constexpr Logger<PAGE_ALLOCATOR_LOG_LEVEL, "PageAllocator"> logger {};
+
+// If the firmware can't tell us how much memory the ARM has, we assume the default split of a 1 GiB board.
+static const uintptr_t FallbackMemoryEnd = 0x3B400000;
+
+PageAllocator& PageAllocator::instance()
+{
+    static PageAllocator instance;
+    return instance;
+}
+
+PageAllocator::PageAllocator()
+{
+    uintptr_t memory_end = FallbackMemoryEnd;
+
+    u32 arm_memory[2] = { 0, 0 };
+    if (Mailbox::instance().property(Mailbox::Tag::GetARMMemory, arm_memory, 2) && arm_memory[1] != 0) {
+        memory_end = (uintptr_t)arm_memory[0] + arm_memory[1];
+    } else {
+        logger.warning("Failed to get the ARM memory size from the firmware, assuming {#}!", memory_end);
+    }
+
+    // We must never hand out anything that overlaps with the peripherals.
+    auto peripheral_window_start = Board::peripheral_window_start();
+    if (memory_end > peripheral_window_start) {
+        memory_end = peripheral_window_start;
+    }
+
+    memory_end &= ~(PageSize - 1);
+
+    // Page indices are relative to a 2 MiB boundary, so that every block is naturally aligned to its own size.
+    auto kernel_end = (uintptr_t)&__bss_end;
+    m_memory_start = kernel_end & ~(size_of_order(MaxOrder) - 1);
+    m_memory_end = memory_end;
+    m_page_count = (m_memory_end - m_memory_start) / PageSize;
+
+    // The page state lives directly after the kernel, everything after that is up for grabs.
+    m_page_state = (u8*)kernel_end;
+    for (size_t i = 0; i < m_page_count; i++) {
+        m_page_state[i] = 0;
+    }
+
+    auto first_free_page = ((uintptr_t)(m_page_state + m_page_count) + PageSize - 1) & ~(PageSize - 1);
+    if (first_free_page >= m_memory_end) {
+        Processor::panic("PageAllocator: No memory left after the kernel!");
+        return;
+    }
+
+    // Hand all of the memory to the free lists in the largest blocks that are aligned to their own size.
+    auto index = page_index((void*)first_free_page);
+    while (index < m_page_count) {
+        u8 order = MaxOrder;
+        while (order > 0 && ((index & ((1 << order) - 1)) != 0 || index + (1 << order) > m_page_count)) {
+            order--;
+        }
+
+        this->push_free_block(index, order);
+        index += 1 << order;
+    }
+
+    logger.debug("Managing {#} -> {#} ({i} pages)"_log, first_free_page, m_memory_end, (m_memory_end - first_free_page) / PageSize);
+}
+
+void* PageAllocator::allocate(u8 order)
+{
+    if (order > MaxOrder) {
+        return nullptr;
+    }
+
+    Locker locker(m_lock);
+
+    // Find the smallest block that is big enough...
+    auto block_order = order;
+    while (block_order <= MaxOrder && m_free_lists[block_order] == nullptr) {
+        block_order++;
+    }
+
+    if (block_order > MaxOrder) {
+        logger.warning("Out of memory! (order {i})", order);
+
+        return nullptr;
+    }
+
+    auto index = page_index(m_free_lists[block_order]);
+    this->remove_free_block(index, block_order);
+
+    // ...and split it in half until it is the size that we want, the upper halves go back into the free lists.
+    while (block_order > order) {
+        block_order--;
+        this->push_free_block(index + (1 << block_order), block_order);
+    }
+
+    m_page_state[index] = PageState::Allocated | order;
+    m_blocks_allocated++;
+
+    logger.debug("Allocated order {i} block at {#}"_log, order, block_at(index));
+
+    return block_at(index);
+}
+
+void PageAllocator::free(void* pointer)
+{
+    if (pointer == nullptr) {
+        return;
+    }
+
+    Locker locker(m_lock);
+
+    // Anything that isn't the start of an allocated block (including a block that has already been free'd, and merged
+    // into its buddy) would end up in a free list twice.
+    auto index = page_index(pointer);
+    if ((uintptr_t)pointer < m_memory_start || (uintptr_t)pointer % PageSize != 0 || index >= m_page_count || !(m_page_state[index] & PageState::Allocated)) {
+        logger.warning("Ignoring invalid free of {#}", pointer);
+
+        return;
+    }
+
+    auto order = (u8)(m_page_state[index] & PageState::OrderMask);
+    m_page_state[index] = 0;
+    m_blocks_freed++;
+
+    // Merge with our buddy for as long as it is free, and the same size as us.
+    while (order < MaxOrder) {
+        auto buddy_index = index ^ ((size_t)1 << order);
+        if (buddy_index >= m_page_count || m_page_state[buddy_index] != (PageState::Free | order)) {
+            break;
+        }
+
+        this->remove_free_block(buddy_index, order);
+
+        if (buddy_index < index) {
+            index = buddy_index;
+        }
+
+        order++;
+    }
+
+    this->push_free_block(index, order);
+}
+
+void PageAllocator::push_free_block(size_t page_index, u8 order)
+{
+    auto block = block_at(page_index);
+    block->previous = nullptr;
+    block->next = m_free_lists[order];
+
+    if (block->next != nullptr) {
+        block->next->previous = block;
+    }
+
+    m_free_lists[order] = block;
+    m_free_block_count[order]++;
+    m_page_state[page_index] = PageState::Free | order;
+}
+
+void PageAllocator::remove_free_block(size_t page_index, u8 order)
+{
+    auto block = block_at(page_index);
+    if (block->previous != nullptr) {
+        block->previous->next = block->next;
+    } else {
+        m_free_lists[order] = block->next;
+    }
+
+    if (block->next != nullptr) {
+        block->next->previous = block->previous;
+    }
+
+    m_free_block_count[order]--;
+    m_page_state[page_index] = 0;
+}
+
+size_t PageAllocator::free_page_count()
+{
+    Locker locker(m_lock);
+
+    size_t free_pages = 0;
+    for (u8 order = 0; order <= MaxOrder; order++) {
+        free_pages += m_free_block_count[order] << order;
+    }
+
+    return free_pages;
+}
+
+void PageAllocator::print_stats()
+{
+    UART::instance().println("[PageAllocator] Statistics:");
+    UART::instance().println("                - Memory:            {#} -> {#}", m_memory_start, m_memory_end);
+    UART::instance().println("                - Free pages:        {i}", this->free_page_count());
+    UART::instance().println("                - Blocks allocated:  {i}", m_blocks_allocated);
+    UART::instance().println("                - Blocks free'd:     {i}", m_blocks_freed);
+    UART::instance().println("                - Free blocks:");
+
+    for (u8 order = 0; order <= MaxOrder; order++) {
+        UART::instance().println("                    {i} KiB: {i}", size_of_order(order) / 1024, m_free_block_count[order]);
+    }
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../types/integer.h"
+#include "Spinlock.h"
+
+namespace Kernel {
+
+// A buddy-system allocator for physical memory.
+// Memory is handed out in blocks of 2^order pages, from a single page (4 KiB) up to 2 MiB. When a block is free'd,
+// it is merged with its "buddy" (the block it was split from) for as long as the buddy is also free.
+class PageAllocator {
+public:
+    static constexpr size_t PageSize = 4096;
+    static constexpr u8 MaxOrder = 9;
+
+    static PageAllocator& instance();
+
+    // Allocates a block of 2^order pages, or returns nullptr if there is no block of that size left.
+    void* allocate(u8 order);
+
+    // Free's a block that was previously returned by allocate().
+    void free(void* pointer);
+
+    // The smallest order that can hold `size` bytes. This may be larger than MaxOrder!
+    static u8 order_for(size_t size)
+    {
+        u8 order = 0;
+        while ((PageSize << order) < size) {
+            order++;
+        }
+
+        return order;
+    }
+
+    static size_t size_of_order(u8 order) { return PageSize << order; }
+
+    size_t free_page_count();
+
+    void print_stats();
+
+private:
+    PageAllocator();
+
+    // Free blocks store their free list entry inside of themselves.
+    struct FreeBlock {
+        FreeBlock* next;
+        FreeBlock* previous;
+    };
+
+    // Every page has one byte of state. Only the first page of a block has any meaningful state, every other page
+    // (and every page that the kernel itself is in) is 0, so that free() can tell where a block starts.
+    struct PageState {
+        static const u8 Free = 1 << 7;
+        static const u8 Allocated = 1 << 6;
+        static const u8 OrderMask = 0x0F;
+    };
+
+    size_t page_index(void* pointer) { return ((uintptr_t)pointer - m_memory_start) / PageSize; }
+    FreeBlock* block_at(size_t page_index) { return (FreeBlock*)(m_memory_start + page_index * PageSize); }
+
+    void push_free_block(size_t page_index, u8 order);
+    void remove_free_block(size_t page_index, u8 order);
+
+    // Held by allocate() and free(), nothing in here takes any other lock.
+    Spinlock m_lock;
+
+    // The memory that we manage, page indices are relative to `m_memory_start`.
+    uintptr_t m_memory_start { 0 };
+    uintptr_t m_memory_end { 0 };
+    size_t m_page_count { 0 };
+
+    u8* m_page_state { nullptr };
+
+    FreeBlock* m_free_lists[MaxOrder + 1] {};
+    u64 m_free_block_count[MaxOrder + 1] {};
+
+    u64 m_blocks_allocated = 0;
+    u64 m_blocks_freed = 0;
+};
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Processor.h"
+#include "SMP.h"
+
+namespace Kernel {
+
+// A `T` for every core, which is found through TPIDR_EL1 (see SMP::current()), so reaching this core's one never
+// touches anything shared. Each one has a cache line (or more) of its own, so that cores don't slow each other down.
+//
+// A core's `T` is only ever used by that core, so it doesn't need a lock, but an interrupt handler that uses it may
+// still interrupt whoever was using it, so they have to mask IRQs while they do.
+//
+//     static PerCpu<Counter> s_counters;
+//     s_counters.current().value++;
+template <typename T>
+class PerCpu {
+public:
+    static constexpr size_t CacheLineSize = 64;
+
+    constexpr PerCpu()
+    {
+    }
+
+    PerCpu(const PerCpu&) = delete;
+    PerCpu& operator=(const PerCpu&) = delete;
+
+    [[gnu::always_inline]] T& current() { return m_slots[SMP::current().id].value; }
+    [[gnu::always_inline]] T* operator->() { return &this->current(); }
+
+    // Another core's `T`, which is only safe to touch if `T` takes care of that itself (or that core isn't online).
+    T& for_core(u32 core) { return m_slots[core].value; }
+
+private:
+    struct alignas(CacheLineSize) Slot {
+        T value {};
+    };
+
+    Slot m_slots[Processor::MaxCoreCount];
+};
+
+}
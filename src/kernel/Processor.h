@@ -1,7 +1,8 @@
 #pragma once
 
+#include "Board.h"
+#include "Log.h"
 #include "asm/CurrentELRegister.h"
-#include "asm/MainIdRegister.h"
 #include "io/UART.h"
 
 namespace Kernel {
@@ -20,17 +21,45 @@ public:
         ExceptionLevel exception_level;
     };
 
+    // The Pi 3 and Pi 4 both have four Cortex-A cores.
+    static constexpr size_t MaxCoreCount = 4;
+
+    // The core that we're running on, from 0 to MaxCoreCount - 1.
+    static inline u32 core_id()
+    {
+#ifdef PHOSPHENE_HOST
+        return 0;
+#else
+        // https://developer.arm.com/documentation/ddi0601/2023-03/AArch64-Registers/MPIDR-EL1--Multiprocessor-Affinity-Register?lang=en
+        u64 affinity;
+        asm volatile("mrs %x0, mpidr_el1"
+                     : "=r"(affinity));
+
+        return affinity & 0xFF;
+#endif
+    }
+
     static inline void halt()
     {
+#ifdef PHOSPHENE_HOST
+        __builtin_trap();
+#else
         while (true) {
             asm volatile("wfi");
         }
+#endif
     }
 
     static void panic(const char* message = "")
     {
+#ifndef PHOSPHENE_HOST
+        // Whatever was logged on the way here is still sitting in the log, and is probably why we're panicking.
+        Log::instance().drain();
+#endif
+
         UART::instance().println("PANIC: {s}", message);
 
+#ifndef PHOSPHENE_HOST
         struct StackFrame* frame;
         asm volatile("mov x0, sp"
                      : "=r"(frame));
@@ -39,18 +68,21 @@ public:
             UART::instance().println("       {i}: {#}", i, frame->last_register);
             frame = frame->previous_frame;
         }
+#endif
+
+        // The UART's interrupt may never fire again, so whatever is still queued has to go out now.
+        UART::instance().flush();
 
         halt();
     }
 
     static Info get_info()
     {
-        MainIdRegister id_register;
         CurrentELRegister el_register;
 
         return {
-            .name = id_register.part_number_as_string(),
-            .part_number = id_register.part_number(),
+            .name = Board::name(),
+            .part_number = Board::part_number(),
             .exception_level = el_register.exception_level(),
         };
     }
@@ -0,0 +1,157 @@
+#include "InterruptControllerImplementation.h"
+#include "../InterruptController.h"
+#include "../Processor.h"
+#include "../io/Register.h"
+
+// Most of the magic numbers you see here are from:
+// https://datasheets.raspberrypi.com/bcm2836/bcm2836-peripherals.pdf
+// https://datasheets.raspberrypi.com/bcm2835/bcm2835-peripherals.pdf (7.5: Registers)
+
+namespace Kernel::RPi3 {
+
+// The BCM2836's local peripherals are at 0x40000000, just past the rest of them.
+static constexpr u32 LocalBase = 0x1000000;
+static constexpr u32 VideoCoreBase = 0xB200;
+
+struct GPUInterruptRouting : Register<GPUInterruptRouting, LocalBase + 0x0C> {
+    using IRQCore = Bitfield<GPUInterruptRouting, 0, 2>;
+    using FIQCore = Bitfield<GPUInterruptRouting, 2, 2>;
+};
+
+// One of each for every core.
+struct CoreTimerInterruptControl : RegisterArray<CoreTimerInterruptControl, LocalBase + 0x40> {
+    using Timers = Bitfield<CoreTimerInterruptControl, 0, 4>;
+};
+
+struct CoreIRQSource : RegisterArray<CoreIRQSource, LocalBase + 0x60> {
+    using Timers = Bitfield<CoreIRQSource, 0, 4>;
+    using GPU = Bitfield<CoreIRQSource, 8>;
+};
+
+// One bit for every VideoCore interrupt, 32 to a register.
+struct VideoCorePending : RegisterArray<VideoCorePending, VideoCoreBase + 0x04> { };
+struct VideoCoreEnable : RegisterArray<VideoCoreEnable, VideoCoreBase + 0x10> { };
+struct VideoCoreDisable : RegisterArray<VideoCoreDisable, VideoCoreBase + 0x1C> { };
+
+// The "basic" registers, which are the ARM's own interrupts (and shortcuts to some of the VideoCore's).
+struct BasicDisable : Register<BasicDisable, VideoCoreBase + 0x24> {
+    using All = Bitfield<BasicDisable, 0, 8>;
+};
+
+static constexpr u32 VideoCoreIRQCount = 64;
+
+// The bits of CoreTimerInterruptControl and CoreIRQSource, in order: CNTPS, CNTPNS, CNTHP and CNTV.
+static constexpr u32 TimerIRQs[] = { IRQ::SecurePhysicalTimer, IRQ::PhysicalTimer, IRQ::HypervisorTimer, IRQ::VirtualTimer };
+
+static i32 timer_bit(u32 irq)
+{
+    for (u32 bit = 0; bit < 4; bit++) {
+        if (TimerIRQs[bit] == irq) {
+            return bit;
+        }
+    }
+
+    return -1;
+}
+
+static bool is_video_core_irq(u32 irq)
+{
+    return irq >= IRQ::VideoCoreBase && irq < IRQ::VideoCoreBase + VideoCoreIRQCount;
+}
+
+InterruptControllerImplementation& InterruptControllerImplementation::instance()
+{
+    static InterruptControllerImplementation instance;
+    return instance;
+}
+
+void InterruptControllerImplementation::initialize()
+{
+    VideoCoreDisable::write(0, 0xFFFFFFFF);
+    VideoCoreDisable::write(1, 0xFFFFFFFF);
+    BasicDisable::write(BasicDisable::All::Set);
+
+    m_enabled[0] = 0;
+    m_enabled[1] = 0;
+
+    GPUInterruptRouting::write(GPUInterruptRouting::IRQCore::value(0) | GPUInterruptRouting::FIQCore::value(0));
+}
+
+void InterruptControllerImplementation::initialize_core()
+{
+    CoreTimerInterruptControl::modify(Processor::core_id(), CoreTimerInterruptControl::Timers::Clear);
+}
+
+bool InterruptControllerImplementation::has_irq(u32 irq) const
+{
+    return timer_bit(irq) >= 0 || is_video_core_irq(irq);
+}
+
+void InterruptControllerImplementation::enable(u32 irq, u8 priority)
+{
+    m_priorities[irq] = priority;
+
+    if (auto bit = timer_bit(irq); bit >= 0) {
+        auto core = Processor::core_id();
+        CoreTimerInterruptControl::write(core, CoreTimerInterruptControl::read(core) | (1u << bit));
+        return;
+    }
+
+    auto index = irq - IRQ::VideoCoreBase;
+    m_enabled[index / 32] |= 1u << (index % 32);
+    VideoCoreEnable::write(index / 32, 1u << (index % 32));
+}
+
+void InterruptControllerImplementation::disable(u32 irq)
+{
+    if (auto bit = timer_bit(irq); bit >= 0) {
+        auto core = Processor::core_id();
+        CoreTimerInterruptControl::write(core, CoreTimerInterruptControl::read(core) & ~(1u << bit));
+        return;
+    }
+
+    auto index = irq - IRQ::VideoCoreBase;
+    m_enabled[index / 32] &= ~(1u << (index % 32));
+    VideoCoreDisable::write(index / 32, 1u << (index % 32));
+}
+
+u32 InterruptControllerImplementation::acknowledge()
+{
+    auto core = Processor::core_id();
+    auto source = CoreIRQSource::read(core);
+
+    auto best = IRQ::Spurious;
+    auto consider = [&](u32 irq) {
+        if (best == IRQ::Spurious || m_priorities[irq] < m_priorities[best]) {
+            best = irq;
+        }
+    };
+
+    // A timer that we haven't enabled here may still be asserting its line.
+    auto timers = CoreIRQSource::Timers::extract(source);
+    if (timers != 0) {
+        timers &= CoreTimerInterruptControl::Timers::extract(CoreTimerInterruptControl::read(core));
+    }
+    for (u32 bit = 0; bit < 4; bit++) {
+        if (timers & (1u << bit)) {
+            consider(TimerIRQs[bit]);
+        }
+    }
+
+    // The VideoCore's interrupts only ever show up on the core that they're routed to (see initialize()).
+    if (CoreIRQSource::GPU::is_set(source)) {
+        for (u32 bank = 0; bank < 2; bank++) {
+            auto pending = VideoCorePending::read(bank) & m_enabled[bank];
+            while (pending != 0) {
+                auto bit = __builtin_ctz(pending);
+                pending &= pending - 1;
+
+                consider(IRQ::VideoCoreBase + bank * 32 + bit);
+            }
+        }
+    }
+
+    return best;
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../../types/integer.h"
+
+// The RPi3 / BCM2837 has two interrupt controllers: the BCM2836's per-core "local" controller, which takes care of
+// each core's timers, and passes the BCM2835's (the VideoCore's) interrupts on to one of the cores.
+// https://datasheets.raspberrypi.com/bcm2836/bcm2836-peripherals.pdf
+// https://datasheets.raspberrypi.com/bcm2835/bcm2835-peripherals.pdf (7: Interrupts)
+
+namespace Kernel::RPi3 {
+
+class InterruptControllerImplementation {
+public:
+    static InterruptControllerImplementation& instance();
+
+    // Disables every VideoCore interrupt, and sends them all to core 0.
+    void initialize();
+
+    // Disables this core's timer interrupts.
+    void initialize_core();
+
+    bool has_irq(u32 irq) const;
+
+    void enable(u32 irq, u8 priority);
+    void disable(u32 irq);
+
+    // Neither controller has priorities (or an acknowledge register), so this looks at everything that is pending on
+    // this core, and returns the most urgent one, or IRQ::Spurious if there isn't one.
+    u32 acknowledge();
+
+    // Every source here is level-triggered, it stops once its handler has dealt with the device.
+    void end_of_interrupt(u32) { }
+
+private:
+    // The VideoCore's interrupts that we've enabled, so that acknowledge() only has to read the pending registers.
+    u32 m_enabled[2] {};
+
+    // Indexed by IRQ, see InterruptController::MaxIRQCount.
+    u8 m_priorities[256] {};
+};
+
+}
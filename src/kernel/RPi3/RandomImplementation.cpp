@@ -1,5 +1,5 @@
 #include "RandomImplementation.h"
-#include "../io/MMIO.h"
+#include "../io/Register.h"
 #include "../io/UART.h"
 
 // Most of the magic numbers you see here are from:
@@ -7,17 +7,25 @@
 
 namespace Kernel::RPi3 {
 
-struct Register {
-    static const u32 Base = 0x00104000;
+static constexpr u32 Base = 0x00104000;
 
-    static const u32 Control = Base + 0x00;
-    static const u32 Status = Base + 0x04;
-    static const u32 Data = Base + 0x08;
-    static const u32 IntegerMask = Base + 0x10;
+struct Control : Register<Control, Base + 0x00> {
+    using Enable = Bitfield<Control, 0>;
 };
 
-struct Control {
-    static const u32 Enable = 1;
+struct Status : Register<Status, Base + 0x04> {
+    // How many of the first numbers are thrown away, as they aren't very random.
+    using WarmupCount = Bitfield<Status, 0, 20>;
+
+    // How many words are waiting in the FIFO.
+    using Available = Bitfield<Status, 24, 8>;
+};
+
+struct Data : Register<Data, Base + 0x08> {
+};
+
+struct InterruptMask : Register<InterruptMask, Base + 0x10> {
+    using Masked = Bitfield<InterruptMask, 0>;
 };
 
 RandomImplementation& RandomImplementation::instance()
@@ -28,33 +36,32 @@ RandomImplementation& RandomImplementation::instance()
 
 void RandomImplementation::initialize()
 {
-    auto control_register = MMIO::instance().read(Register::Control);
-    if (control_register & Control::Enable) {
+    if (Control::Enable::is_set()) {
         UART::instance().println("[RPi3::Random] Already enabled!");
         return;
     }
 
-    // Unsure why exactly this is needed...
-    MMIO::instance().write(Register::Status, 0x40000);
+    Status::write(Status::WarmupCount::value(0x40000));
 
     // Mask the interrupt bit
-    auto mask = MMIO::instance().read(Register::IntegerMask);
-    mask |= 1;
-    MMIO::instance().write(Register::IntegerMask, mask);
+    InterruptMask::modify(InterruptMask::Masked::Set);
 
     // Enable the random number generator
-    control_register |= Control::Enable;
-    MMIO::instance().write(Register::Control, control_register);
+    Control::modify(Control::Enable::Set);
 }
 
-u32 RandomImplementation::get()
+size_t RandomImplementation::read(u32* buffer, size_t count)
 {
-    return MMIO::instance().read(Register::Data);
-}
+    auto available = Status::Available::read();
+    if (count > available) {
+        count = available;
+    }
 
-void RandomImplementation::wait_until_ready_for_reading()
-{
-    // TODO
+    for (size_t i = 0; i < count; i++) {
+        buffer[i] = Data::read();
+    }
+
+    return count;
 }
 
 }
@@ -1,20 +1,19 @@
 #pragma once
 
 #include "../../types/integer.h"
-#include "../Random.h"
 
 // https://elinux.org/BCM2835_registers#RNG
 namespace Kernel::RPi3 {
 
-class RandomImplementation : public Random {
+class RandomImplementation {
 public:
     static RandomImplementation& instance();
 
-    virtual void initialize() override;
-    virtual u32 get() override;
+    void initialize();
 
-private:
-    void wait_until_ready_for_reading();
+    // Reads up to `count` words that are already waiting in the FIFO, and returns how many were read. This never
+    // waits, so it returns 0 while the generator is still catching up.
+    size_t read(u32* buffer, size_t count);
 };
 
 }
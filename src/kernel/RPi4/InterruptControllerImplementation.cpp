@@ -0,0 +1,143 @@
+#include "InterruptControllerImplementation.h"
+#include "../InterruptController.h"
+#include "../io/Register.h"
+
+// Most of the magic numbers you see here are from:
+// https://developer.arm.com/documentation/ihi0048/b (4: Programmers' Model)
+// https://datasheets.raspberrypi.com/bcm2711/bcm2711-peripherals.pdf (6.3: GIC-400)
+
+namespace Kernel::RPi4 {
+
+// The distributor and CPU interface are at 0xFF841000 and 0xFF842000 (in the "low peripheral" address map).
+static constexpr u32 DistributorBase = 0x1841000;
+static constexpr u32 CPUInterfaceBase = 0x1842000;
+
+// The firmware's armstub puts every interrupt into Group 1 and drops us to non-secure, so "enabled" here means
+// Group 1 from our point of view.
+struct DistributorControl : Register<DistributorControl, DistributorBase + 0x000> {
+    using Enable = Bitfield<DistributorControl, 0>;
+};
+
+struct DistributorType : Register<DistributorType, DistributorBase + 0x004> {
+    // There are 32 * (LineCount + 1) interrupt lines.
+    using LineCount = Bitfield<DistributorType, 0, 5>;
+};
+
+// One bit for every IRQ, 32 to a register. The first register of each of these is banked per core.
+struct SetEnable : RegisterArray<SetEnable, DistributorBase + 0x100> { };
+struct ClearEnable : RegisterArray<ClearEnable, DistributorBase + 0x180> { };
+struct ClearPending : RegisterArray<ClearPending, DistributorBase + 0x280> { };
+struct ClearActive : RegisterArray<ClearActive, DistributorBase + 0x380> { };
+
+// One byte for every IRQ, 4 to a register. The first 8 registers of each of these are banked per core.
+struct PriorityLevel : RegisterArray<PriorityLevel, DistributorBase + 0x400> { };
+struct ProcessorTargets : RegisterArray<ProcessorTargets, DistributorBase + 0x800> { };
+
+// Two bits for every IRQ, 16 to a register: 0b10 makes it edge-triggered, 0b00 level-sensitive.
+struct Configuration : RegisterArray<Configuration, DistributorBase + 0xC00> { };
+
+struct CPUInterfaceControl : Register<CPUInterfaceControl, CPUInterfaceBase + 0x00> {
+    using Enable = Bitfield<CPUInterfaceControl, 0>;
+};
+
+// Only IRQs that are more urgent than this are signalled to the core.
+struct PriorityMask : Register<PriorityMask, CPUInterfaceBase + 0x04> {
+    using Priority = Bitfield<PriorityMask, 0, 8>;
+};
+
+// Every bit of the priority is used for preemption (which we don't do), instead of some being used for sub-priorities.
+struct BinaryPoint : Register<BinaryPoint, CPUInterfaceBase + 0x08> {
+};
+
+struct InterruptAcknowledge : Register<InterruptAcknowledge, CPUInterfaceBase + 0x0C> {
+    using InterruptID = Bitfield<InterruptAcknowledge, 0, 10>;
+};
+
+struct EndOfInterrupt : Register<EndOfInterrupt, CPUInterfaceBase + 0x10> {
+    using InterruptID = Bitfield<EndOfInterrupt, 0, 10>;
+};
+
+// Our priorities are bytes, and every one of them is allowed through.
+static constexpr u32 LowestPriority = 0xFF;
+
+InterruptControllerImplementation& InterruptControllerImplementation::instance()
+{
+    static InterruptControllerImplementation instance;
+    return instance;
+}
+
+// 4.3: Distributor register descriptions, and Linux's gic_dist_init().
+void InterruptControllerImplementation::initialize()
+{
+    DistributorControl::write(DistributorControl::Enable::Clear);
+
+    m_line_count = 32 * (DistributorType::LineCount::read() + 1);
+    if (m_line_count > InterruptController::MaxIRQCount) {
+        m_line_count = InterruptController::MaxIRQCount;
+    }
+
+    // Everything that is shared starts off disabled, idle, level-sensitive, and aimed at core 0 (which is where the
+    // Pi 3 sends the VideoCore's interrupts too).
+    for (u32 irq = IRQ::FirstShared; irq < m_line_count; irq += 32) {
+        ClearEnable::write(irq / 32, 0xFFFFFFFF);
+        ClearPending::write(irq / 32, 0xFFFFFFFF);
+        ClearActive::write(irq / 32, 0xFFFFFFFF);
+    }
+
+    for (u32 irq = IRQ::FirstShared; irq < m_line_count; irq += 4) {
+        PriorityLevel::write(irq / 4, 0x01010101u * InterruptController::DefaultPriority);
+        ProcessorTargets::write(irq / 4, 0x01010101);
+    }
+
+    for (u32 irq = IRQ::FirstShared; irq < m_line_count; irq += 16) {
+        Configuration::write(irq / 16, 0);
+    }
+
+    DistributorControl::write(DistributorControl::Enable::Set);
+}
+
+// 4.4: CPU interface register descriptions, and Linux's gic_cpu_init().
+void InterruptControllerImplementation::initialize_core()
+{
+    ClearEnable::write(0, 0xFFFFFFFF);
+    ClearPending::write(0, 0xFFFFFFFF);
+    ClearActive::write(0, 0xFFFFFFFF);
+
+    for (u32 irq = 0; irq < IRQ::FirstShared; irq += 4) {
+        PriorityLevel::write(irq / 4, 0x01010101u * InterruptController::DefaultPriority);
+    }
+
+    PriorityMask::write(PriorityMask::Priority::value(LowestPriority));
+    BinaryPoint::write(0);
+    CPUInterfaceControl::write(CPUInterfaceControl::Enable::Set);
+}
+
+void InterruptControllerImplementation::enable(u32 irq, u8 priority)
+{
+    // The priority registers can be written a byte at a time, but Register only does words, so the caller's lock
+    // keeps the rest of the word safe.
+    auto shift = (irq % 4) * 8;
+    PriorityLevel::write(irq / 4, (PriorityLevel::read(irq / 4) & ~(0xFFu << shift)) | ((u32)priority << shift));
+
+    SetEnable::write(irq / 32, 1u << (irq % 32));
+}
+
+void InterruptControllerImplementation::disable(u32 irq)
+{
+    ClearEnable::write(irq / 32, 1u << (irq % 32));
+}
+
+u32 InterruptControllerImplementation::acknowledge()
+{
+    // 1022 and 1023 are both spurious, and neither of them has to be ended.
+    auto irq = InterruptAcknowledge::InterruptID::read();
+    return irq >= 1020 ? IRQ::Spurious : irq;
+}
+
+// NOTE: An SGI would need the core that sent it in here too, but we don't send any.
+void InterruptControllerImplementation::end_of_interrupt(u32 irq)
+{
+    EndOfInterrupt::write(EndOfInterrupt::InterruptID::value(irq));
+}
+
+}
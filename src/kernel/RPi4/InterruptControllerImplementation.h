@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../../types/integer.h"
+
+// The GIC-400 of the RPi4 / BCM2711, which is a GICv2.
+// https://developer.arm.com/documentation/ddi0471/b (GIC-400)
+// https://developer.arm.com/documentation/ihi0048/b (GICv2)
+
+namespace Kernel::RPi4 {
+
+class InterruptControllerImplementation {
+public:
+    static InterruptControllerImplementation& instance();
+
+    // Sets up the distributor, which is shared by every core.
+    void initialize();
+
+    // Sets up this core's CPU interface, and its banked (private) part of the distributor.
+    void initialize_core();
+
+    bool has_irq(u32 irq) const { return irq >= 16 && irq < m_line_count; }
+
+    void enable(u32 irq, u8 priority);
+    void disable(u32 irq);
+
+    // Returns the most urgent IRQ that is pending on this core (which is then active until end_of_interrupt()), or
+    // IRQ::Spurious if there isn't one.
+    u32 acknowledge();
+    void end_of_interrupt(u32 irq);
+
+private:
+    u32 m_line_count { 0 };
+};
+
+}
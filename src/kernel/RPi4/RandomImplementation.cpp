@@ -1,5 +1,5 @@
 #include "RandomImplementation.h"
-#include "../io/MMIO.h"
+#include "../io/Register.h"
 #include "../io/UART.h"
 
 // Most of the magic numbers you see here are from:
@@ -7,20 +7,18 @@
 
 namespace Kernel::RPi4 {
 
-struct Register {
-    static const u32 Base = 0x00104000;
-    static const u32 Control = Base + 0x0;
-    static const u32 Data = Base + 0x20;
-    static const u32 FIFOCount = Base + 0x24;
+static constexpr u32 Base = 0x00104000;
+
+struct Control : Register<Control, Base + 0x00> {
+    using EnableRNG = Bitfield<Control, 0, 13>;
+    using Divisor = Bitfield<Control, 13, 8>;
 };
 
-struct Control {
-    static const u32 Enable = 1;
+struct Data : Register<Data, Base + 0x20> {
 };
 
-struct Mask {
-    static const u32 EnableRNG = 0x00001FFF;
-    static const u32 FIFOCount = 0x000000FF;
+struct FIFOCount : Register<FIFOCount, Base + 0x24> {
+    using Count = Bitfield<FIFOCount, 0, 8>;
 };
 
 RandomImplementation& RandomImplementation::instance()
@@ -32,28 +30,27 @@ RandomImplementation& RandomImplementation::instance()
 // https://github.com/raspberrypi/linux/blob/rpi-6.1.y/drivers/char/hw_random/iproc-rng200.c#L206
 void RandomImplementation::initialize()
 {
-    auto control_register = MMIO::instance().read(Register::Control);
-    if (control_register & Mask::EnableRNG) {
+    if (Control::EnableRNG::is_set()) {
         UART::instance().println("[RPi4::Random] Already enabled!");
         return;
     }
 
-    auto control = (0x3 << 13) | Mask::EnableRNG;
-    MMIO::instance().write(Register::Control, control);
-}
-
-// https://github.com/raspberrypi/linux/blob/rpi-6.1.y/drivers/char/hw_random/iproc-rng200.c#L199
-u32 RandomImplementation::get()
-{
-    this->wait_until_ready_for_reading();
-    return MMIO::instance().read(Register::Data);
+    Control::write(Control::Divisor::value(0x3) | Control::EnableRNG::Set);
 }
 
 // https://github.com/raspberrypi/linux/blob/rpi-6.1.y/drivers/char/hw_random/iproc-rng200.c#L185
-void RandomImplementation::wait_until_ready_for_reading()
+size_t RandomImplementation::read(u32* buffer, size_t count)
 {
-    while ((MMIO::instance().read(Register::FIFOCount) & Mask::FIFOCount) == 0) {
+    auto available = FIFOCount::Count::read();
+    if (count > available) {
+        count = available;
     }
+
+    for (size_t i = 0; i < count; i++) {
+        buffer[i] = Data::read();
+    }
+
+    return count;
 }
 
 }
@@ -1,7 +1,6 @@
 #pragma once
 
 #include "../../types/integer.h"
-#include "../Random.h"
 
 // The undocumented hardware randomness of the RPi4 / BCM2711 (and RPi3 / BCM2837)...
 // https://github.com/raspberrypi/linux/blob/rpi-6.1.y/arch/arm/boot/dts/bcm2711.dtsi#L125C1-L128
@@ -10,15 +9,15 @@
 
 namespace Kernel::RPi4 {
 
-class RandomImplementation : public Random {
+class RandomImplementation {
 public:
     static RandomImplementation& instance();
 
-    virtual void initialize() override;
-    virtual u32 get() override;
+    void initialize();
 
-private:
-    void wait_until_ready_for_reading();
+    // Reads up to `count` words that are already waiting in the FIFO, and returns how many were read. This never
+    // waits, so it returns 0 while the generator is still catching up.
+    size_t read(u32* buffer, size_t count);
 };
 
 }
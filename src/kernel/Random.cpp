@@ -1,40 +1,118 @@
 #include "Random.h"
-#include "MemoryManagement.h"
+#include "Board.h"
+#include "Processor.h"
 #include "RPi3/RandomImplementation.h"
 #include "RPi4/RandomImplementation.h"
-#include "asm/MainIdRegister.h"
-#include "io/UART.h"
+#include "Time.h"
 
 namespace Kernel {
 
-RPi3::RandomImplementation* rpi3_implementation;
-RPi4::RandomImplementation* rpi4_implementation;
+// The hardware comes up with a new word every few microseconds, so if it hasn't for this long, it never will.
+static constexpr u64 HardwareTimeout = Time::Second;
 
-Random* Random::instance()
+Random& Random::instance()
 {
-    MainIdRegister id_register;
-    switch (id_register.part_number()) {
-    case PartNumber::Pi4: {
-        if (rpi4_implementation == nullptr) {
-            rpi4_implementation = new RPi4::RandomImplementation();
-            rpi4_implementation->initialize();
-        }
+    static Random instance;
+    return instance;
+}
+
+Random::Random()
+{
+    Board::visit([](auto board) { decltype(board)::RandomImplementation::instance().initialize(); });
+
+    // Nobody should have to wait on the hardware until they've used up a whole pool.
+    while (m_pool_count < PoolSize) {
+        m_pool_count += this->read_from_hardware(m_pool + m_pool_count, PoolSize - m_pool_count);
+    }
+}
 
-        return rpi4_implementation;
+u32 Random::get()
+{
+    Locker locker(m_lock);
+
+    u32 value;
+    if (this->take_from_pool(&value, 1) == 0) {
+        this->read_from_hardware(&value, 1);
     }
 
-    default:
-        if (id_register.part_number() != PartNumber::Pi3) {
-            UART::instance().println("[Random] Using the default Pi3 random number generator... this may not work!");
+    return value;
+}
+
+void Random::fill(void* buffer, size_t size)
+{
+    auto bytes = (u8*)buffer;
+    u32 words[BurstSize];
+
+    Locker locker(m_lock);
+
+    while (size > 0) {
+        auto count = this->take_from_pool(words, BurstSize);
+        if (count == 0) {
+            count = this->read_from_hardware(words, BurstSize);
         }
 
-        if (rpi3_implementation == nullptr) {
-            rpi3_implementation = new RPi3::RandomImplementation();
-            rpi3_implementation->initialize();
+        auto count_in_bytes = count * sizeof(u32) < size ? count * sizeof(u32) : size;
+        auto word_bytes = (const u8*)words;
+        for (size_t i = 0; i < count_in_bytes; i++) {
+            bytes[i] = word_bytes[i];
         }
 
-        return rpi3_implementation;
+        bytes += count_in_bytes;
+        size -= count_in_bytes;
+    }
+
+    // Whatever was left over shouldn't stay behind on the stack.
+    for (auto& word : words) {
+        *(volatile u32*)&word = 0;
     }
 }
 
-}
\ No newline at end of file
+void Random::refill()
+{
+    if (!m_lock.try_lock()) {
+        return;
+    }
+
+    if (m_pool_count < PoolSize) {
+        m_pool_count += Board::visit([this](auto board) {
+            return decltype(board)::RandomImplementation::instance().read(m_pool + m_pool_count, PoolSize - m_pool_count);
+        });
+    }
+
+    m_lock.unlock();
+}
+
+size_t Random::take_from_pool(u32* buffer, size_t count)
+{
+    if (count > m_pool_count) {
+        count = m_pool_count;
+    }
+
+    // A word that has been handed out is wiped, so that it can't be handed out (or found) again.
+    for (size_t i = 0; i < count; i++) {
+        auto& word = m_pool[--m_pool_count];
+        buffer[i] = word;
+        word = 0;
+    }
+
+    return count;
+}
+
+size_t Random::read_from_hardware(u32* buffer, size_t count)
+{
+    Timeout timeout(HardwareTimeout);
+
+    while (true) {
+        auto read = Board::visit([&](auto board) { return decltype(board)::RandomImplementation::instance().read(buffer, count); });
+        if (read != 0) {
+            return read;
+        }
+
+        // There's no sensible way to carry on without any randomness.
+        if (timeout.has_expired()) {
+            Processor::panic("The hardware random number generator has stopped!");
+        }
+    }
+}
+
+}
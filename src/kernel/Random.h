@@ -1,16 +1,57 @@
 #pragma once
 
 #include "../types/integer.h"
+#include "Spinlock.h"
 
 namespace Kernel {
 
-// The RPi3 and RPi4 have slightly different (and undocumented) hardware random number generators
+// The RPi3 and RPi4 have slightly different (and undocumented) hardware random number generators, this hands
+// everything to the right one for the board (see Board::visit()).
+//
+// The hardware only produces a few words every so often, so we keep a pool of them around, which is filled up at
+// boot and topped up by refill() whenever there's time to spare. Anyone who needs some randomness takes it from the
+// pool first, and only has to wait on the hardware once the pool is empty.
+// The pool (and the hardware) is shared by every core, behind a lock.
+// NOTE: None of this is safe to use from an interrupt handler.
 class Random {
 public:
-    static Random* instance();
+    // In words.
+    static constexpr size_t PoolSize = 256;
 
-    virtual void initialize() = 0;
-    virtual u32 get() = 0;
+    // The most words that we read from the hardware in one go.
+    static constexpr size_t BurstSize = 16;
+
+    static Random& instance();
+
+    Random(const Random&) = delete;
+    Random& operator=(const Random&) = delete;
+
+    u32 get();
+
+    // Fills `buffer` with `size` random bytes: from the pool while it lasts, and then from the hardware, a whole
+    // FIFO at a time.
+    void fill(void* buffer, size_t size);
+
+    // Moves whatever the hardware has ready into the pool, without waiting for any more (or for the lock, if another
+    // core is already using the pool).
+    void refill();
+
+    size_t words_in_pool() const { return m_pool_count; }
+
+private:
+    Random();
+
+    // Takes up to `count` words from the pool, and returns how many were taken.
+    size_t take_from_pool(u32* buffer, size_t count);
+
+    // Reads up to `count` words from the hardware, waiting until there is at least one.
+    size_t read_from_hardware(u32* buffer, size_t count);
+
+    Spinlock m_lock;
+
+    // This is used as a stack, the newest words are taken first.
+    u32 m_pool[PoolSize] {};
+    size_t m_pool_count { 0 };
 };
 
 }
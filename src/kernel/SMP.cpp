@@ -0,0 +1,191 @@
+#include "SMP.h"
+#include "Kernel.h"
+#include "Log.h"
+#include "MMU.h"
+#include "Random.h"
+#include "Time.h"
+#include "asm/CycleCounter.h"
+
+// Defined in boot.S
+extern "C" u8 secondary_start;
+
+// Read by secondary_start (see boot.S) before the core's MMU is on.
+extern "C" {
+uintptr_t secondary_stack_tops[Kernel::Processor::MaxCoreCount];
+}
+
+namespace Kernel {
+
+static constexpr Logger<SMP_LOG_LEVEL, "SMP"> logger {};
+
+// How long start_secondary_cores() waits for the other cores to show up.
+static constexpr u64 StartTimeout = 100 * Time::Millisecond;
+
+// The boot core keeps the stack that boot.S gave it.
+alignas(16) static u8 s_stacks[Processor::MaxCoreCount - 1][SMP::StackSize];
+
+struct CoreState {
+    CoreData data;
+
+    // Set by run_on_core() while it hands over work, and by the core itself until that work is done.
+    bool is_busy;
+};
+
+static CoreState s_cores[Processor::MaxCoreCount];
+
+static void set_current(CoreData& data)
+{
+    asm volatile("msr tpidr_el1, %x0" ::"r"(&data));
+}
+
+// This and initialize_secondary_core() run before the MMU is on, which is why this file is built with -mstrict-align
+// (see CMakeLists.txt).
+void SMP::initialize()
+{
+    auto& core = s_cores[Processor::core_id()];
+    core.data.id = Processor::core_id();
+    core.data.is_online = true;
+
+    set_current(core.data);
+}
+
+void SMP::initialize_secondary_core(u32 core)
+{
+    set_current(s_cores[core].data);
+
+    // Every core has its own cycle counter.
+    CycleCounter::enable();
+}
+
+size_t SMP::start_secondary_cores()
+{
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        if (s_cores[core].data.is_online) {
+            continue;
+        }
+
+        auto stack = s_stacks[core - 1];
+        secondary_stack_tops[core] = (uintptr_t)stack + StackSize;
+        s_cores[core].data.id = core;
+
+        // The core uses its stack before its caches are on, so nothing stale may be left in ours.
+        MMU::invalidate_data_cache(stack, StackSize);
+    }
+
+    MMU::clean_data_cache(secondary_stack_tops, sizeof(secondary_stack_tops));
+
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        if (s_cores[core].data.is_online) {
+            continue;
+        }
+
+        auto entry = (volatile u64*)(SpinTableStart + core * sizeof(u64));
+        *entry = (u64)&secondary_start;
+        MMU::clean_data_cache(entry, sizeof(u64));
+    }
+
+    // The cores are waiting with `wfe`.
+    asm volatile("sev");
+
+    Timeout timeout(StartTimeout);
+    while (online_core_count() < Processor::MaxCoreCount && !timeout.has_expired()) {
+    }
+
+    auto count = online_core_count();
+    if (count < Processor::MaxCoreCount) {
+        logger.warning("Only {i} out of {i} cores came online!", count, Processor::MaxCoreCount);
+    } else {
+        logger.info("All {i} cores are online", count);
+    }
+
+    return count;
+}
+
+void SMP::run_secondary_core(u32 core)
+{
+    auto& state = s_cores[core];
+
+    __atomic_store_n(&state.data.is_online, true, __ATOMIC_RELEASE);
+    logger.debug("Core {i} is online"_log, core);
+
+    while (true) {
+        auto function = __atomic_load_n(&state.data.function, __ATOMIC_ACQUIRE);
+        if (function == nullptr) {
+            // run_on_core() sends an event once there is something to do.
+            idle();
+            continue;
+        }
+
+        function(state.data.argument);
+
+        state.data.function = nullptr;
+        __atomic_store_n(&state.is_busy, false, __ATOMIC_RELEASE);
+
+        // Whoever is waiting for us is probably doing so with `wfe`.
+        asm volatile("dsb ish\n"
+                     "sev");
+    }
+}
+
+bool SMP::run_on_core(u32 core, CoreData::Function function, void* argument)
+{
+    if (core >= Processor::MaxCoreCount || !__atomic_load_n(&s_cores[core].data.is_online, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    // This core isn't waiting for work, so we might as well do it ourselves.
+    if (core == current().id) {
+        function(argument);
+        return true;
+    }
+
+    auto& state = s_cores[core];
+
+    auto is_busy = false;
+    if (!__atomic_compare_exchange_n(&state.is_busy, &is_busy, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+    state.data.argument = argument;
+    __atomic_store_n(&state.data.function, function, __ATOMIC_RELEASE);
+
+    asm volatile("dsb ish\n"
+                 "sev");
+
+    return true;
+}
+
+void SMP::wait_for_core(u32 core)
+{
+    if (core >= Processor::MaxCoreCount) {
+        return;
+    }
+
+    while (__atomic_load_n(&s_cores[core].is_busy, __ATOMIC_ACQUIRE)) {
+        asm volatile("wfe");
+    }
+}
+
+void SMP::idle()
+{
+    Random::instance().refill();
+    Log::instance().drain_without_waiting();
+
+    // Both `sev` and returning from an IRQ set the event register, so anything that happened since the caller last
+    // looked (and found nothing to do) wakes us straight back up.
+    asm volatile("wfe");
+}
+
+size_t SMP::online_core_count()
+{
+    size_t count = 0;
+    for (auto& core : s_cores) {
+        if (__atomic_load_n(&core.data.is_online, __ATOMIC_ACQUIRE)) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+}
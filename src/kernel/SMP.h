@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../types/integer.h"
+#include "Processor.h"
+
+namespace Kernel {
+
+// Everything that belongs to a single core. TPIDR_EL1 points at the core's own one, see SMP::current().
+struct CoreData {
+    using Function = void (*)(void* argument);
+
+    u32 id;
+    bool is_online;
+
+    // Work that was handed to this core with SMP::run_on_core(). `function` is only set while there is some.
+    Function function;
+    void* argument;
+};
+
+// Symmetric multiprocessing: the boot core starts the others, which then wait for work from run_on_core().
+//
+// The firmware (or boot.S, if the firmware leaves every core to us) parks the other cores in a "spin table": each
+// one waits for an address to show up at 0xD8 + 8 * core, and jumps to it. We put secondary_start (see boot.S)
+// there, which drops the core to EL1, switches to its own stack, and ends up in SMP::run_secondary_core().
+// https://github.com/raspberrypi/tools/blob/master/armstubs/armstub8.S
+//
+// NOTE: Singletons are constructed without a guard (see -fno-threadsafe-statics), so any singleton that more than one
+// core uses has to be constructed before start_secondary_cores() (see init.cpp), and has to have a lock of its own
+// (see Spinlock.h).
+class SMP {
+public:
+    static constexpr size_t StackSize = 16 * 1024;
+
+    // The spin table entry of core 0, every other core's entry follows it.
+    static constexpr uintptr_t SpinTableStart = 0xD8;
+
+    // Points the boot core's TPIDR_EL1 at its CoreData. This doesn't need the MMU, and has to happen before anything
+    // uses current() (or a PerCpu).
+    static void initialize();
+
+    // The same for a secondary core, which also starts its cycle counter (which the log and the interrupt controller's
+    // statistics use). This doesn't need the MMU either, and has to happen first thing.
+    static void initialize_secondary_core(u32 core);
+
+    // Releases the other cores from the spin table, and waits (for a little while) until they're all online.
+    // Returns how many cores are online, including this one.
+    static size_t start_secondary_cores();
+
+    // Runs `function(argument)` on `core`, without waiting for it to finish. Returns false if that core isn't online,
+    // or is still busy with something else.
+    static bool run_on_core(u32 core, CoreData::Function function, void* argument);
+
+    // Waits until `core` has finished whatever was handed to it with run_on_core().
+    static void wait_for_core(u32 core);
+
+    // Does whatever can be done with time to spare (topping up Random's pool, and draining the log), and then sleeps
+    // until something happens: an IRQ (such as this core's next timer, see TimerWheel), or an event.
+    static void idle();
+
+    static size_t online_core_count();
+
+    // The CoreData of the core that we're running on.
+    static CoreData& current()
+    {
+#ifdef PHOSPHENE_HOST
+        static CoreData data {};
+        return data;
+#else
+        CoreData* data;
+        asm volatile("mrs %x0, tpidr_el1"
+                     : "=r"(data));
+
+        return *data;
+#endif
+    }
+
+    // Where a secondary core goes once it's running C++ (with its MMU on), see init.cpp.
+    [[noreturn]] static void run_secondary_core(u32 core);
+};
+
+}
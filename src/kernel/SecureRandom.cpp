@@ -0,0 +1,28 @@
+#include "SecureRandom.h"
+#include "Random.h"
+
+namespace Kernel {
+
+SecureRandom& SecureRandom::instance()
+{
+    static SecureRandom instance;
+    return instance;
+}
+
+SecureRandom::SecureRandom()
+{
+    this->mix_in_fresh_key();
+}
+
+void SecureRandom::mix_in_fresh_key()
+{
+    u8 key[ChaCha20::KeySize];
+    Random::instance().fill(key, sizeof(key));
+    m_generator.seed(key);
+
+    for (auto& byte : key) {
+        *(volatile u8*)&byte = 0;
+    }
+}
+
+}
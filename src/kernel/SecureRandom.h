@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../fluorescent/ChaCha20.h"
+#include "../types/integer.h"
+#include "Spinlock.h"
+
+namespace Kernel {
+
+// Random numbers that are safe to use for anything secret (keys, hash seeds, etc.), as fast as ChaCha20 can make
+// them. The generator is seeded from the hardware (see Random), and reseeded every ReseedInterval bytes.
+// Every core shares the one generator, behind a lock. Anything that needs a lot of numbers that don't have to be
+// secure should use FastRandom instead.
+// NOTE: This isn't safe to use from an interrupt handler.
+class SecureRandom : public UniformRandom<SecureRandom> {
+public:
+    static constexpr u64 ReseedInterval = 1024 * 1024;
+
+    static SecureRandom& instance();
+
+    SecureRandom(const SecureRandom&) = delete;
+    SecureRandom& operator=(const SecureRandom&) = delete;
+
+    void fill(void* buffer, size_t size)
+    {
+        Locker locker(m_lock);
+
+        this->reseed_if_needed();
+        m_generator.fill(buffer, size);
+    }
+
+    u32 next_u32()
+    {
+        Locker locker(m_lock);
+
+        this->reseed_if_needed();
+        return m_generator.next_u32();
+    }
+
+    u64 next_u64()
+    {
+        Locker locker(m_lock);
+
+        this->reseed_if_needed();
+        return m_generator.next_u64();
+    }
+
+    // Mixes a fresh key from the hardware into the generator.
+    void reseed()
+    {
+        Locker locker(m_lock);
+        this->mix_in_fresh_key();
+    }
+
+private:
+    SecureRandom();
+
+    void reseed_if_needed()
+    {
+        if (m_generator.bytes_since_seed() >= ReseedInterval) {
+            this->mix_in_fresh_key();
+        }
+    }
+
+    // reseed(), for when the lock is already held.
+    void mix_in_fresh_key();
+
+    Spinlock m_lock;
+    ChaCha20 m_generator;
+};
+
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "../fluorescent/New.h"
+#include "../types/integer.h"
+#include "Kernel.h"
+#include "Log.h"
+#include "PageAllocator.h"
+#include "Spinlock.h"
+#include "io/UART.h"
+
+namespace Kernel {
+
+static constexpr Logger<SLAB_CACHE_LOG_LEVEL, "SlabCache"> slab_cache_logger {};
+
+// A cache of same-sized objects, carved out of blocks of pages ("slabs") from the PageAllocator.
+// Free objects are linked together through memory inside of the slot itself, so there is no per-object header,
+// and allocating or freeing an object is just a pop or push on the slab's free list.
+//
+// If a constructor is given, objects are constructed once when their slab is created, and stay constructed while
+// they are free (the free list link is then stored *after* the object instead of inside of it). This is useful for
+// objects which are expensive to set up, but can be returned to a known state cheaply before they are free'd.
+//
+// SlabCache has a constexpr constructor, so it can be used as a global without needing global constructors.
+//
+// Every cache has a lock of its own, so it can be shared between cores. Constructors and destructors run while it is
+// held (and while the PageAllocator's is), so they mustn't use the cache themselves.
+// NOTE: This must not be used from an interrupt handler, as it may have interrupted someone holding the lock.
+template<typename T>
+class SlabCache {
+public:
+    using Constructor = void (*)(T*);
+    using Destructor = void (*)(T*);
+
+    constexpr explicit SlabCache(const char* name, Constructor constructor = nullptr, Destructor destructor = nullptr)
+        : m_name(name)
+        , m_constructor(constructor)
+        , m_destructor(destructor)
+        , m_link_offset(constructor ? align_up(sizeof(T), alignof(void*)) : 0)
+        , m_slot_size(align_up(m_link_offset + sizeof(void*) > sizeof(T) ? m_link_offset + sizeof(void*) : sizeof(T), SlotAlignment))
+        , m_slab_order(slab_order_for(m_slot_size))
+        , m_objects_per_slab(((PageAllocator::PageSize << m_slab_order) - FirstSlotOffset) / m_slot_size)
+    {
+    }
+
+    // Allocates and constructs an object. Only valid for caches without a cached constructor.
+    template<typename... Args>
+    T* create(Args&&... args)
+    {
+        auto object = this->allocate();
+        if (object == nullptr) {
+            return nullptr;
+        }
+
+        return new (object) T(static_cast<Args&&>(args)...);
+    }
+
+    // Destructs and free's an object that was returned by create().
+    void destroy(T* object)
+    {
+        if (object == nullptr) {
+            return;
+        }
+
+        object->~T();
+        this->free(object);
+    }
+
+    // Returns an uninitialized slot, or an already-constructed object if this cache has a constructor.
+    T* allocate()
+    {
+        Locker locker(m_lock);
+
+        auto slab = m_partial_slabs;
+        if (slab == nullptr) {
+            slab = this->take_empty_slab();
+            if (slab == nullptr) {
+                return nullptr;
+            }
+        }
+
+        auto slot = slab->free_list;
+        slab->free_list = *link_of(slot);
+        slab->in_use++;
+
+        // If this was the last free object in the slab, it doesn't need to be looked at until something is free'd.
+        if (slab->free_list == nullptr) {
+            remove_slab(m_partial_slabs, slab);
+            push_slab(m_full_slabs, slab);
+        }
+
+        m_allocations++;
+        return (T*)slot;
+    }
+
+    void free(T* object)
+    {
+        if (object == nullptr) {
+            return;
+        }
+
+        Locker locker(m_lock);
+
+        // Slabs are aligned to their own size, so the slab header is always at the start of the block.
+        auto slab = (Slab*)((uintptr_t)object & ~((PageAllocator::PageSize << m_slab_order) - 1));
+        auto was_full = slab->free_list == nullptr;
+
+        *link_of(object) = slab->free_list;
+        slab->free_list = object;
+        slab->in_use--;
+
+        if (was_full) {
+            remove_slab(m_full_slabs, slab);
+            push_slab(m_partial_slabs, slab);
+        }
+
+        if (slab->in_use == 0) {
+            remove_slab(m_partial_slabs, slab);
+            this->release_empty_slab(slab);
+        }
+
+        m_frees++;
+    }
+
+    size_t objects_in_use() const { return m_allocations - m_frees; }
+
+    void print_stats()
+    {
+        UART::instance().println("[SlabCache] {s}:", m_name);
+        UART::instance().println("            - Object size:      {i} bytes ({i} per slab)", m_slot_size, m_objects_per_slab);
+        UART::instance().println("            - Objects in use:   {i}", this->objects_in_use());
+        UART::instance().println("            - Allocations:      {i}", m_allocations);
+        UART::instance().println("            - Frees:            {i}", m_frees);
+        UART::instance().println("            - Slabs created:    {i}", m_slabs_created);
+        UART::instance().println("            - Slabs destroyed:  {i}", m_slabs_destroyed);
+    }
+
+private:
+    struct Slab {
+        Slab* next;
+        Slab* previous;
+
+        void* free_list;
+        size_t in_use;
+    };
+
+    static constexpr size_t align_up(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    static constexpr size_t SlotAlignment = alignof(T) > alignof(void*) ? alignof(T) : alignof(void*);
+    static constexpr size_t FirstSlotOffset = align_up(sizeof(Slab), SlotAlignment);
+
+    // We want at least 8 objects per slab, so that we aren't constantly going back to the PageAllocator.
+    static constexpr u8 slab_order_for(size_t slot_size)
+    {
+        u8 order = 0;
+        while (order < PageAllocator::MaxOrder && (PageAllocator::PageSize << order) < FirstSlotOffset + slot_size * 8) {
+            order++;
+        }
+
+        return order;
+    }
+
+    static_assert(FirstSlotOffset + sizeof(T) + sizeof(void*) <= PageAllocator::PageSize << PageAllocator::MaxOrder, "SlabCache: Objects must fit in a 2 MiB slab!");
+
+    void** link_of(void* slot)
+    {
+        return (void**)((u8*)slot + m_link_offset);
+    }
+
+    static void push_slab(Slab*& list, Slab* slab)
+    {
+        slab->previous = nullptr;
+        slab->next = list;
+
+        if (list != nullptr) {
+            list->previous = slab;
+        }
+
+        list = slab;
+    }
+
+    static void remove_slab(Slab*& list, Slab* slab)
+    {
+        if (slab->previous != nullptr) {
+            slab->previous->next = slab->next;
+        } else {
+            list = slab->next;
+        }
+
+        if (slab->next != nullptr) {
+            slab->next->previous = slab->previous;
+        }
+    }
+
+    // Returns a slab with every object free, which is now in the partial list.
+    Slab* take_empty_slab()
+    {
+        auto slab = m_empty_slab;
+        m_empty_slab = nullptr;
+
+        if (slab == nullptr) {
+            slab = this->create_slab();
+            if (slab == nullptr) {
+                return nullptr;
+            }
+        }
+
+        push_slab(m_partial_slabs, slab);
+        return slab;
+    }
+
+    Slab* create_slab()
+    {
+        auto slab = (Slab*)PageAllocator::instance().allocate(m_slab_order);
+        if (slab == nullptr) {
+            slab_cache_logger.error("{s}: Failed to allocate a slab!", m_name);
+            return nullptr;
+        }
+
+        *slab = Slab {
+            .next = nullptr,
+            .previous = nullptr,
+            .free_list = nullptr,
+            .in_use = 0,
+        };
+
+        // Link the slots together back-to-front, so that the free list hands them out in address order.
+        for (auto i = m_objects_per_slab; i > 0; i--) {
+            auto slot = (u8*)slab + FirstSlotOffset + (i - 1) * m_slot_size;
+            if (m_constructor) {
+                m_constructor((T*)slot);
+            }
+
+            *link_of(slot) = slab->free_list;
+            slab->free_list = slot;
+        }
+
+        m_slabs_created++;
+        return slab;
+    }
+
+    // We hold on to a single empty slab, so that a cache hovering around a slab boundary doesn't thrash the
+    // PageAllocator. Any other empty slab is given back.
+    void release_empty_slab(Slab* slab)
+    {
+        if (m_empty_slab == nullptr) {
+            m_empty_slab = slab;
+            return;
+        }
+
+        if (m_destructor) {
+            for (size_t i = 0; i < m_objects_per_slab; i++) {
+                m_destructor((T*)((u8*)slab + FirstSlotOffset + i * m_slot_size));
+            }
+        }
+
+        PageAllocator::instance().free(slab);
+        m_slabs_destroyed++;
+    }
+
+    const char* m_name;
+
+    // Held by allocate() and free(), which may take the PageAllocator's lock while holding it.
+    Spinlock m_lock;
+
+    Constructor m_constructor { nullptr };
+    Destructor m_destructor { nullptr };
+
+    // If objects are constructed ahead of time, their free list link can't overlap with them.
+    size_t m_link_offset;
+    size_t m_slot_size;
+    u8 m_slab_order;
+    size_t m_objects_per_slab;
+
+    Slab* m_partial_slabs { nullptr };
+    Slab* m_full_slabs { nullptr };
+    Slab* m_empty_slab { nullptr };
+
+    u64 m_allocations { 0 };
+    u64 m_frees { 0 };
+    u64 m_slabs_created { 0 };
+    u64 m_slabs_destroyed { 0 };
+};
+
+}
@@ -0,0 +1,71 @@
+#include "Spinlock.h"
+
+namespace Kernel {
+
+void Spinlock::wait_for_ticket(u16 ticket)
+{
+    auto start = CycleCounter::read();
+
+    auto owner = __atomic_load_n(&m_owner, __ATOMIC_ACQUIRE);
+    while (owner != ticket) {
+        owner = wait_for_change(&m_owner, owner);
+    }
+
+    // The lock is ours now, so nobody else is touching these.
+    m_statistics.contentions++;
+    m_statistics.cycles_waited += CycleCounter::read() - start;
+}
+
+void ReadWriteSpinlock::wait_for_shared()
+{
+    auto start = CycleCounter::read();
+
+    auto state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+    while (true) {
+        if ((state & (Writer | WriterWaiting)) != 0) {
+            state = wait_for_change(&m_state, state);
+            continue;
+        }
+
+        // On failure, `state` is updated to whatever it is now.
+        if (__atomic_compare_exchange_n(&m_state, &state, state + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    __atomic_fetch_add(&m_contentions, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m_cycles_waited, CycleCounter::read() - start, __ATOMIC_RELAXED);
+}
+
+void ReadWriteSpinlock::wait_for_exclusive()
+{
+    auto start = CycleCounter::read();
+
+    auto state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+    while (true) {
+        // Nobody holds it, although someone (maybe us) may be waiting for it.
+        if ((state & ~WriterWaiting) == 0) {
+            if (__atomic_compare_exchange_n(&m_state, &state, Writer, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                break;
+            }
+
+            continue;
+        }
+
+        // Keep any new readers out until we've had our turn.
+        if ((state & WriterWaiting) == 0) {
+            if (__atomic_compare_exchange_n(&m_state, &state, state | WriterWaiting, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                state |= WriterWaiting;
+            }
+
+            continue;
+        }
+
+        state = wait_for_change(&m_state, state);
+    }
+
+    __atomic_fetch_add(&m_contentions, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m_cycles_waited, CycleCounter::read() - start, __ATOMIC_RELAXED);
+}
+
+}
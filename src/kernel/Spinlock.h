@@ -0,0 +1,332 @@
+#pragma once
+
+#include "../types/integer.h"
+#include "Kernel.h"
+#include "asm/CycleCounter.h"
+#include "asm/Interrupts.h"
+
+namespace Kernel {
+
+// How much a lock is being fought over. `contentions` (how many times someone had to wait) and `cycles_waited` are
+// always kept, as they are only touched by whoever had to wait anyway. Everything else costs two cycle counter reads
+// per acquisition, which is more than the lock itself, so it is only kept with LOCK_STATISTICS (see Kernel.h).
+struct LockStatistics {
+    u64 acquisitions;
+    u64 contentions;
+    u64 cycles_waited;
+    u64 cycles_held;
+    u64 longest_hold;
+};
+
+// Sleeps until the value at `address` is (probably) no longer `value`, and returns whatever it is now.
+// Loading it with an exclusive arms this core's monitor, so the next store to it from another core wakes us up.
+[[gnu::always_inline]] inline u16 wait_for_change(volatile u16* address, u16 value)
+{
+    while (true) {
+        u32 current;
+#ifdef PHOSPHENE_HOST
+        current = __atomic_load_n(address, __ATOMIC_ACQUIRE);
+#else
+        asm volatile("ldaxrh %w0, [%1]"
+                     : "=&r"(current)
+                     : "r"(address)
+                     : "memory");
+#endif
+
+        if (current != value) {
+            return current;
+        }
+
+#ifndef PHOSPHENE_HOST
+        asm volatile("wfe" ::
+                         : "memory");
+#endif
+    }
+}
+
+[[gnu::always_inline]] inline u32 wait_for_change(volatile u32* address, u32 value)
+{
+    while (true) {
+        u32 current;
+#ifdef PHOSPHENE_HOST
+        current = __atomic_load_n(address, __ATOMIC_ACQUIRE);
+#else
+        asm volatile("ldaxr %w0, [%1]"
+                     : "=&r"(current)
+                     : "r"(address)
+                     : "memory");
+#endif
+
+        if (current != value) {
+            return current;
+        }
+
+#ifndef PHOSPHENE_HOST
+        asm volatile("wfe" ::
+                         : "memory");
+#endif
+    }
+}
+
+// A ticket lock: everyone who wants the lock takes the next ticket, and waits until the lock's owner gets to theirs,
+// so cores get the lock in the order that they asked for it and none of them can be starved. Taking an uncontended
+// lock is a single exclusive add, and releasing it is a single store-release.
+//
+// Exclusives don't work on Device memory, which is all memory until the MMU is on, so nothing may be locked before
+// MMU::initialize(). Locks aren't recursive. Anything that an interrupt handler also locks has to be locked with
+// lock_saving_interrupts() (or an InterruptSafeLocker) everywhere else, or the handler could end up waiting on the
+// code that it interrupted.
+class Spinlock {
+public:
+    constexpr Spinlock()
+    {
+    }
+
+    Spinlock(const Spinlock&) = delete;
+    Spinlock& operator=(const Spinlock&) = delete;
+
+    [[gnu::always_inline]] void lock()
+    {
+        auto value = __atomic_fetch_add(&m_value, 1 << 16, __ATOMIC_ACQUIRE);
+        auto ticket = (u16)(value >> 16);
+
+        if ((u16)value != ticket) [[unlikely]] {
+            this->wait_for_ticket(ticket);
+        }
+
+        if constexpr (LOCK_STATISTICS) {
+            m_statistics.acquisitions++;
+            m_acquired_at = CycleCounter::read();
+        }
+    }
+
+    [[gnu::always_inline]] bool try_lock()
+    {
+        auto value = __atomic_load_n(&m_value, __ATOMIC_RELAXED);
+        if ((u16)value != (u16)(value >> 16)) {
+            return false;
+        }
+
+        if (!__atomic_compare_exchange_n(&m_value, &value, value + (1 << 16), false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return false;
+        }
+
+        if constexpr (LOCK_STATISTICS) {
+            m_statistics.acquisitions++;
+            m_acquired_at = CycleCounter::read();
+        }
+
+        return true;
+    }
+
+    [[gnu::always_inline]] void unlock()
+    {
+        if constexpr (LOCK_STATISTICS) {
+            auto held = CycleCounter::read() - m_acquired_at;
+            m_statistics.cycles_held += held;
+            if (held > m_statistics.longest_hold) {
+                m_statistics.longest_hold = held;
+            }
+        }
+
+        // Only the owner ever moves the owner forward, everyone else only moves `next`.
+        __atomic_store_n(&m_owner, (u16)(__atomic_load_n(&m_owner, __ATOMIC_RELAXED) + 1), __ATOMIC_RELEASE);
+    }
+
+    [[nodiscard, gnu::always_inline]] InterruptState lock_saving_interrupts()
+    {
+        auto state = Interrupts::disable();
+        this->lock();
+
+        return state;
+    }
+
+    [[gnu::always_inline]] void unlock_restoring_interrupts(InterruptState state)
+    {
+        this->unlock();
+        Interrupts::restore(state);
+    }
+
+    bool is_locked() const
+    {
+        auto value = __atomic_load_n(&m_value, __ATOMIC_RELAXED);
+        return (u16)value != (u16)(value >> 16);
+    }
+
+    // Only consistent while the lock is held.
+    const LockStatistics& statistics() const { return m_statistics; }
+
+private:
+    [[gnu::noinline]] void wait_for_ticket(u16 ticket);
+
+    union {
+        u32 m_value { 0 };
+
+        struct {
+            // The ticket that currently holds the lock.
+            u16 m_owner;
+
+            // The ticket that the next core to come along will get.
+            u16 m_next;
+        };
+    };
+
+    u64 m_acquired_at { 0 };
+    LockStatistics m_statistics {};
+};
+
+// A lock that any number of readers can hold at once, or a single writer. A writer that is waiting keeps any new
+// readers out, so a steady stream of readers can't starve it. lock() and unlock() are for writers, so that a
+// Locker takes it exclusively.
+//
+// Only `contentions` and `cycles_waited` are kept, as readers don't have the lock to themselves.
+class ReadWriteSpinlock {
+public:
+    constexpr ReadWriteSpinlock()
+    {
+    }
+
+    ReadWriteSpinlock(const ReadWriteSpinlock&) = delete;
+    ReadWriteSpinlock& operator=(const ReadWriteSpinlock&) = delete;
+
+    [[gnu::always_inline]] void lock_shared()
+    {
+        auto state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+        if ((state & (Writer | WriterWaiting)) != 0 || !__atomic_compare_exchange_n(&m_state, &state, state + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) [[unlikely]] {
+            this->wait_for_shared();
+        }
+    }
+
+    [[gnu::always_inline]] void unlock_shared()
+    {
+        __atomic_fetch_sub(&m_state, 1, __ATOMIC_RELEASE);
+    }
+
+    [[gnu::always_inline]] void lock()
+    {
+        u32 state = 0;
+        if (!__atomic_compare_exchange_n(&m_state, &state, Writer, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) [[unlikely]] {
+            this->wait_for_exclusive();
+        }
+    }
+
+    [[gnu::always_inline]] void unlock()
+    {
+        // Another writer may have started waiting while we held the lock, which has to stay visible.
+        __atomic_fetch_and(&m_state, ~Writer, __ATOMIC_RELEASE);
+    }
+
+    [[nodiscard, gnu::always_inline]] InterruptState lock_shared_saving_interrupts()
+    {
+        auto state = Interrupts::disable();
+        this->lock_shared();
+
+        return state;
+    }
+
+    [[gnu::always_inline]] void unlock_shared_restoring_interrupts(InterruptState state)
+    {
+        this->unlock_shared();
+        Interrupts::restore(state);
+    }
+
+    [[nodiscard, gnu::always_inline]] InterruptState lock_saving_interrupts()
+    {
+        auto state = Interrupts::disable();
+        this->lock();
+
+        return state;
+    }
+
+    [[gnu::always_inline]] void unlock_restoring_interrupts(InterruptState state)
+    {
+        this->unlock();
+        Interrupts::restore(state);
+    }
+
+    LockStatistics statistics() const
+    {
+        return {
+            .acquisitions = 0,
+            .contentions = __atomic_load_n(&m_contentions, __ATOMIC_RELAXED),
+            .cycles_waited = __atomic_load_n(&m_cycles_waited, __ATOMIC_RELAXED),
+            .cycles_held = 0,
+            .longest_hold = 0,
+        };
+    }
+
+private:
+    static constexpr u32 Writer = 1u << 31;
+    static constexpr u32 WriterWaiting = 1u << 30;
+
+    [[gnu::noinline]] void wait_for_shared();
+    [[gnu::noinline]] void wait_for_exclusive();
+
+    // [Writer] [WriterWaiting] [reader count (30 bits)]
+    u32 m_state { 0 };
+
+    u64 m_contentions { 0 };
+    u64 m_cycles_waited { 0 };
+};
+
+// Holds `lock` for as long as it is in scope.
+//
+//     Locker locker(m_lock);
+template <typename Lock>
+class Locker {
+public:
+    [[gnu::always_inline]] explicit Locker(Lock& lock)
+        : m_lock(lock)
+    {
+        m_lock.lock();
+    }
+
+    [[gnu::always_inline]] ~Locker() { m_lock.unlock(); }
+
+    Locker(const Locker&) = delete;
+    Locker& operator=(const Locker&) = delete;
+
+private:
+    Lock& m_lock;
+};
+
+// Holds a ReadWriteSpinlock as a reader for as long as it is in scope.
+template <typename Lock>
+class SharedLocker {
+public:
+    [[gnu::always_inline]] explicit SharedLocker(Lock& lock)
+        : m_lock(lock)
+    {
+        m_lock.lock_shared();
+    }
+
+    [[gnu::always_inline]] ~SharedLocker() { m_lock.unlock_shared(); }
+
+    SharedLocker(const SharedLocker&) = delete;
+    SharedLocker& operator=(const SharedLocker&) = delete;
+
+private:
+    Lock& m_lock;
+};
+
+// Masks IRQs on this core and holds `lock` for as long as it is in scope, see Spinlock.
+template <typename Lock>
+class InterruptSafeLocker {
+public:
+    [[gnu::always_inline]] explicit InterruptSafeLocker(Lock& lock)
+        : m_lock(lock)
+        , m_state(lock.lock_saving_interrupts())
+    {
+    }
+
+    [[gnu::always_inline]] ~InterruptSafeLocker() { m_lock.unlock_restoring_interrupts(m_state); }
+
+    InterruptSafeLocker(const InterruptSafeLocker&) = delete;
+    InterruptSafeLocker& operator=(const InterruptSafeLocker&) = delete;
+
+private:
+    Lock& m_lock;
+    InterruptState m_state;
+};
+
+}
@@ -0,0 +1,32 @@
+#include "Time.h"
+#include "Board.h"
+
+namespace Kernel {
+
+u64 Time::frequency()
+{
+    auto frequency = GenericTimer::frequency();
+    if (frequency != 0) [[likely]] {
+        return frequency;
+    }
+
+    return Board::visit([](auto board) { return decltype(board)::CounterFrequency; });
+}
+
+// Both of these split the value into whole seconds and the rest, so that nothing overflows (the counter would need
+// to run at more than 18 GHz for the rest to), and neither needs a 128-bit division, which there is no libgcc for.
+u64 Time::nanoseconds_from_ticks(u64 ticks)
+{
+    auto frequency = Time::frequency();
+    return ticks / frequency * Second + ticks % frequency * Second / frequency;
+}
+
+u64 Time::ticks_from_nanoseconds(u64 nanoseconds)
+{
+    auto frequency = Time::frequency();
+    auto remainder = nanoseconds % Second * frequency;
+
+    return nanoseconds / Second * frequency + remainder / Second + (remainder % Second != 0);
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../types/integer.h"
+#include "asm/GenericTimer.h"
+
+namespace Kernel {
+
+// The kernel's monotonic clock, which is the generic timer's counter (see GenericTimer) in nanoseconds. It starts
+// at zero when the board is reset, never goes backwards, and reads the same on every core.
+class Time {
+public:
+    static constexpr u64 Nanosecond = 1;
+    static constexpr u64 Microsecond = 1000 * Nanosecond;
+    static constexpr u64 Millisecond = 1000 * Microsecond;
+    static constexpr u64 Second = 1000 * Millisecond;
+
+    [[gnu::always_inline]] static u64 now() { return nanoseconds_from_ticks(GenericTimer::counter()); }
+
+    // How many times a second the counter ticks.
+    static u64 frequency();
+
+    // Rounded down, so that a tick is never counted as having happened later than it did.
+    static u64 nanoseconds_from_ticks(u64 ticks);
+
+    // Rounded up, so that a deadline that is turned into ticks is never early.
+    static u64 ticks_from_nanoseconds(u64 nanoseconds);
+};
+
+// A point in time that a polling loop gives up at, so that hardware that never answers can't hang the kernel.
+// This only ever reads the counter, so it works with IRQs masked, and doesn't cost a conversion per check.
+//
+//     Timeout timeout(10 * Time::Millisecond);
+//     while (!ready()) {
+//         if (timeout.has_expired()) {
+//             return false;
+//         }
+//     }
+class Timeout {
+public:
+    explicit Timeout(u64 nanoseconds)
+        : m_expires_at(GenericTimer::counter() + Time::ticks_from_nanoseconds(nanoseconds))
+    {
+    }
+
+    [[gnu::always_inline]] bool has_expired() const { return GenericTimer::counter() >= m_expires_at; }
+
+private:
+    // In counter ticks.
+    u64 m_expires_at;
+};
+
+}
@@ -0,0 +1,356 @@
+#include "TimerWheel.h"
+#include "InterruptController.h"
+#include "Log.h"
+#include "SMP.h"
+#include "asm/Interrupts.h"
+#include "io/UART.h"
+
+namespace Kernel {
+
+static constexpr Logger<TIMER_LOG_LEVEL, "TimerWheel"> logger {};
+
+static constexpr u64 SlotMask = TimerWheel::SlotCount - 1;
+
+static constexpr size_t shift_of(size_t level)
+{
+    return level * TimerWheel::SlotBits;
+}
+
+// Rounded up, so that a timer never fires early.
+static u64 tick_of(u64 deadline)
+{
+    if (deadline > TimerWheel::NoTick - TimerWheel::Resolution) {
+        return (TimerWheel::NoTick - 1) / TimerWheel::Resolution;
+    }
+
+    return (deadline + TimerWheel::Resolution - 1) / TimerWheel::Resolution;
+}
+
+static u64 rotate_right(u64 value, u64 count)
+{
+    return count == 0 ? value : (value >> count) | (value << (64 - count));
+}
+
+TimerWheel& TimerWheel::instance()
+{
+    static TimerWheel instance;
+    return instance;
+}
+
+void TimerWheel::initialize()
+{
+    auto handler = [](void* wheel) { ((TimerWheel*)wheel)->handle_interrupt(); };
+    InterruptController::instance().register_handler(IRQ::PhysicalTimer, handler, this, InterruptController::HighPriority);
+
+    this->initialize_core();
+
+    logger.info("Counter running at {i} Hz, {i} ns per slot", Time::frequency(), Resolution);
+}
+
+void TimerWheel::initialize_core()
+{
+    auto& wheel = m_wheels.current();
+
+    {
+        InterruptSafeLocker locker(wheel.lock);
+
+        wheel.current_tick = Time::now() / Resolution;
+        wheel.programmed_tick = NoTick;
+
+        // Whatever the firmware left behind would fire straight away.
+        GenericTimer::stop();
+    }
+
+    InterruptController::instance().enable(IRQ::PhysicalTimer);
+}
+
+void TimerWheel::start_one_shot(Timer& timer, u64 deadline, Timer::Callback callback, void* context)
+{
+    this->start(timer, deadline, 0, callback, context);
+}
+
+void TimerWheel::start_periodic(Timer& timer, u64 period, Timer::Callback callback, void* context)
+{
+    if (period < Resolution) {
+        period = Resolution;
+    }
+
+    this->start(timer, Time::now() + period, period, callback, context);
+}
+
+void TimerWheel::start(Timer& timer, u64 deadline, u64 period, Timer::Callback callback, void* context)
+{
+    if (timer.is_pending) {
+        this->cancel(timer);
+    }
+
+    auto& wheel = m_wheels.current();
+    InterruptSafeLocker locker(wheel.lock);
+
+    timer.callback = callback;
+    timer.context = context;
+    timer.deadline = deadline;
+    timer.period = period;
+    timer.core = SMP::current().id;
+
+    this->insert(wheel, timer);
+    wheel.statistics.timers_started++;
+
+    this->program(wheel);
+}
+
+bool TimerWheel::cancel(Timer& timer)
+{
+    auto& wheel = m_wheels.for_core(timer.core);
+    InterruptSafeLocker locker(wheel.lock);
+
+    if (!timer.is_pending) {
+        return false;
+    }
+
+    // The physical timer is left alone, as it may be another core's. Waking up for nothing is cheaper than finding
+    // out whether it was set for this timer.
+    this->remove(wheel, timer);
+    wheel.statistics.timers_cancelled++;
+
+    return true;
+}
+
+void TimerWheel::insert(CoreWheel& wheel, Timer& timer)
+{
+    auto tick = tick_of(timer.deadline);
+    if (tick < wheel.current_tick) {
+        tick = wheel.current_tick;
+    }
+
+    // The lowest level that the timer's slot is less than a whole turn of the wheel away in.
+    size_t level = 0;
+    while (level < LevelCount - 1 && (tick >> shift_of(level)) - (wheel.current_tick >> shift_of(level)) >= SlotCount) {
+        level++;
+    }
+
+    // Anything past the last level waits in its furthest slot, and is put back once the wheel gets there.
+    auto shift = shift_of(level);
+    if ((tick >> shift) - (wheel.current_tick >> shift) >= SlotCount) {
+        tick = ((wheel.current_tick >> shift) + SlotCount - 1) << shift;
+    }
+
+    auto slot = (tick >> shift) & SlotMask;
+    auto& head = wheel.slots[level][slot];
+
+    timer.previous = nullptr;
+    timer.next = head;
+    if (head != nullptr) {
+        head->previous = &timer;
+    }
+
+    head = &timer;
+    wheel.occupied[level] |= 1ull << slot;
+
+    timer.level = level;
+    timer.slot = slot;
+    timer.is_pending = true;
+}
+
+void TimerWheel::remove(CoreWheel& wheel, Timer& timer)
+{
+    auto& head = timer.level == Expiring ? wheel.expiring : wheel.slots[timer.level][timer.slot];
+
+    if (timer.previous != nullptr) {
+        timer.previous->next = timer.next;
+    } else {
+        head = timer.next;
+    }
+
+    if (timer.next != nullptr) {
+        timer.next->previous = timer.previous;
+    }
+
+    if (timer.level != Expiring && head == nullptr) {
+        wheel.occupied[timer.level] &= ~(1ull << timer.slot);
+    }
+
+    timer.next = nullptr;
+    timer.previous = nullptr;
+    timer.is_pending = false;
+}
+
+u64 TimerWheel::next_event_tick(CoreWheel& wheel)
+{
+    auto next = NoTick;
+
+    for (size_t level = 0; level < LevelCount; level++) {
+        if (wheel.occupied[level] == 0) {
+            continue;
+        }
+
+        // A slot above the first level is only looked at when the wheel gets to its start, so this is the first
+        // slot of this level that hasn't started yet (or is starting right now).
+        auto shift = shift_of(level);
+        auto first = (wheel.current_tick + (1ull << shift) - 1) >> shift;
+
+        auto distance = __builtin_ctzll(rotate_right(wheel.occupied[level], first & SlotMask));
+        auto tick = (first + distance) << shift;
+
+        if (tick < next) {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+void TimerWheel::cascade(CoreWheel& wheel, size_t level)
+{
+    auto slot = (wheel.current_tick >> shift_of(level)) & SlotMask;
+
+    auto timer = wheel.slots[level][slot];
+    wheel.slots[level][slot] = nullptr;
+    wheel.occupied[level] &= ~(1ull << slot);
+
+    while (timer != nullptr) {
+        auto next = timer->next;
+        this->insert(wheel, *timer);
+        wheel.statistics.cascades++;
+
+        timer = next;
+    }
+}
+
+void TimerWheel::program(CoreWheel& wheel)
+{
+    auto next = this->next_event_tick(wheel);
+    if (next == wheel.programmed_tick) {
+        return;
+    }
+
+    wheel.programmed_tick = next;
+
+    if (next == NoTick) {
+        GenericTimer::stop();
+        return;
+    }
+
+    GenericTimer::start(Time::ticks_from_nanoseconds(next * Resolution));
+}
+
+void TimerWheel::handle_interrupt()
+{
+    // IRQs are already masked in here, but another core may be cancelling one of ours.
+    auto& wheel = m_wheels.current();
+    wheel.lock.lock();
+
+    wheel.statistics.interrupts++;
+
+    auto now = Time::now();
+    auto now_tick = now / Resolution;
+
+    // Only the ticks that have something to do are visited, no matter how long we've been asleep for.
+    for (auto tick = this->next_event_tick(wheel); tick <= now_tick; tick = this->next_event_tick(wheel)) {
+        wheel.current_tick = tick;
+
+        // Higher levels go first, as what they move down may belong in a lower level's slot that starts now too.
+        for (auto level = LevelCount - 1; level > 0; level--) {
+            if ((tick & ((1ull << shift_of(level)) - 1)) == 0) {
+                this->cascade(wheel, level);
+            }
+        }
+
+        // Whatever is started from here on (including by the callbacks) goes into a later slot than this one.
+        wheel.current_tick = tick + 1;
+
+        auto slot = tick & SlotMask;
+        wheel.expiring = wheel.slots[0][slot];
+        wheel.slots[0][slot] = nullptr;
+        wheel.occupied[0] &= ~(1ull << slot);
+
+        for (auto timer = wheel.expiring; timer != nullptr; timer = timer->next) {
+            timer->level = Expiring;
+        }
+
+        while (wheel.expiring != nullptr) {
+            auto& timer = *wheel.expiring;
+            this->remove(wheel, timer);
+
+            // It was too far away for the wheel, and has only got as far as its last slot.
+            if (tick_of(timer.deadline) > tick) {
+                this->insert(wheel, timer);
+                continue;
+            }
+
+            auto callback = timer.callback;
+            auto context = timer.context;
+
+            if (timer.period != 0) {
+                timer.deadline += timer.period;
+                if (timer.deadline <= now) {
+                    timer.deadline += ((now - timer.deadline) / timer.period + 1) * timer.period;
+                }
+
+                this->insert(wheel, timer);
+            }
+
+            wheel.statistics.timers_fired++;
+
+            // The callback may start or cancel timers (including this one).
+            wheel.lock.unlock();
+            callback(context);
+            wheel.lock.lock();
+        }
+    }
+
+    this->program(wheel);
+    wheel.lock.unlock();
+}
+
+void TimerWheel::sleep(u64 nanoseconds)
+{
+    // Without IRQs, nothing would ever wake us up.
+    if (!Interrupts::are_enabled()) {
+        Timeout timeout(nanoseconds);
+        while (!timeout.has_expired()) {
+        }
+
+        return;
+    }
+
+    Timer timer {};
+    volatile bool has_woken_up = false;
+
+    auto wake_up = [](void* has_woken_up) { *(volatile bool*)has_woken_up = true; };
+    this->start_one_shot(timer, Time::now() + nanoseconds, wake_up, (void*)&has_woken_up);
+
+    while (!has_woken_up) {
+        SMP::idle();
+    }
+}
+
+TimerWheel::Statistics TimerWheel::statistics()
+{
+    Statistics total {};
+
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        auto& statistics = m_wheels.for_core(core).statistics;
+        total.timers_started += statistics.timers_started;
+        total.timers_cancelled += statistics.timers_cancelled;
+        total.timers_fired += statistics.timers_fired;
+        total.cascades += statistics.cascades;
+        total.interrupts += statistics.interrupts;
+    }
+
+    return total;
+}
+
+void TimerWheel::print_stats()
+{
+    auto statistics = this->statistics();
+
+    UART::instance().println("[TimerWheel] Statistics:");
+    UART::instance().println("             - Timers started:   {i}", statistics.timers_started);
+    UART::instance().println("             - Timers cancelled: {i}", statistics.timers_cancelled);
+    UART::instance().println("             - Timers fired:     {i}", statistics.timers_fired);
+    UART::instance().println("             - Cascades:         {i}", statistics.cascades);
+    UART::instance().println("             - Interrupts:       {i}", statistics.interrupts);
+}
+
+}
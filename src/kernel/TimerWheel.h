@@ -0,0 +1,151 @@
+#pragma once
+
+#include "../types/integer.h"
+#include "PerCpu.h"
+#include "Spinlock.h"
+#include "Time.h"
+
+namespace Kernel {
+
+// A callback that runs once a deadline has passed, either once, or every `period` after that. It runs from the timer
+// interrupt of the core that it was started on, see TimerWheel (and InterruptController for what that allows).
+//
+// A Timer is owned by whoever started it, and must stay where it is until it has fired (if it's a one-shot timer), or
+// has been cancelled.
+struct Timer {
+    using Callback = void (*)(void* context);
+
+    Callback callback;
+    void* context;
+
+    // In nanoseconds, see Time::now().
+    u64 deadline;
+
+    // Zero for a one-shot timer.
+    u64 period;
+
+    // Where the timer is in its core's wheel, while it's pending.
+    Timer* next;
+    Timer* previous;
+    u8 level;
+    u8 slot;
+    u8 core;
+    bool is_pending;
+};
+
+// Every core keeps its own timers in a hierarchical timer wheel, so starting and cancelling a timer is O(1): each
+// level has 64 slots, the first level's slots are `Resolution` wide, and every level's slots are 64 times as wide as
+// the one below. A timer goes into the slot of the lowest level that its deadline fits in, and moves down a level
+// whenever the wheel gets to its slot, until it ends up in the first level, and fires.
+//
+//     level 0: 64 x 100 us (6.4 ms)
+//     level 1: 64 x 6.4 ms (409.6 ms)
+//     ...
+//     level 4: 64 x 1677.7 s (29.8 hours), anything later than that waits in the last slot until it fits
+//
+// There is no periodic tick: the core's physical timer (see GenericTimer) is only ever set for the next slot that has
+// something in it, and a core with nothing to do sleeps until then (see SMP::idle()). A deadline is rounded up to
+// the next multiple of `Resolution`, so a timer never fires early, but may fire up to that much late.
+//
+//     static Timer s_timer;
+//     TimerWheel::instance().start_periodic(s_timer, 10 * Time::Millisecond, poll_something, nullptr);
+class TimerWheel {
+public:
+    static constexpr u64 Resolution = 100 * Time::Microsecond;
+
+    static constexpr size_t SlotBits = 6;
+    static constexpr size_t SlotCount = 1 << SlotBits;
+    static constexpr size_t LevelCount = 5;
+
+    static constexpr u64 NoTick = ~0ull;
+
+    struct Statistics {
+        u64 timers_started;
+        u64 timers_cancelled;
+        u64 timers_fired;
+
+        // How many timers moved down a level, and how many times the timer interrupt fired.
+        u64 cascades;
+        u64 interrupts;
+    };
+
+    static TimerWheel& instance();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Routes the physical timer's interrupt to us, and does initialize_core() for the boot core.
+    void initialize();
+
+    // Every core has to start its own wheel (and enable its own timer interrupt), after initialize().
+    void initialize_core();
+
+    // Runs `callback(context)` once `deadline` (see Time::now()) has passed, on this core. A deadline that has already
+    // passed fires as soon as possible. If `timer` is still pending, it is cancelled first.
+    void start_one_shot(Timer& timer, u64 deadline, Timer::Callback callback, void* context);
+
+    // Runs `callback(context)` every `period` nanoseconds (which is rounded up to `Resolution`), on this core. The
+    // first time is one period from now, and every time after that is one period after the one before, whenever the
+    // callback actually ran, so it doesn't drift. Periods that were missed entirely are skipped.
+    void start_periodic(Timer& timer, u64 period, Timer::Callback callback, void* context);
+
+    // Stops `timer` from firing (again), from any core. Returns false if it wasn't pending, e.g. because it has already
+    // fired (or is running right now, on another core).
+    bool cancel(Timer& timer);
+
+    // Waits at least `nanoseconds`, sleeping until then if IRQs are enabled.
+    void sleep(u64 nanoseconds);
+
+    // Fires every timer on this core whose deadline has passed, and sets the physical timer for the next one.
+    void handle_interrupt();
+
+    Statistics statistics();
+    void print_stats();
+
+private:
+    TimerWheel() = default;
+
+    struct CoreWheel {
+        // Taken by this core's timer interrupt (so everywhere else masks IRQs), and by anyone cancelling one of this
+        // core's timers from another core.
+        Spinlock lock;
+
+        Timer* slots[LevelCount][SlotCount];
+
+        // Which slots have anything in them, so the next one can be found without looking at every slot.
+        u64 occupied[LevelCount];
+
+        // The first level's slot that handle_interrupt() is firing, taken out of the wheel first, so that a periodic
+        // timer that goes back into the same slot (a whole turn later) isn't fired again straight away.
+        Timer* expiring;
+
+        // In units of `Resolution`, everything before this has been handled.
+        u64 current_tick;
+
+        // The tick that the physical timer is set for, or NoTick if it isn't set.
+        u64 programmed_tick;
+
+        Statistics statistics;
+    };
+
+    // The `level` of a timer that is in `expiring`.
+    static constexpr u8 Expiring = LevelCount;
+
+    void start(Timer&, u64 deadline, u64 period, Timer::Callback, void* context);
+
+    void insert(CoreWheel&, Timer&);
+    void remove(CoreWheel&, Timer&);
+
+    // The tick that the wheel next has to do something at, or NoTick if it's empty.
+    u64 next_event_tick(CoreWheel&);
+
+    // Moves every timer in the slot that the wheel has just got to at `level` down to where it belongs now.
+    void cascade(CoreWheel&, size_t level);
+
+    // Sets the physical timer for the next tick that has something to do, if it isn't already.
+    void program(CoreWheel&);
+
+    PerCpu<CoreWheel> m_wheels;
+};
+
+}
@@ -0,0 +1,279 @@
+#include "VirtualMemory.h"
+#include "../fluorescent/Memory.h"
+#include "Kernel.h"
+#include "Log.h"
+#include "MMU.h"
+#include "PageAllocator.h"
+#include "io/UART.h"
+
+namespace Kernel {
+
+static constexpr Logger<VIRTUAL_MEMORY_LOG_LEVEL, "VirtualMemory"> logger {};
+
+using Descriptor = MMU::Descriptor;
+
+VirtualMemory& VirtualMemory::instance()
+{
+    static VirtualMemory instance;
+    return instance;
+}
+
+static u64 page_descriptor(uintptr_t physical_address, u32 flags)
+{
+    auto descriptor = (physical_address & Descriptor::AddressMask) | Descriptor::Page | Descriptor::AccessFlag;
+
+    if (flags & VirtualMemory::Flags::Device) {
+        descriptor |= Descriptor::attribute(MMU::Attribute::Device);
+    } else {
+        descriptor |= Descriptor::attribute(MMU::Attribute::Normal) | Descriptor::Shareability::Inner;
+    }
+
+    if (!(flags & VirtualMemory::Flags::Writable)) {
+        descriptor |= Descriptor::ReadOnly;
+    }
+
+    if (!(flags & VirtualMemory::Flags::Executable) || (flags & VirtualMemory::Flags::Device)) {
+        descriptor |= Descriptor::PrivilegedExecuteNever | Descriptor::UnprivilegedExecuteNever;
+    }
+
+    return descriptor;
+}
+
+// Tables are only written with the lock held, but they are read by every core's table walker at any time.
+static void publish_descriptor(u64* entry, u64 descriptor)
+{
+    *entry = descriptor;
+
+    asm volatile("dsb ishst\n"
+                 "isb" ::
+                     : "memory");
+}
+
+u64* VirtualMemory::entry_for(uintptr_t virtual_address, bool create)
+{
+    if (virtual_address >= ((uintptr_t)1 << MMU::VirtualAddressBits)) {
+        return nullptr;
+    }
+
+    auto table = MMU::level1_table();
+
+    // Level 1 (1 GiB) and level 2 (2 MiB) entries point to the next table, level 3 entries are the pages.
+    for (auto shift = 30; shift > 12; shift -= 9) {
+        auto entry = &table[(virtual_address >> shift) & 0x1FF];
+
+        if ((*entry & Descriptor::Valid) == 0) {
+            if (!create) {
+                return nullptr;
+            }
+
+            // Everything that the PageAllocator hands out is identity mapped, so the table can be used as-is.
+            auto next_table = (u64*)PageAllocator::instance().allocate(0);
+            if (next_table == nullptr) {
+                return nullptr;
+            }
+
+            zero_memory(next_table, PageSize);
+            publish_descriptor(entry, (u64)next_table | Descriptor::Table);
+
+            m_tables_allocated++;
+        } else if ((*entry & Descriptor::Table) != Descriptor::Table) {
+            // This is a block, which we don't split up.
+            return nullptr;
+        }
+
+        table = (u64*)(*entry & Descriptor::AddressMask);
+    }
+
+    return &table[(virtual_address >> 12) & 0x1FF];
+}
+
+bool VirtualMemory::map(uintptr_t virtual_address, uintptr_t physical_address, u32 flags)
+{
+    Locker locker(m_lock);
+    return this->map_page(virtual_address, physical_address, flags);
+}
+
+bool VirtualMemory::map_page(uintptr_t virtual_address, uintptr_t physical_address, u32 flags)
+{
+    auto entry = this->entry_for(virtual_address, true);
+    if (entry == nullptr || (*entry & Descriptor::Valid)) {
+        return false;
+    }
+
+    // The entry was invalid, so there is nothing in the TLB for it.
+    publish_descriptor(entry, page_descriptor(physical_address, flags));
+    m_pages_mapped++;
+
+    return true;
+}
+
+uintptr_t VirtualMemory::unmap(uintptr_t virtual_address)
+{
+    Locker locker(m_lock);
+    return this->unmap_page(virtual_address);
+}
+
+uintptr_t VirtualMemory::unmap_page(uintptr_t virtual_address)
+{
+    auto entry = this->entry_for(virtual_address, false);
+    if (entry == nullptr || !(*entry & Descriptor::Valid)) {
+        return 0;
+    }
+
+    auto physical_address = *entry & Descriptor::AddressMask;
+
+    publish_descriptor(entry, 0);
+    invalidate_tlb(virtual_address);
+    m_pages_unmapped++;
+
+    return physical_address;
+}
+
+bool VirtualMemory::protect(uintptr_t virtual_address, u32 flags)
+{
+    Locker locker(m_lock);
+
+    auto entry = this->entry_for(virtual_address, false);
+    if (entry == nullptr || !(*entry & Descriptor::Valid)) {
+        return false;
+    }
+
+    // Changing the permissions of a live mapping has to go through an invalid entry (break-before-make).
+    auto physical_address = *entry & Descriptor::AddressMask;
+
+    publish_descriptor(entry, 0);
+    invalidate_tlb(virtual_address);
+    publish_descriptor(entry, page_descriptor(physical_address, flags));
+
+    return true;
+}
+
+uintptr_t VirtualMemory::physical_address_of(uintptr_t virtual_address)
+{
+    SharedLocker locker(m_lock);
+
+    auto entry = this->entry_for(virtual_address, false);
+    if (entry == nullptr || !(*entry & Descriptor::Valid)) {
+        return 0;
+    }
+
+    return (*entry & Descriptor::AddressMask) | (virtual_address & (PageSize - 1));
+}
+
+void VirtualMemory::invalidate_tlb(uintptr_t virtual_address)
+{
+    asm volatile("dsb ishst\n"
+                 "tlbi vaae1is, %0\n"
+                 "dsb ish\n"
+                 "isb" ::"r"(virtual_address >> 12)
+                 : "memory");
+}
+
+void VirtualMemory::invalidate_tlb()
+{
+    asm volatile("dsb ishst\n"
+                 "tlbi vmalle1is\n"
+                 "dsb ish\n"
+                 "isb" ::
+                     : "memory");
+}
+
+void* VirtualMemory::grow_heap(size_t size)
+{
+    size = (size + PageSize - 1) & ~(PageSize - 1);
+
+    Locker locker(m_lock);
+
+    if (size > HeapStart + HeapReservation - m_heap_break) {
+        logger.error("The heap reservation is exhausted!");
+        return nullptr;
+    }
+
+    auto old_break = m_heap_break;
+    m_heap_break += size;
+
+    logger.debug("Moved the heap break up to {#}"_log, m_heap_break);
+
+    return (void*)old_break;
+}
+
+void VirtualMemory::shrink_heap(size_t size)
+{
+    size &= ~(PageSize - 1);
+
+    Locker locker(m_lock);
+
+    if (size > m_heap_break - HeapStart) {
+        size = m_heap_break - HeapStart;
+    }
+
+    auto new_break = m_heap_break - size;
+    for (auto page = new_break; page < m_heap_break; page += PageSize) {
+        auto physical_address = this->unmap_page(page);
+        if (physical_address != 0) {
+            PageAllocator::instance().free((void*)physical_address);
+            m_heap_pages_backed--;
+        }
+    }
+
+    m_heap_break = new_break;
+
+    logger.debug("Moved the heap break down to {#}"_log, m_heap_break);
+}
+
+bool VirtualMemory::handle_page_fault(uintptr_t address)
+{
+    if (address < HeapStart || address >= HeapStart + HeapReservation) {
+        return false;
+    }
+
+    Locker locker(m_lock);
+    m_page_faults++;
+
+    // Everything between the break and the end of the reservation is a guard.
+    if (address >= m_heap_break) {
+        logger.error("Heap overrun at {#}! (the break is at {#})", address, m_heap_break);
+        return false;
+    }
+
+    auto page = address & ~(PageSize - 1);
+
+    // Another core may have faulted on the same page, and beaten us to it.
+    auto entry = this->entry_for(page, false);
+    if (entry != nullptr && (*entry & Descriptor::Valid)) {
+        return true;
+    }
+
+    auto physical_page = PageAllocator::instance().allocate(0);
+    if (physical_page == nullptr) {
+        logger.error("Out of memory while backing the heap at {#}!", address);
+        return false;
+    }
+
+    // Whatever used this page before may have left something behind, so it is cleared before anyone can see it.
+    zero_memory(physical_page, PageSize);
+
+    if (!this->map_page(page, (uintptr_t)physical_page, Flags::Writable)) {
+        PageAllocator::instance().free(physical_page);
+        return false;
+    }
+
+    m_heap_pages_backed++;
+
+    logger.debug("Backed the heap page at {#} with {#}"_log, page, physical_page);
+
+    return true;
+}
+
+void VirtualMemory::print_stats()
+{
+    UART::instance().println("[VirtualMemory] Statistics:");
+    UART::instance().println("                - Heap:                {#} -> {#}", HeapStart, m_heap_break);
+    UART::instance().println("                - Heap pages backed:   {i} of {i}", m_heap_pages_backed, (m_heap_break - HeapStart) / PageSize);
+    UART::instance().println("                - Page faults:         {i}", m_page_faults);
+    UART::instance().println("                - Pages mapped:        {i}", m_pages_mapped);
+    UART::instance().println("                - Pages unmapped:      {i}", m_pages_unmapped);
+    UART::instance().println("                - Tables allocated:    {i}", m_tables_allocated);
+}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../types/integer.h"
+#include "Spinlock.h"
+
+namespace Kernel {
+
+// Maps 4 KiB pages anywhere outside of the identity map that MMU::initialize() sets up.
+// It also owns the kernel heap's virtual address range: MemoryManagement moves the break with grow_heap() and
+// shrink_heap(), and pages below the break are only backed by physical memory once they are first touched (see
+// handle_page_fault). Everything above the break is left unmapped, so running off the end of the heap faults.
+//
+// The tables are shared by every core, so changing them (or the break) takes the lock exclusively, and only looking
+// something up takes it shared. The page fault handler takes it too, so nothing may fault while holding it.
+class VirtualMemory {
+public:
+    static constexpr size_t PageSize = 4096;
+
+    // The kernel heap lives at 256 GiB, well above any physical memory that the identity map covers.
+    static constexpr uintptr_t HeapStart = 0x4000000000;
+    static constexpr size_t HeapReservation = (size_t)16 * 1024 * 1024 * 1024;
+
+    struct Flags {
+        static const u32 Writable = 1 << 0;
+        static const u32 Executable = 1 << 1;
+        static const u32 Device = 1 << 2;
+    };
+
+    static VirtualMemory& instance();
+
+    // Maps the page at `virtual_address` to the page at `physical_address`. Fails if the page is already mapped,
+    // or if it is covered by a block in the identity map.
+    bool map(uintptr_t virtual_address, uintptr_t physical_address, u32 flags);
+
+    // Unmaps the page at `virtual_address`, and returns the physical address that it was mapped to (or 0).
+    uintptr_t unmap(uintptr_t virtual_address);
+
+    // Changes the flags of a page which is already mapped.
+    bool protect(uintptr_t virtual_address, u32 flags);
+
+    // Returns the physical address that `virtual_address` is mapped to, or 0 if it isn't mapped by a page.
+    uintptr_t physical_address_of(uintptr_t virtual_address);
+
+    static void invalidate_tlb(uintptr_t virtual_address);
+    static void invalidate_tlb();
+
+    // Moves the heap's break up by `size` bytes (rounded up to a page), and returns the old break. Nothing is
+    // mapped until it is touched. Returns nullptr if the reservation is exhausted.
+    void* grow_heap(size_t size);
+
+    // Moves the heap's break down by `size` bytes (rounded down to a page), and gives back any pages that were
+    // backing that part of the heap.
+    void shrink_heap(size_t size);
+
+    void* heap_start() const { return (void*)HeapStart; }
+    void* heap_break() const { return (void*)m_heap_break; }
+    size_t heap_pages_backed() const { return m_heap_pages_backed; }
+
+    // Called for translation faults. Backs the page with a zeroed physical page if it is below the heap's break,
+    // returns false for anything else.
+    bool handle_page_fault(uintptr_t address);
+
+    void print_stats();
+
+private:
+    VirtualMemory()
+    {
+    }
+
+    // Returns the level 3 entry for `virtual_address`, creating the tables in between if `create` is set.
+    u64* entry_for(uintptr_t virtual_address, bool create);
+
+    // map() and unmap(), for when the lock is already held.
+    bool map_page(uintptr_t virtual_address, uintptr_t physical_address, u32 flags);
+    uintptr_t unmap_page(uintptr_t virtual_address);
+
+    ReadWriteSpinlock m_lock;
+
+    uintptr_t m_heap_break { HeapStart };
+    size_t m_heap_pages_backed { 0 };
+
+    u64 m_tables_allocated = 0;
+    u64 m_page_faults = 0;
+    u64 m_pages_mapped = 0;
+    u64 m_pages_unmapped = 0;
+};
+
+}
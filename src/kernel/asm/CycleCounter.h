@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../../types/integer.h"
+
+namespace Kernel {
+
+// The PMU cycle counter, which counts every CPU cycle once it has been enabled.
+// https://developer.arm.com/documentation/ddi0601/2023-03/AArch64-Registers/PMCCNTR-EL0--Performance-Monitors-Cycle-Count-Register?lang=en
+class CycleCounter {
+public:
+    static void enable()
+    {
+#ifndef PHOSPHENE_HOST
+        u64 control;
+        asm volatile("mrs %x0, pmcr_el0"
+                     : "=r"(control));
+
+        // E (bit 0) enables the counters, LC (bit 6) makes the cycle counter 64-bit.
+        control |= (1 << 0) | (1 << 6);
+        asm volatile("msr pmcr_el0, %x0" ::"r"(control));
+
+        // C (bit 31) enables the cycle counter itself.
+        asm volatile("msr pmcntenset_el0, %x0" ::"r"((u64)1 << 31));
+        asm volatile("isb");
+#endif
+    }
+
+    static u64 read()
+    {
+#ifdef PHOSPHENE_HOST
+        return 0;
+#else
+        u64 value;
+        asm volatile("isb\n"
+                     "mrs %x0, pmccntr_el0"
+                     : "=r"(value));
+
+        return value;
+#endif
+    }
+};
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../../types/integer.h"
+
+namespace Kernel {
+
+// The ARM generic timer's system counter, which ticks at a fixed rate (unlike the cycle counter) and is shared by
+// every core, and the EL1 physical timer, which every core has its own one of.
+// https://developer.arm.com/documentation/102379/0101/The-processor-timers
+class GenericTimer {
+public:
+    // https://developer.arm.com/documentation/ddi0601/2023-03/AArch64-Registers/CNTPCT-EL0--Counter-timer-Physical-Count-Register?lang=en
+    [[gnu::always_inline]] static u64 counter()
+    {
+#ifdef PHOSPHENE_HOST
+        return 0;
+#else
+        u64 value;
+        asm volatile("isb\n"
+                     "mrs %x0, cntpct_el0"
+                     : "=r"(value));
+
+        return value;
+#endif
+    }
+
+    // How many times a second the counter ticks, which the firmware sets up (we can't, it's only writable at EL3).
+    [[gnu::always_inline]] static u64 frequency()
+    {
+#ifdef PHOSPHENE_HOST
+        return 0;
+#else
+        u64 value;
+        asm volatile("mrs %x0, cntfrq_el0"
+                     : "=r"(value));
+
+        return value;
+#endif
+    }
+
+    // Fires the timer's interrupt once the counter reaches `value`, and keeps it asserted until this is moved into
+    // the future again (or the timer is stopped).
+    [[gnu::always_inline]] static void start(u64 value)
+    {
+#ifdef PHOSPHENE_HOST
+        (void)value;
+#else
+        // ENABLE (bit 0) set, IMASK (bit 1) clear.
+        asm volatile("msr cntp_cval_el0, %x0\n"
+                     "msr cntp_ctl_el0, %x1\n"
+                     "isb" ::"r"(value),
+                     "r"((u64)1));
+#endif
+    }
+
+    [[gnu::always_inline]] static void stop()
+    {
+#ifndef PHOSPHENE_HOST
+        asm volatile("msr cntp_ctl_el0, xzr\n"
+                     "isb");
+#endif
+    }
+};
+
+}
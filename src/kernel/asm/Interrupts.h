@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../../types/integer.h"
+
+namespace Kernel {
+
+// What DAIF was before interrupts were masked, so that they can be put back the way they were.
+using InterruptState = u64;
+
+// Masking and unmasking IRQs on the core that we're running on.
+// https://developer.arm.com/documentation/ddi0601/2023-03/AArch64-Registers/DAIF--Interrupt-Mask-Bits?lang=en
+class Interrupts {
+public:
+    // Masks IRQs, and returns whether they were masked before.
+    [[gnu::always_inline]] static InterruptState disable()
+    {
+#ifdef PHOSPHENE_HOST
+        return 0;
+#else
+        InterruptState state;
+        asm volatile("mrs %x0, daif\n"
+                     "msr daifset, #2"
+                     : "=r"(state)::"memory");
+
+        return state;
+#endif
+    }
+
+    [[gnu::always_inline]] static void restore(InterruptState state)
+    {
+#ifdef PHOSPHENE_HOST
+        (void)state;
+#else
+        asm volatile("msr daif, %x0" ::"r"(state)
+                     : "memory");
+#endif
+    }
+
+    [[gnu::always_inline]] static void enable()
+    {
+#ifndef PHOSPHENE_HOST
+        asm volatile("msr daifclr, #2" ::
+                         : "memory");
+#endif
+    }
+
+    [[gnu::always_inline]] static bool are_enabled()
+    {
+#ifdef PHOSPHENE_HOST
+        return false;
+#else
+        u64 state;
+        asm volatile("mrs %x0, daif"
+                     : "=r"(state));
+
+        // I (bit 7) masks IRQs.
+        return (state & (1 << 7)) == 0;
+#endif
+    }
+};
+
+}
@@ -29,7 +29,12 @@ public:
 
     const char* part_number_as_string()
     {
-        switch (part_number()) {
+        return part_number_as_string(part_number());
+    }
+
+    static const char* part_number_as_string(PartNumber part_number)
+    {
+        switch (part_number) {
         case PartNumber::Pi1:
             return "Raspberry Pi 1";
 
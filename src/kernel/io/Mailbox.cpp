@@ -0,0 +1,117 @@
+#include "Mailbox.h"
+#include "../Kernel.h"
+#include "../Log.h"
+#include "../MMU.h"
+#include "../Time.h"
+#include "Register.h"
+
+// Most of the magic numbers you see here are from:
+// https://github.com/raspberrypi/firmware/wiki/Accessing-mailboxes
+
+namespace Kernel {
+
+static constexpr Logger<MAILBOX_LOG_LEVEL, "Mailbox"> logger {};
+
+static constexpr u32 Base = 0x0000B880;
+
+struct MailboxRead : Register<MailboxRead, Base + 0x00> {
+};
+
+struct MailboxStatus : Register<MailboxStatus, Base + 0x18> {
+    using Empty = Bitfield<MailboxStatus, 30>;
+    using Full = Bitfield<MailboxStatus, 31>;
+};
+
+struct MailboxWrite : Register<MailboxWrite, Base + 0x20> {
+};
+
+struct Channel {
+    static const u8 Property = 8;
+};
+
+struct Code {
+    static const u32 Request = 0x00000000;
+    static const u32 ResponseSuccess = 0x80000000;
+};
+
+// The firmware answers most calls within microseconds, but changing a clock can take a while.
+static constexpr u64 CallTimeout = Time::Second;
+
+Mailbox& Mailbox::instance()
+{
+    static Mailbox instance;
+    return instance;
+}
+
+bool Mailbox::property(u32 tag, u32* values, u32 value_count)
+{
+    // The buffer holds the header (2 words), the tag header (3 words), the values, and the end tag.
+    if (value_count > sizeof(m_buffer) / sizeof(u32) - 6) {
+        return false;
+    }
+
+    Locker locker(m_lock);
+
+    auto index = 0;
+    m_buffer[index++] = (value_count + 6) * sizeof(u32);
+    m_buffer[index++] = Code::Request;
+
+    m_buffer[index++] = tag;
+    m_buffer[index++] = value_count * sizeof(u32);
+    m_buffer[index++] = 0;
+
+    for (u32 i = 0; i < value_count; i++) {
+        m_buffer[index++] = values[i];
+    }
+
+    // End tag
+    m_buffer[index++] = 0;
+
+    if (!this->call(Channel::Property)) {
+        logger.warning("Firmware did not accept tag {#}!", tag);
+
+        return false;
+    }
+
+    for (u32 i = 0; i < value_count; i++) {
+        values[i] = m_buffer[5 + i];
+    }
+
+    return true;
+}
+
+bool Mailbox::call(u8 channel)
+{
+    auto message = (u32)(uintptr_t)m_buffer | channel;
+
+    // The firmware reads and writes the buffer directly in memory, so it can't see anything that is still in our cache.
+    MMU::clean_data_cache(m_buffer, sizeof(m_buffer));
+
+    Timeout timeout(CallTimeout);
+
+    while (MailboxStatus::Full::is_set()) {
+        if (timeout.has_expired()) {
+            logger.error("Timed out waiting for room in the mailbox!");
+            return false;
+        }
+    }
+
+    MailboxWrite::write(message);
+
+    while (true) {
+        while (MailboxStatus::Empty::is_set()) {
+            if (timeout.has_expired()) {
+                logger.error("Timed out waiting for the firmware to answer!");
+                return false;
+            }
+        }
+
+        // There may be responses for other channels in here, we can just ignore those.
+        if (MailboxRead::read() == message) {
+            MMU::invalidate_data_cache(m_buffer, sizeof(m_buffer));
+            return m_buffer[1] == Code::ResponseSuccess;
+        }
+    }
+}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../../types/integer.h"
+#include "../Spinlock.h"
+
+namespace Kernel {
+
+// The mailbox is how we talk to the VideoCore firmware, which owns things like the memory split and clocks.
+// https://github.com/raspberrypi/firmware/wiki/Mailboxes
+// https://github.com/raspberrypi/firmware/wiki/Mailbox-property-interface
+class Mailbox {
+public:
+    struct Tag {
+        static const u32 GetARMMemory = 0x00010005;
+        static const u32 GetClockRate = 0x00030002;
+        static const u32 SetClockRate = 0x00038002;
+    };
+
+    // https://github.com/raspberrypi/firmware/wiki/Mailbox-property-interface#clocks
+    struct Clock {
+        static const u32 UART = 2;
+    };
+
+    static Mailbox& instance();
+
+    // Sends a single property tag to the firmware. `values` is used for both the request and the response,
+    // and must be able to hold `value_count` words. Returns false if the firmware did not understand the request.
+    bool property(u32 tag, u32* values, u32 value_count);
+
+private:
+    Mailbox()
+    {
+    }
+
+    bool call(u8 channel);
+
+    // There is only one buffer (and one mailbox), so only one core can talk to the firmware at a time.
+    Spinlock m_lock;
+
+    // The buffer has to be 16-byte aligned, as the lower 4 bits of the address we write are used for the channel.
+    alignas(16) volatile u32 m_buffer[36] {};
+};
+
+}
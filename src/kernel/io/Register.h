@@ -0,0 +1,89 @@
+#pragma once
+
+#include "../../types/integer.h"
+#include "../Board.h"
+
+namespace Kernel {
+
+// Typed descriptions of peripheral registers. Everything here is always inlined, so an access is a single load or
+// store at a fixed offset from the board's peripheral base, which is only worked out once at boot (see Board). On a
+// board-specific kernel, the base is a constant too.
+//
+//     struct Control : Register<Control, 0x201030> {
+//         using UARTEnable = Bitfield<Control, 0>;
+//         using TransmitEnable = Bitfield<Control, 8>;
+//     };
+//
+//     Control::write(Control::UARTEnable::Set | Control::TransmitEnable::Set); // Every other field is zeroed
+//     Control::modify(Control::TransmitEnable::Clear);                         // Every other field is left alone
+//
+// A FieldValue knows which register it belongs to, so fields of different registers can't be mixed up.
+
+// The values of one or more fields of `Register`, which can be combined with `|` and then written in one go.
+template <typename Register>
+struct FieldValue {
+    u32 value;
+    u32 mask;
+
+    constexpr FieldValue operator|(FieldValue other) const { return { value | other.value, mask | other.mask }; }
+};
+
+// A 32-bit register at `Offset` from the peripheral base. `Self` is the register itself, see above.
+template <typename Self, u32 Offset>
+class Register {
+public:
+    [[gnu::always_inline]] static u32 read() { return *address(); }
+    [[gnu::always_inline]] static void write(u32 value) { *address() = value; }
+
+    // Writes the given fields, and zeroes the rest.
+    [[gnu::always_inline]] static void write(FieldValue<Self> fields) { write(fields.value); }
+
+    // Writes the given fields, and keeps whatever the rest already were.
+    [[gnu::always_inline]] static void modify(FieldValue<Self> fields) { write((read() & ~fields.mask) | fields.value); }
+
+    // Whether all of the given fields currently have the given values.
+    [[gnu::always_inline]] static bool matches(FieldValue<Self> fields) { return (read() & fields.mask) == fields.value; }
+
+private:
+    [[gnu::always_inline]] static volatile u32* address() { return (volatile u32*)(Board::peripheral_base() + Offset); }
+};
+
+// A run of 32-bit registers that share a layout, `Stride` bytes apart from `Offset`, e.g. one for every core or one
+// for every 32 interrupts.
+//
+//     struct SetEnable : RegisterArray<SetEnable, 0x1841100> { };
+//     SetEnable::write(irq / 32, 1 << (irq % 32));
+template <typename Self, u32 Offset, u32 Stride = 4>
+class RegisterArray {
+public:
+    [[gnu::always_inline]] static u32 read(u32 index) { return *address(index); }
+    [[gnu::always_inline]] static void write(u32 index, u32 value) { *address(index) = value; }
+
+    [[gnu::always_inline]] static void write(u32 index, FieldValue<Self> fields) { write(index, fields.value); }
+    [[gnu::always_inline]] static void modify(u32 index, FieldValue<Self> fields) { write(index, (read(index) & ~fields.mask) | fields.value); }
+
+private:
+    [[gnu::always_inline]] static volatile u32* address(u32 index) { return (volatile u32*)(Board::peripheral_base() + Offset + index * Stride); }
+};
+
+// `Width` bits of `Register`, starting at bit `Shift`.
+template <typename Register, u32 Shift, u32 Width = 1>
+struct Bitfield {
+    static_assert(Width != 0 && Shift + Width <= 32, "Bitfield does not fit in a register!");
+
+    static constexpr u32 Mask = (u32)(((u64)1 << Width) - 1) << Shift;
+
+    static constexpr FieldValue<Register> value(u32 value) { return { (value << Shift) & Mask, Mask }; }
+
+    static constexpr FieldValue<Register> Set { Mask, Mask };
+    static constexpr FieldValue<Register> Clear { 0, Mask };
+
+    [[gnu::always_inline]] static u32 read() { return extract(Register::read()); }
+    [[gnu::always_inline]] static bool is_set() { return Register::read() & Mask; }
+
+    // Pulls the field out of a value that was already read, so that several fields can be checked with one read.
+    static constexpr u32 extract(u32 register_value) { return (register_value & Mask) >> Shift; }
+    static constexpr bool is_set(u32 register_value) { return register_value & Mask; }
+};
+
+}
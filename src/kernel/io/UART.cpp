@@ -1,46 +1,98 @@
 #include "UART.h"
-#include "MMIO.h"
+#include "../InterruptController.h"
+#include "../SMP.h"
+#include "../Time.h"
+#include "Mailbox.h"
+#include "Register.h"
 
 namespace Kernel {
 
 // 11.5: Register View
 // https://datasheets.raspberrypi.com/bcm2711/bcm2711-peripherals.pdf#%5B%7B%22num%22%3A149%2C%22gen%22%3A0%7D%2C%7B%22name%22%3A%22XYZ%22%7D%2C115%2C139.396%2Cnull%5D
-struct Register {
-    // NOTE: This does not include the peripheral base of 0x7C000000 (RPi 4)
-    static const u32 Base = 0x201000;
-    static const u32 Data = Base + 0x00;
-    static const u32 Flag = Base + 0x18;
-    static const u32 LineControl = Base + 0x2c;
-    static const u32 Control = Base + 0x30;
+// NOTE: This does not include the peripheral base of 0x7C000000 (RPi 4)
+static constexpr u32 Base = 0x201000;
+
+// 11.5. Register View - DR Register
+// https://datasheets.raspberrypi.com/bcm2711/bcm2711-peripherals.pdf#reg-UART-DR
+struct Data : Register<Data, Base + 0x00> {
+    using Character = Bitfield<Data, 0, 8>;
+
+    // Overrun, break, parity and framing errors
+    using Errors = Bitfield<Data, 8, 4>;
 };
 
 // 11.5. Register View - FR Register
 // https://datasheets.raspberrypi.com/bcm2711/bcm2711-peripherals.pdf#reg-UART-FR
-struct Flag {
-    static const u32 TransmitFIFOFull = 1 << 5;
-    static const u32 ReceiveFIFOFull = 1 << 6;
+struct Flag : Register<Flag, Base + 0x18> {
+    using Busy = Bitfield<Flag, 3>;
+    using ReceiveFIFOEmpty = Bitfield<Flag, 4>;
+    using TransmitFIFOFull = Bitfield<Flag, 5>;
+    using ReceiveFIFOFull = Bitfield<Flag, 6>;
+};
+
+// 11.5. Register View - IBRD and FBRD Registers
+// https://datasheets.raspberrypi.com/bcm2711/bcm2711-peripherals.pdf#reg-UART-IBRD
+struct IntegerBaudRate : Register<IntegerBaudRate, Base + 0x24> {
+    using Divisor = Bitfield<IntegerBaudRate, 0, 16>;
+};
+
+struct FractionalBaudRate : Register<FractionalBaudRate, Base + 0x28> {
+    using Divisor = Bitfield<FractionalBaudRate, 0, 6>;
 };
 
 // 11.5. Register View - LCRH Register
 // https://datasheets.raspberrypi.com/bcm2711/bcm2711-peripherals.pdf#reg-UART-LCRH
-struct LineControl {
-    // These bits indicate the number of data bits transmitted or received in a frame
-    struct WordLength {
-        static const u32 Eight = 0b11 << 5;
-    };
+struct LineControl : Register<LineControl, Base + 0x2c> {
+    using EnableFIFO = Bitfield<LineControl, 4>;
 
-    static const u32 EnableFIFO = 1 << 4;
-    static const u32 DisableFIFO = 0 << 4;
+    // These bits indicate the number of data bits transmitted or received in a frame
+    using WordLength = Bitfield<LineControl, 5, 2>;
+    static constexpr auto EightBitWords = WordLength::value(0b11);
 };
 
 // 11.5. Register View - CR Register
 // https://datasheets.raspberrypi.com/bcm2711/bcm2711-peripherals.pdf#reg-UART-CR
-struct Control {
-    static const u32 UARTEnable = 1 << 0;
-    static const u32 TransmitEnable = 1 << 8;
-    static const u32 ReceiveEnable = 1 << 9;
+struct Control : Register<Control, Base + 0x30> {
+    using UARTEnable = Bitfield<Control, 0>;
+    using TransmitEnable = Bitfield<Control, 8>;
+    using ReceiveEnable = Bitfield<Control, 9>;
 };
 
+// 11.5. Register View - IFLS Register
+// https://datasheets.raspberrypi.com/bcm2711/bcm2711-peripherals.pdf#reg-UART-IFLS
+struct InterruptFIFOLevel : Register<InterruptFIFOLevel, Base + 0x34> {
+    using Transmit = Bitfield<InterruptFIFOLevel, 0, 3>;
+    using Receive = Bitfield<InterruptFIFOLevel, 3, 3>;
+
+    // The transmit interrupt fires once the FIFO drops to 1/8 full, which leaves plenty of time to refill it.
+    static constexpr auto TransmitOneEighth = Transmit::value(0b000);
+
+    // The receive interrupt fires once the FIFO is half full. Anything less than that is picked up by the receive
+    // timeout interrupt, once the line has been idle for 32 bits.
+    static constexpr auto ReceiveOneHalf = Receive::value(0b010);
+};
+
+// 11.5. Register View - IMSC, MIS and ICR Registers (they all share the same layout)
+// https://datasheets.raspberrypi.com/bcm2711/bcm2711-peripherals.pdf#reg-UART-IMSC
+template <typename Self>
+struct InterruptFields {
+    using Receive = Bitfield<Self, 4>;
+    using Transmit = Bitfield<Self, 5>;
+    using ReceiveTimeout = Bitfield<Self, 6>;
+    using All = Bitfield<Self, 0, 11>;
+};
+
+struct InterruptMask : Register<InterruptMask, Base + 0x38>, InterruptFields<InterruptMask> { };
+struct MaskedInterruptStatus : Register<MaskedInterruptStatus, Base + 0x40>, InterruptFields<MaskedInterruptStatus> { };
+struct InterruptClear : Register<InterruptClear, Base + 0x44>, InterruptFields<InterruptClear> { };
+
+// The UART clock that the firmware sets up by default on both the Pi 3 and the Pi 4, which is fast enough for 3 Mbaud.
+static const u32 DefaultReferenceClockRate = 48000000;
+
+// How long we wait for the UART to make room (or to finish sending) before we decide that it's stuck, which is far
+// longer than a full FIFO takes to go out at 9600 baud.
+static constexpr u64 TransmitTimeout = 100 * Time::Millisecond;
+
 UART& UART::instance()
 {
     static UART instance;
@@ -52,195 +104,398 @@ UART& UART::instance()
 UART::UART()
 {
     // 1. Disable the UART.
-    MMIO::instance().write(Register::Control, 0);
+    Control::write(0);
 
     // 2. TODO: Wait for the end of transmission or reception of the current character.
 
     // 3. Flush the transmit FIFO by setting the FEN bit to 0 in the Line Control Register
-    MMIO::instance().write(Register::LineControl, LineControl::DisableFIFO);
+    LineControl::write(LineControl::EnableFIFO::Clear);
+
+    // - Program the baud rate, which only takes effect once the Line Control Register is written.
+    //   If this fails, whatever the firmware left behind is the best that we can do.
+    //   NOTE: The mailbox must not print anything here, as we are still being constructed!
+    this->program_baud_rate(DefaultBaudRate);
 
     // - Enable FIFO and set the word length to 8
     //   TODO: Figure out why 8 is the only value that works, maybe I'm a dummy lol
-    MMIO::instance().write(Register::LineControl, LineControl::EnableFIFO | LineControl::WordLength::Eight);
+    LineControl::write(LineControl::EnableFIFO::Set | LineControl::EightBitWords);
+
+    // - Nothing is routed anywhere yet, see enable_interrupts()
+    InterruptMask::write(0);
+    InterruptClear::write(InterruptClear::All::Set);
 
     // 4 + 5. Reprogram the control register + Enable the UART
-    MMIO::instance().write(Register::Control, Control::UARTEnable | Control::ReceiveEnable | Control::TransmitEnable);
+    Control::write(Control::UARTEnable::Set | Control::ReceiveEnable::Set | Control::TransmitEnable::Set);
+}
+
+u32 UART::read()
+{
+    u8 value;
+    while (!this->try_read(value)) {
+        // The receive interrupt will wake us up.
+        if (m_interrupts_enabled) {
+            SMP::idle();
+        }
+    }
+
+    return value;
 }
 
-const char* u32_to_string(u32 value, char* output, u32 buffer_size)
+bool UART::try_read(u8& value)
 {
-    // 0 will always be 0.
-    // We also have to special case this due to the while statement below...
-    if (value == 0) {
-        return "0";
+    if (!m_interrupts_enabled) {
+        InterruptSafeLocker locker(m_lock);
+        this->drain_receive_fifo();
     }
 
-    auto index = buffer_size - 1;
-    output[index--] = 0;
+    if (m_receive_tail == m_receive_head) {
+        return false;
+    }
+
+    value = m_receive_buffer[m_receive_tail % ReceiveBufferSize];
+
+    // The byte has to be read before the producer can see that its slot is free.
+    asm volatile("dmb ish" ::
+                     : "memory");
+    m_receive_tail = m_receive_tail + 1;
 
-    while (value > 0) {
-        auto remainder = value % 10;
-        output[index--] = '0' + remainder;
+    return true;
+}
 
-        value = value / 10;
+size_t UART::read(u8* buffer, size_t size)
+{
+    size_t count = 0;
+    while (count < size && this->try_read(buffer[count])) {
+        count++;
     }
 
-    // Because we are working from the end forward (index--), `index` will always point to
-    // the byte before the last one that was written.
-    return &output[index + 1];
+    return count;
 }
 
-const char* u32_to_hex_string(u32 value, char* output, u32 buffer_size)
+bool UART::try_read_line(char* buffer, size_t size)
 {
-    char hexidecimal_characters[] = "0123456789ABCDEF";
+    // There isn't even room for the terminator.
+    if (size == 0) {
+        return false;
+    }
+
+    u8 value;
+    while (this->try_read(value)) {
+        if (value == '\r' || value == '\n') {
+            // A \r\n line ending would otherwise give us an empty line after every line.
+            if (value == '\n' && m_line_length == 0 && m_last_line_ending == '\r') {
+                m_last_line_ending = value;
+                continue;
+            }
+
+            m_last_line_ending = value;
+            this->print("\r\n");
+
+            auto length = m_line_length < size - 1 ? m_line_length : size - 1;
+            for (size_t i = 0; i < length; i++) {
+                buffer[i] = m_line[i];
+            }
 
-    auto base = 16;
-    auto index = buffer_size - 1;
-    output[index--] = 0;
+            buffer[length] = '\0';
+            m_line_length = 0;
 
-    while (value > 0) {
-        auto remainder = value % base;
-        output[index--] = hexidecimal_characters[remainder];
+            return true;
+        }
+
+        m_last_line_ending = 0;
+
+        // Backspace and delete both remove the last character.
+        if (value == '\b' || value == 0x7F) {
+            if (m_line_length > 0) {
+                m_line_length--;
+                this->print("\b \b");
+            }
+
+            continue;
+        }
 
-        value = value / base;
+        if (m_line_length < LineBufferSize) {
+            m_line[m_line_length++] = value;
+            this->write(value);
+        }
     }
 
-    return &output[index + 1];
+    return false;
 }
 
-void UART::print_raw(const char* string)
+void UART::read_line(char* buffer, size_t size)
 {
-    for (auto i = 0; string[i] != '\0'; i++) {
-        this->write(string[i]);
+    if (size == 0) {
+        return;
+    }
+
+    while (!this->try_read_line(buffer, size)) {
+        if (m_interrupts_enabled) {
+            SMP::idle();
+        }
     }
 }
 
-void UART::print(const char* string, va_list arguments)
+void UART::drain_receive_fifo()
 {
-    // Loop over all characters in the string...
-    for (auto i = 0; string[i] != '\0'; i++) {
-        auto character = string[i];
+    while (!Flag::ReceiveFIFOEmpty::is_set()) {
+        auto data = Data::read();
 
-        if (character == '\\') {
-            this->write(string[i + 1]);
-            i++;
-            
+        if (Data::Errors::is_set(data)) {
+            m_receive_errors++;
             continue;
         }
 
-        // If the character was an opening brace, we have started to parse an argument
-        if (character == '{') {
+        if (m_receive_head - m_receive_tail == ReceiveBufferSize) {
+            m_bytes_overrun++;
             continue;
         }
 
-        // If the last character was an opening brace, and the next character is a closing brace, do nothing
-        if (string[i - 1] == '{' && string[i + 1] == '}') {
-            continue;
-        }
+        m_receive_buffer[m_receive_head % ReceiveBufferSize] = Data::Character::extract(data);
 
-        // If the character is a closing brace, we have finished this argument, and can now print out its value
-        if (character == '}') {
-            auto type = string[i - 1];
-            switch (type) {
+        // The byte has to be in the buffer before the consumer can see the new head.
+        asm volatile("dmb ish" ::
+                         : "memory");
+        m_receive_head = m_receive_head + 1;
+    }
+}
 
-            // Integer types (u32)
-            case 'i': {
-                auto value = va_arg(arguments, u32);
+void UART::write(u32 value)
+{
+    InterruptSafeLocker locker(m_lock);
 
-                char output[11];
-                this->print_raw(u32_to_string(value, output, 11));
+    this->queue(value);
+    this->start_transmitting();
+}
 
-                break;
-            }
+void UART::write(const char* data, size_t size)
+{
+    InterruptSafeLocker locker(m_lock);
 
-            // Integer types printed as hexidecimal
-            case '#': {
-                auto value = va_arg(arguments, u32);
+    for (size_t i = 0; i < size; i++) {
+        this->queue(data[i]);
+    }
 
-                this->print_raw("0x");
+    this->start_transmitting();
+}
 
-                char output[16];
-                this->print_raw(u32_to_hex_string(value, output, 16));
+bool UART::try_write(const char* data, size_t size)
+{
+    InterruptSafeLocker locker(m_lock);
 
-                break;
-            }
+    if (!m_interrupts_enabled || TransmitBufferSize - this->transmit_buffer_used() < size) {
+        return false;
+    }
 
-            // Strings
-            case 's': {
-                auto value = va_arg(arguments, const char*);
-                this->print_raw(value);
+    for (size_t i = 0; i < size; i++) {
+        this->queue(data[i]);
+    }
 
-                break;
-            }
+    this->start_transmitting();
 
-            // Booleans (treated as int when parsing argument)
-            case 'b': {
-                auto value = va_arg(arguments, int);
-                this->print_raw(value ? "true" : "false");
+    return true;
+}
 
-                break;
+void UART::queue(u8 value)
+{
+    if (this->transmit_buffer_used() == TransmitBufferSize) {
+        switch (m_full_buffer_policy) {
+        case FullBufferPolicy::Block: {
+            // The interrupt is masked while we hold the lock (or isn't enabled yet), so we make room ourselves.
+            Timeout timeout(TransmitTimeout);
+            while (this->transmit_buffer_used() == TransmitBufferSize) {
+                if (timeout.has_expired()) {
+                    m_bytes_dropped++;
+                    return;
+                }
+
+                this->fill_transmit_fifo();
             }
 
-            default:
-                this->print_raw("{ Unsupported debug format type: '");
-                this->write(type);
-                this->print_raw("' }");
+            break;
+        }
 
-                break;
-            }
+        case FullBufferPolicy::Drop:
+            m_bytes_dropped++;
+            return;
 
-            continue;
+        case FullBufferPolicy::OverwriteOldest:
+            m_transmit_tail = m_transmit_tail + 1;
+            m_bytes_dropped++;
+            break;
         }
+    }
+
+    m_transmit_buffer[m_transmit_head % TransmitBufferSize] = value;
+
+    // The byte has to be in the buffer before whoever is draining it can see the new head.
+    asm volatile("dmb ish" ::
+                     : "memory");
+    m_transmit_head = m_transmit_head + 1;
+}
 
-        // The character was neither an opening, or a closing brace, so we can just write it normally
-        this->write(character);
+void UART::start_transmitting()
+{
+    // Without the interrupt, nothing else is going to send what was just queued.
+    if (!m_interrupts_enabled) {
+        return this->write_out_transmit_buffer();
     }
 
-    va_end(arguments);
+    // The transmit interrupt only fires when the FIFO drains past its trigger level, so if the UART is idle, we have
+    // to start it off ourselves.
+    this->fill_transmit_fifo();
 }
 
-void UART::print(const char* string, ...)
+void UART::fill_transmit_fifo()
 {
-    va_list arguments;
-    va_start(arguments, string);
+    while (m_transmit_tail != m_transmit_head && !Flag::TransmitFIFOFull::is_set()) {
+        Data::write(m_transmit_buffer[m_transmit_tail % TransmitBufferSize]);
+        m_transmit_tail = m_transmit_tail + 1;
+    }
 
-    this->print(string, arguments);
+    // We only want to hear from the UART while there is something left to send.
+    if (m_interrupts_enabled) {
+        InterruptMask::modify(InterruptMask::Transmit::value(m_transmit_tail != m_transmit_head));
+    }
 }
 
-void UART::println(const char* string, ...)
+void UART::flush()
 {
-    va_list arguments;
-    va_start(arguments, string);
+    InterruptSafeLocker locker(m_lock);
+    this->write_out_transmit_buffer();
+}
+
+void UART::write_out_transmit_buffer()
+{
+    while (m_transmit_tail != m_transmit_head) {
+        // If the UART is stuck, nothing else that is queued is going to make it out either.
+        if (!this->wait_until_ready_for_writing()) {
+            m_bytes_dropped += this->transmit_buffer_used();
+            m_transmit_tail = m_transmit_head;
+            return;
+        }
 
-    this->print(string, arguments);
-    this->print("\r\n");
+        Data::write(m_transmit_buffer[m_transmit_tail % TransmitBufferSize]);
+        m_transmit_tail = m_transmit_tail + 1;
+    }
+
+    // The FIFO being empty doesn't mean that the last byte has left the UART.
+    Timeout timeout(TransmitTimeout);
+    while (Flag::Busy::is_set() && !timeout.has_expired()) {
+    }
 }
 
-u32 UART::read()
+// 11.5. Register View - IBRD Register
+// https://datasheets.raspberrypi.com/bcm2711/bcm2711-peripherals.pdf#reg-UART-IBRD
+u32 UART::set_baud_rate(u32 baud_rate)
+{
+    InterruptSafeLocker locker(m_lock);
+    this->write_out_transmit_buffer();
+
+    Control::write(0);
+
+    auto effective_baud_rate = this->program_baud_rate(baud_rate);
+
+    // The divisors are only latched when the Line Control Register is written.
+    LineControl::write(LineControl::EnableFIFO::Set | LineControl::EightBitWords);
+    Control::write(Control::UARTEnable::Set | Control::ReceiveEnable::Set | Control::TransmitEnable::Set);
+
+    return effective_baud_rate;
+}
+
+u32 UART::program_baud_rate(u32 baud_rate)
 {
-    this->wait_until_ready_for_reading();
+    if (baud_rate == 0) {
+        return 0;
+    }
+
+    if (m_reference_clock_rate == 0) {
+        u32 clock[2] = { Mailbox::Clock::UART, 0 };
+        m_reference_clock_rate = Mailbox::instance().property(Mailbox::Tag::GetClockRate, clock, 2) && clock[1] != 0 ? clock[1] : DefaultReferenceClockRate;
+    }
 
-    return MMIO::instance().read(Register::Data);
+    // The UART samples every bit 16 times, so the clock has to be at least 16 times the baud rate.
+    if ((u64)m_reference_clock_rate < (u64)baud_rate * 16) {
+        u32 clock[3] = { Mailbox::Clock::UART, DefaultReferenceClockRate, 0 };
+        if ((u64)baud_rate * 16 > DefaultReferenceClockRate) {
+            clock[1] = baud_rate * 16;
+        }
+
+        if (Mailbox::instance().property(Mailbox::Tag::SetClockRate, clock, 3) && clock[1] != 0) {
+            m_reference_clock_rate = clock[1];
+        }
+
+        if ((u64)m_reference_clock_rate < (u64)baud_rate * 16) {
+            return 0;
+        }
+    }
+
+    // The divisor is clock / (16 * baud rate), with a 16-bit integer part and a 6-bit fraction. Working in 64ths
+    // gives us both parts at once, rounded to the nearest 64th.
+    auto divisor = ((u64)m_reference_clock_rate * 4 + baud_rate / 2) / baud_rate;
+    auto integer_divisor = divisor >> 6;
+    if (integer_divisor == 0 || integer_divisor > 0xFFFF) {
+        return 0;
+    }
+
+    IntegerBaudRate::write(IntegerBaudRate::Divisor::value(integer_divisor));
+    FractionalBaudRate::write(FractionalBaudRate::Divisor::value(divisor));
+
+    m_baud_rate = (u64)m_reference_clock_rate * 4 / divisor;
+    return m_baud_rate;
 }
 
-void UART::write(u32 value)
+void UART::enable_interrupts()
 {
-    this->wait_until_ready_for_writing();
+    auto handler = [](void* uart) { ((UART*)uart)->handle_interrupt(); };
+    if (!InterruptController::instance().register_handler(IRQ::UART, handler, this)) {
+        return;
+    }
+
+    InterruptSafeLocker locker(m_lock);
+
+    InterruptFIFOLevel::write(InterruptFIFOLevel::TransmitOneEighth | InterruptFIFOLevel::ReceiveOneHalf);
+    InterruptClear::write(InterruptClear::All::Set);
+
+    // The receive interrupts stay enabled from now on, the transmit interrupt is only enabled while there is
+    // something to send (see fill_transmit_fifo).
+    InterruptMask::modify(InterruptMask::Receive::Set | InterruptMask::ReceiveTimeout::Set);
 
-    MMIO::instance().write(Register::Data, value);
+    m_interrupts_enabled = true;
+
+    // Anything that is already queued is picked up from here.
+    this->fill_transmit_fifo();
 }
 
-void UART::wait_until_ready_for_reading()
+void UART::handle_interrupt()
 {
-    // We need to wait until the receive FIFO is empty
-    while (MMIO::instance().read(Register::Flag) & Flag::ReceiveFIFOFull) {
+    // IRQs are already masked in here, but a writer on another core may be using the buffers.
+    Locker locker(m_lock);
+
+    auto status = MaskedInterruptStatus::read();
+
+    // Reading the FIFO clears the receive interrupt, but the timeout interrupt has to be cleared by hand.
+    if (MaskedInterruptStatus::Receive::is_set(status) || MaskedInterruptStatus::ReceiveTimeout::is_set(status)) {
+        this->drain_receive_fifo();
+        InterruptClear::write(InterruptClear::Receive::Set | InterruptClear::ReceiveTimeout::Set);
+    }
+
+    if (MaskedInterruptStatus::Transmit::is_set(status)) {
+        InterruptClear::write(InterruptClear::Transmit::Set);
+        this->fill_transmit_fifo();
     }
 }
 
-void UART::wait_until_ready_for_writing()
+bool UART::wait_until_ready_for_writing()
 {
     // We need to wait until the transmit FIFO is empty
-    while (MMIO::instance().read(Register::Flag) & Flag::TransmitFIFOFull) {
+    Timeout timeout(TransmitTimeout);
+    while (Flag::TransmitFIFOFull::is_set()) {
+        if (timeout.has_expired()) {
+            return false;
+        }
     }
+
+    return true;
 }
 }
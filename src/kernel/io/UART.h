@@ -1,28 +1,166 @@
 #pragma once
 
+#include "../../fluorescent/Format.h"
 #include "../../types/integer.h"
-#include <stdarg.h>
+#include "../Spinlock.h"
 
 namespace Kernel {
 
+// The PL011 UART.
+// Everything that is written goes into a ring buffer first, which the UART's transmit interrupt drains into the
+// hardware FIFO, so printing only costs as much as copying the bytes. Received bytes go the other way: the receive
+// interrupt moves them from the hardware FIFO into a ring buffer, where they wait until someone reads them.
+//
+// Writing is safe from any core (and from interrupt handlers), the transmit side is behind a lock that masks IRQs.
+// Reading isn't: only one core may read at a time.
 class UART {
 public:
+    static constexpr size_t TransmitBufferSize = 4096;
+    static constexpr size_t ReceiveBufferSize = 1024;
+    static constexpr size_t LineBufferSize = 256;
+
+    static constexpr u32 DefaultBaudRate = 115200;
+
+    // What happens when something is written while the transmit buffer is full.
+    enum class FullBufferPolicy {
+        // Wait for the UART to make room, nothing is lost.
+        Block,
+
+        // The new bytes are thrown away.
+        Drop,
+
+        // The oldest bytes in the buffer are thrown away to make room.
+        OverwriteOldest,
+    };
+
     static UART& instance();
 
-    void print(const char* string, ...);
-    void println(const char* string, ...);
+    UART(const UART&) = delete;
+    UART& operator=(const UART&) = delete;
 
+    // See Format.h for what the format string can contain. The text is formatted into a buffer on the stack first,
+    // and then queued in one go.
+    template <typename... Arguments>
+    void print(FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments)
+    {
+        FormatBuffer buffer(write_formatted, this);
+        format(buffer, string, arguments...);
+    }
+
+    template <typename... Arguments>
+    void println(FormatString<TypeIdentity<Arguments>...> string, const Arguments&... arguments)
+    {
+        FormatBuffer buffer(write_formatted, this);
+        format(buffer, string, arguments...);
+        buffer.append("\r\n", 2);
+    }
+
+    // Waits until a byte has been received.
     u32 read();
+
+    // Reads a byte if one has been received, without waiting.
+    bool try_read(u8& value);
+
+    // Reads up to `size` bytes that have already been received, and returns how many were read.
+    size_t read(u8* buffer, size_t size);
+
+    // Assembles a line out of whatever has been received so far, echoing it back and handling backspace.
+    // Returns true (with the line, without its line ending, null-terminated in `buffer`) once a line is complete.
+    // Anything past `size - 1` characters is thrown away, and nothing is read at all if `size` is 0.
+    bool try_read_line(char* buffer, size_t size);
+
+    // Waits until a whole line has been received, see try_read_line(). Returns straight away if `size` is 0.
+    void read_line(char* buffer, size_t size);
+
     void write(u32 value);
+    void write(const char* data, size_t size);
+
+    // Queues all of `data` if the transmit buffer has room for it, or nothing at all if it doesn't (or if the interrupt
+    // isn't enabled yet, as nothing would send it without waiting). Never waits, whatever the full buffer policy is.
+    bool try_write(const char* data, size_t size);
+
+    // Waits for everything that has been written to go out, and switches to the closest rate to `baud_rate` that the
+    // UART's clock allows. If the clock is too slow, the firmware is asked for a faster one. Returns the rate that
+    // the UART is actually running at, or 0 if `baud_rate` can't be reached (in which case nothing is changed).
+    u32 set_baud_rate(u32 baud_rate);
+
+    u32 baud_rate() const { return m_baud_rate; }
+    u32 reference_clock_rate() const { return m_reference_clock_rate; }
+
+    FullBufferPolicy full_buffer_policy() const { return m_full_buffer_policy; }
+    void set_full_buffer_policy(FullBufferPolicy policy) { m_full_buffer_policy = policy; }
+
+    // Writes everything in the transmit buffer out by polling, and waits until the last byte has left the UART.
+    // This doesn't rely on interrupts, so it is safe to call from the panic path.
+    void flush();
+
+    // Switches to draining the transmit buffer and filling the receive buffer from the UART's interrupt, which is
+    // routed to handle_interrupt() (see InterruptController). Until this is called, every write is flushed
+    // synchronously, and the receive FIFO is polled whenever something is read.
+    void enable_interrupts();
+    void handle_interrupt();
+
+    u64 bytes_dropped() const { return m_bytes_dropped; }
+    u64 bytes_overrun() const { return m_bytes_overrun; }
+    u64 receive_errors() const { return m_receive_errors; }
 
 private:
     UART();
 
-    void print(const char* string, va_list arguments);
-    void print_raw(const char* string);
+    static void write_formatted(void* context, const char* data, size_t size) { ((UART*)context)->write(data, size); }
+
+    // Adds a byte to the transmit buffer, following the full buffer policy if there's no room.
+    void queue(u8 value);
+
+    // Makes sure that whatever has been queued is on its way out.
+    void start_transmitting();
+
+    // flush(), for when the lock is already held.
+    void write_out_transmit_buffer();
+
+    // Returns false if the UART didn't make room in time.
+    bool wait_until_ready_for_writing();
+
+    // Writes the divisors for `baud_rate` (the UART must be disabled), see set_baud_rate().
+    u32 program_baud_rate(u32 baud_rate);
+
+    // Moves as much of the transmit buffer into the hardware FIFO as will fit, without waiting.
+    void fill_transmit_fifo();
+
+    // Moves everything in the hardware FIFO into the receive buffer. Only the interrupt handler (or whoever is
+    // reading, while the interrupt is not enabled) may call this.
+    void drain_receive_fifo();
+
+    size_t transmit_buffer_used() const { return m_transmit_head - m_transmit_tail; }
+
+    // The head only ever moves forward when something is written, and the tail when something is sent. Both are
+    // free-running, and are only reduced modulo the size when indexing.
+    // Held by anyone who touches the transmit buffer or the UART's registers, including the interrupt handler.
+    Spinlock m_lock;
+
+    u8 m_transmit_buffer[TransmitBufferSize] {};
+    volatile size_t m_transmit_head { 0 };
+    volatile size_t m_transmit_tail { 0 };
+
+    // This is a single-producer (the interrupt handler), single-consumer (whoever is reading) queue, so it doesn't
+    // need a lock: the producer only ever moves the head, and the consumer only ever moves the tail.
+    u8 m_receive_buffer[ReceiveBufferSize] {};
+    volatile size_t m_receive_head { 0 };
+    volatile size_t m_receive_tail { 0 };
+
+    char m_line[LineBufferSize] {};
+    size_t m_line_length { 0 };
+    u8 m_last_line_ending { 0 };
+
+    u32 m_baud_rate { 0 };
+    u32 m_reference_clock_rate { 0 };
+
+    FullBufferPolicy m_full_buffer_policy { FullBufferPolicy::Block };
+    bool m_interrupts_enabled { false };
 
-    void wait_until_ready_for_reading();
-    void wait_until_ready_for_writing();
+    u64 m_bytes_dropped = 0;
+    u64 m_bytes_overrun = 0;
+    u64 m_receive_errors = 0;
 };
 
-}
\ No newline at end of file
+}
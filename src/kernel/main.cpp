@@ -1,14 +1,30 @@
 #include "../fluorescent/Fluorescent.h"
+#include "../fluorescent/Format.h"
+#include "Arena.h"
+#include "Board.h"
+#include "FastRandom.h"
+#include "InterruptController.h"
 #include "Kernel.h"
+#include "Log.h"
+#include "MMU.h"
 #include "MemoryManagement.h"
+#include "PageAllocator.h"
 #include "Processor.h"
+#include "Random.h"
+#include "SMP.h"
+#include "SecureRandom.h"
+#include "SlabCache.h"
+#include "Spinlock.h"
+#include "Time.h"
+#include "TimerWheel.h"
+#include "VirtualMemory.h"
 #include "io/UART.h"
 
 namespace Kernel {
 
 void main()
 {
-    auto uart = UART::instance();
+    auto& uart = UART::instance();
     auto processor_info = Processor::get_info();
 
     uart.println("[main] Running on exception level {i}", processor_info.exception_level);
@@ -19,22 +35,44 @@ void main()
     }
 
     uart.println("[main] Board detected: {s}", processor_info.name);
+    uart.println("[main] MMU and caches enabled: {b}", MMU::is_enabled());
+    uart.println("[main] {i} cores online", SMP::online_core_count());
+    uart.println("[main] UART running at {i} baud (reference clock: {i} Hz)", uart.baud_rate(), uart.reference_clock_rate());
 
-    // Our OS only supports the Pi3 and Pi4 at the moment.
-    if (processor_info.part_number != PartNumber::Pi3 && processor_info.part_number != PartNumber::Pi4) {
+    if (!Board::is_supported()) {
         return Processor::panic("Unsupported Raspberry PI board revision!");
     }
 
     // TODO: Move these somewhere else, and maybe have a "testing mode"?
+    test_format();
+    test_page_allocator();
+    test_virtual_memory();
     test_memory_management();
+    test_slab_cache();
+    test_arena();
     test_random_number_generation();
+    test_smp();
+    test_spinlock();
+    test_interrupts();
+    test_timers();
+    test_log();
+
+    if (RUN_BENCHMARKS) {
+        benchmark_memory_zeroing();
+        benchmark_random_number_generation();
+        benchmark_spinlock();
+        benchmark_allocation_scaling();
+        benchmark_timer_wheel();
+    }
+
+    Log::instance().drain();
 
     Processor::panic("Reached end of init!");
 }
 
 void test_memory_management()
 {
-    auto uart = UART::instance();
+    auto& uart = UART::instance();
 
     auto expected_a_value = 4;
     auto expected_b_value = 69;
@@ -123,15 +161,17 @@ void test_memory_management()
 
     uart.println("[test_memory_management] Checking if freeing a large region will cause it to be resized...");
 
-    auto big_address = MemoryManagement::instance().allocate(512);
+    // Anything below MemoryManagement::MaxSizeClassSize is served from a size class, which never gets resized,
+    // so we need to use sizes that go through the general path here.
+    auto big_address = MemoryManagement::instance().allocate(8192);
     *(int*)big_address = 0x69;
-    uart.println("[test_memory_management] Allocated 512 bytes for big_address at {#}", big_address);
+    uart.println("[test_memory_management] Allocated 8192 bytes for big_address at {#}", big_address);
 
     uart.println("[test_memory_management] Freeing big_address... ({#})", big_address);
     MemoryManagement::instance().free(big_address);
 
-    uart.println("[test_memory_management] Allocating 16 bytes for small_address...");
-    auto small_address = MemoryManagement::instance().allocate(16);
+    uart.println("[test_memory_management] Allocating 4096 bytes for small_address...");
+    auto small_address = MemoryManagement::instance().allocate(4096);
     if (*(int*)small_address == 0x69) {
         Processor::panic("big_address was not free'd correctly!");
     }
@@ -146,12 +186,294 @@ void test_memory_management()
     uart.println("[test_memory_management] Cleaning up...");
 
     MemoryManagement::instance().free(small_address);
+
+    uart.println("[test_memory_management] Checking if aligned allocations are aligned...");
+
+    auto cache_line_address = MemoryManagement::instance().allocate_aligned(100, 64);
+    auto page_address = MemoryManagement::instance().allocate_aligned(100, 4096);
+    uart.println("[test_memory_management] cache_line_address = {#}, page_address = {#}", cache_line_address, page_address);
+
+    if ((uintptr_t)cache_line_address % 64 != 0 || (uintptr_t)page_address % 4096 != 0) {
+        uart.println("[test_memory_management] ERROR: The aligned allocations were not aligned!");
+        return;
+    }
+
+    uart.println("[test_memory_management] It looks like aligned allocations work!");
+    uart.println("[test_memory_management] Cleaning up...");
+
+    MemoryManagement::instance().free(cache_line_address);
+    MemoryManagement::instance().free(page_address);
+
+    uart.println("[test_memory_management] Checking if an aligned allocation of 0 bytes can be free'd...");
+
+    // A region of size 0 would end the walk over the heap early, and couldn't be free'd.
+    auto regions_before = MemoryManagement::instance().statistics().regions;
+    auto empty_address = MemoryManagement::instance().allocate_aligned(0, 4096);
+    if (empty_address == nullptr || (uintptr_t)empty_address % 4096 != 0) {
+        return Processor::panic("Aligned allocation of 0 bytes failed!");
+    }
+
+    auto regions_allocated = MemoryManagement::instance().statistics().regions;
+    if (regions_allocated <= regions_before) {
+        return Processor::panic("Aligned allocation of 0 bytes cut the heap short!");
+    }
+
+    MemoryManagement::instance().free(empty_address);
+    if (MemoryManagement::instance().statistics().regions >= regions_allocated) {
+        return Processor::panic("Aligned allocation of 0 bytes was not free'd!");
+    }
+
+    uart.println("[test_memory_management] It looks like it can!");
+
     MemoryManagement::instance().print_stats();
 }
 
+void test_page_allocator()
+{
+    auto& uart = UART::instance();
+    auto& page_allocator = PageAllocator::instance();
+
+    auto free_pages = page_allocator.free_page_count();
+
+    uart.println("[test_page_allocator] Checking if blocks are aligned to their size...");
+
+    auto small_block = page_allocator.allocate(0);
+    auto large_block = page_allocator.allocate(PageAllocator::MaxOrder);
+    uart.println("[test_page_allocator] Allocated a 4 KiB block at {#} and a 2 MiB block at {#}", small_block, large_block);
+
+    if (small_block == nullptr || large_block == nullptr) {
+        return Processor::panic("PageAllocator failed to allocate a block!");
+    }
+
+    if ((uintptr_t)large_block % PageAllocator::size_of_order(PageAllocator::MaxOrder) != 0) {
+        return Processor::panic("PageAllocator returned a misaligned 2 MiB block!");
+    }
+
+    uart.println("[test_page_allocator] Checking if free'd blocks are given back...");
+
+    page_allocator.free(small_block);
+    page_allocator.free(large_block);
+
+    if (page_allocator.free_page_count() != free_pages) {
+        uart.println("[test_page_allocator] ERROR: {i} pages were free before, but {i} are free now!", free_pages, page_allocator.free_page_count());
+        return;
+    }
+
+    uart.println("[test_page_allocator] Checking if free'ing a block twice is ignored...");
+
+    // Splitting a block hands out its lower half first, so these are (almost certainly) buddies, and the first free
+    // of the upper one merges them back together.
+    auto lower_block = page_allocator.allocate(0);
+    auto upper_block = page_allocator.allocate(0);
+    if (lower_block > upper_block) {
+        auto block = lower_block;
+        lower_block = upper_block;
+        upper_block = block;
+    }
+
+    uart.println("[test_page_allocator] Allocated 4 KiB blocks at {#} and {#}", lower_block, upper_block);
+
+    page_allocator.free(lower_block);
+    page_allocator.free(upper_block);
+    page_allocator.free(upper_block);
+
+    if (page_allocator.free_page_count() != free_pages) {
+        uart.println("[test_page_allocator] ERROR: {i} pages were free before, but {i} are free after a double free!", free_pages, page_allocator.free_page_count());
+        return;
+    }
+
+    uart.println("[test_page_allocator] It appears that the page allocator is working as expected!");
+    page_allocator.print_stats();
+}
+
+void test_virtual_memory()
+{
+    auto& uart = UART::instance();
+    auto& virtual_memory = VirtualMemory::instance();
+
+    uart.println("[test_virtual_memory] Checking if a page can be mapped somewhere else...");
+
+    // Anything above the identity map (and below the heap) will do.
+    auto virtual_address = (uintptr_t)0x2000000000;
+    auto physical_page = (u64*)PageAllocator::instance().allocate(0);
+    if (physical_page == nullptr || !virtual_memory.map(virtual_address, (uintptr_t)physical_page, VirtualMemory::Flags::Writable)) {
+        return Processor::panic("VirtualMemory failed to map a page!");
+    }
+
+    *(volatile u64*)virtual_address = 0x69;
+    if (*(volatile u64*)physical_page != 0x69 || virtual_memory.physical_address_of(virtual_address) != (uintptr_t)physical_page) {
+        uart.println("[test_virtual_memory] ERROR: The page was not mapped to {#}!", physical_page);
+        return;
+    }
+
+    if (virtual_memory.unmap(virtual_address) != (uintptr_t)physical_page || virtual_memory.physical_address_of(virtual_address) != 0) {
+        uart.println("[test_virtual_memory] ERROR: The page was not unmapped!");
+        return;
+    }
+
+    PageAllocator::instance().free(physical_page);
+
+    uart.println("[test_virtual_memory] Checking if the heap is only backed once it is touched...");
+
+    auto pages_backed = virtual_memory.heap_pages_backed();
+    auto large_address = (u8*)MemoryManagement::instance().allocate(4 * 1024 * 1024);
+
+    // Only the pages with region headers and the end marker should have been touched.
+    if (large_address == nullptr || virtual_memory.heap_pages_backed() > pages_backed + 4) {
+        uart.println("[test_virtual_memory] ERROR: {i} pages were backed by a 4 MiB allocation!", virtual_memory.heap_pages_backed() - pages_backed);
+        return;
+    }
+
+    pages_backed = virtual_memory.heap_pages_backed();
+    large_address[2 * 1024 * 1024] = 0x42;
+
+    if (virtual_memory.heap_pages_backed() != pages_backed + 1) {
+        uart.println("[test_virtual_memory] ERROR: Touching a page caused {i} pages to be backed!", virtual_memory.heap_pages_backed() - pages_backed);
+        return;
+    }
+
+    // The policy doesn't matter here, nothing but the touched page should be cleared.
+    auto zeroing_policy = MemoryManagement::instance().zeroing_policy();
+    MemoryManagement::instance().set_zeroing_policy(MemoryManagement::ZeroingPolicy::None);
+    MemoryManagement::instance().free(large_address);
+    MemoryManagement::instance().set_zeroing_policy(zeroing_policy);
+
+    uart.println("[test_virtual_memory] It appears that virtual memory is working as expected!");
+    virtual_memory.print_stats();
+}
+
+void test_format()
+{
+    struct Output {
+        char data[64];
+        size_t size;
+    };
+
+    auto& uart = UART::instance();
+    uart.println("[test_format] Checking if arguments are formatted as expected...");
+
+    Output output {};
+    {
+        auto append = [](void* context, const char* data, size_t size) {
+            auto output = (Output*)context;
+            for (size_t i = 0; i < size && output->size < sizeof(output->data); i++) {
+                output->data[output->size++] = data[i];
+            }
+        };
+
+        FormatBuffer buffer(append, &output);
+
+        format(buffer, "{i} {04i} {#} {08x} {s} {b} \\{\\}", -42, 7, (u64)1 << 40, 0xBEEFu, "ok", true);
+    }
+
+    const char expected[] = "-42 0007 0x10000000000 0000BEEF ok true {}";
+    auto matches = output.size == sizeof(expected) - 1;
+    for (size_t i = 0; matches && i < output.size; i++) {
+        matches = output.data[i] == expected[i];
+    }
+
+    if (!matches) {
+        uart.print("[test_format] ERROR: Expected \"{s}\", but got \"", expected);
+        uart.write(output.data, output.size);
+        uart.println("\"!");
+        return;
+    }
+
+    uart.println("[test_format] It appears that formatting is working as expected!");
+}
+
+void test_slab_cache()
+{
+    struct TestObject {
+        u64 value;
+        TestObject* next;
+    };
+
+    auto& uart = UART::instance();
+    SlabCache<TestObject> cache("TestObject");
+
+    uart.println("[test_slab_cache] Checking if objects can be created and destroyed...");
+
+    TestObject* objects = nullptr;
+    for (auto i = 0; i < 512; i++) {
+        auto object = cache.create(TestObject { .value = (u64)i, .next = objects });
+        if (object == nullptr) {
+            return Processor::panic("SlabCache failed to allocate an object!");
+        }
+
+        objects = object;
+    }
+
+    // The objects were allocated in reverse order, so we should see them counting down.
+    auto expected_value = 511;
+    for (auto object = objects; object != nullptr; object = object->next) {
+        if (object->value != (u64)expected_value--) {
+            uart.println("[test_slab_cache] ERROR: Expected {i}, but got {i}!", expected_value + 1, object->value);
+            return;
+        }
+    }
+
+    while (objects != nullptr) {
+        auto next = objects->next;
+        cache.destroy(objects);
+        objects = next;
+    }
+
+    if (cache.objects_in_use() != 0) {
+        uart.println("[test_slab_cache] ERROR: {i} objects are still in use!", cache.objects_in_use());
+        return;
+    }
+
+    uart.println("[test_slab_cache] It appears that the slab cache is working as expected!");
+    cache.print_stats();
+}
+
+void test_arena()
+{
+    auto& uart = UART::instance();
+    Arena arena;
+
+    uart.println("[test_arena] Checking if allocations respect their alignment...");
+
+    auto unaligned_address = arena.allocate(1, 1);
+    auto aligned_address = arena.allocate(64, 64);
+    uart.println("[test_arena] Allocated 1 byte at {#}, and 64 bytes aligned to 64 bytes at {#}", unaligned_address, aligned_address);
+
+    if ((uintptr_t)aligned_address % 64 != 0) {
+        return Processor::panic("Arena returned a misaligned allocation!");
+    }
+
+    uart.println("[test_arena] Checking if a scope gives back everything allocated inside of it...");
+
+    auto marker = arena.mark();
+    auto bytes_before_scope = arena.bytes_allocated();
+
+    {
+        Arena::Scope scope(arena);
+
+        // This is more than a single chunk, so the scope has to unwind across chunks too.
+        for (auto i = 0; i < 8192; i++) {
+            auto value = new (arena) u64(i);
+            if (*value != (u64)i) {
+                return Processor::panic("Arena returned memory that was still in use!");
+            }
+        }
+    }
+
+    if (arena.bytes_allocated() != bytes_before_scope || arena.allocate(1, 1) != marker.position) {
+        uart.println("[test_arena] ERROR: Arena was not reset to the start of the scope! ({i} bytes, expected {i})", arena.bytes_allocated(), bytes_before_scope);
+        return;
+    }
+
+    arena.print_stats("test_arena");
+    arena.release();
+
+    uart.println("[test_arena] It appears that the arena is working as expected!");
+}
+
 void test_random_number_generation()
 {
-    auto uart = UART::instance();
+    auto& uart = UART::instance();
     uart.println("[test_random_number_generation] Checking if the random number generator works...");
 
     auto random_number_a = random(0, 1000);
@@ -166,7 +488,340 @@ void test_random_number_generation()
         return;
     }
 
+    // More than a whole pool, so that the rest has to come from the hardware.
+    static u8 buffer_a[Random::PoolSize * sizeof(u32) + 100];
+    static u8 buffer_b[100];
+
+    auto& random = Random::instance();
+    random.fill(buffer_a, sizeof(buffer_a));
+    random.fill(buffer_b, sizeof(buffer_b));
+
+    uart.println("[test_random_number_generation] {i} words left in the pool after filling {i} bytes", random.words_in_pool(), sizeof(buffer_a) + sizeof(buffer_b));
+
+    size_t matching_bytes = 0;
+    for (size_t i = 0; i < sizeof(buffer_b); i++) {
+        if (buffer_a[sizeof(buffer_a) - sizeof(buffer_b) + i] == buffer_b[i]) {
+            matching_bytes++;
+        }
+    }
+
+    // About one in every 256 bytes should match by chance.
+    if (matching_bytes > 8) {
+        uart.println("ERROR: Random number generator test failed. {i} out of {i} bytes were the same!", matching_bytes, sizeof(buffer_b));
+
+        return;
+    }
+
+    // RFC 8439, 2.3.2. Test Vector for the ChaCha20 Block Function
+    const u32 key[8] = { 0x03020100, 0x07060504, 0x0b0a0908, 0x0f0e0d0c, 0x13121110, 0x17161514, 0x1b1a1918, 0x1f1e1d1c };
+    const u32 nonce[3] = { 0x09000000, 0x4a000000, 0x00000000 };
+    u32 block[16];
+    ChaCha20::block(key, 1, nonce, block);
+
+    if (block[0] != 0xe4e7f110 || block[15] != 0x4e3c50a2) {
+        uart.println("ERROR: ChaCha20 test failed. Got {08x}...{08x}!", block[0], block[15]);
+
+        return;
+    }
+
+    auto& fast_random = FastRandom::current();
+    auto& secure_random = SecureRandom::instance();
+    for (auto i = 0; i < 1000; i++) {
+        auto fast_value = fast_random.between(-3, 3);
+        auto secure_value = secure_random.below(7);
+
+        if (fast_value < -3 || fast_value > 3 || secure_value >= 7 || ::random(5, 6) != 5 || ::random(9, 9) != 9) {
+            uart.println("ERROR: Random number generator test failed. Got {i} and {i}, which are out of range!", fast_value, secure_value);
+
+            return;
+        }
+    }
+
     uart.println("[test_random_number_generation] It appears that the random number generator is working as expected!");
 }
 
+static void mark_core(void* argument)
+{
+    __atomic_fetch_or((u32*)argument, 1u << Processor::core_id(), __ATOMIC_RELAXED);
+}
+
+void test_smp()
+{
+    auto& uart = UART::instance();
+    uart.println("[test_smp] Checking if every core that is online runs what it's given...");
+
+    u32 cores_seen = 0;
+    u32 expected = 0;
+
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        if (!SMP::run_on_core(core, mark_core, &cores_seen)) {
+            continue;
+        }
+
+        expected |= 1u << core;
+    }
+
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        SMP::wait_for_core(core);
+    }
+
+    auto seen = __atomic_load_n(&cores_seen, __ATOMIC_ACQUIRE);
+    if (seen != expected || expected == 0) {
+        uart.println("[test_smp] ERROR: Expected cores {x} to run, but {x} did!", expected, seen);
+        return;
+    }
+
+    uart.println("[test_smp] {i} cores ran their work (mask {x})", SMP::online_core_count(), seen);
+}
+
+struct SpinlockTest {
+    Spinlock lock;
+    u64 counter;
+
+    ReadWriteSpinlock read_write_lock;
+    u64 values[2];
+    u64 torn_reads;
+};
+
+static constexpr size_t SpinlockTestIterations = 10000;
+
+static void hammer_locks(void* argument)
+{
+    auto test = (SpinlockTest*)argument;
+
+    for (size_t i = 0; i < SpinlockTestIterations; i++) {
+        {
+            Locker locker(test->lock);
+            test->counter++;
+        }
+
+        // Writers keep both values the same, so a reader should never see them differ.
+        if (i % 8 == 0) {
+            Locker locker(test->read_write_lock);
+            test->values[0]++;
+            test->values[1]++;
+        } else {
+            SharedLocker locker(test->read_write_lock);
+            if (test->values[0] != test->values[1]) {
+                __atomic_fetch_add(&test->torn_reads, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+void test_spinlock()
+{
+    auto& uart = UART::instance();
+    uart.println("[test_spinlock] Checking if locks keep every core out of each other's way...");
+
+    static SpinlockTest test;
+
+    size_t cores = 0;
+    // This core goes last, as run_on_core() runs its work straight away.
+    for (u32 i = 1; i <= Processor::MaxCoreCount; i++) {
+        auto core = (SMP::current().id + i) % Processor::MaxCoreCount;
+        if (SMP::run_on_core(core, hammer_locks, &test)) {
+            cores++;
+        }
+    }
+
+    for (u32 core = 0; core < Processor::MaxCoreCount; core++) {
+        SMP::wait_for_core(core);
+    }
+
+    if (test.counter != cores * SpinlockTestIterations || test.values[0] != test.values[1] || test.torn_reads != 0) {
+        uart.println("[test_spinlock] ERROR: Expected {i} increments, but got {i} ({i} torn reads)!", cores * SpinlockTestIterations, test.counter, test.torn_reads);
+        return;
+    }
+
+    if (test.lock.is_locked() || !test.lock.try_lock() || test.lock.try_lock()) {
+        uart.println("[test_spinlock] ERROR: try_lock() doesn't agree with is_locked()!");
+        return;
+    }
+
+    test.lock.unlock();
+
+    auto& statistics = test.lock.statistics();
+    uart.println("[test_spinlock] {i} cores took the lock {i} times, and had to wait {i} times", cores, test.counter, statistics.contentions);
+}
+
+void test_interrupts()
+{
+    auto& uart = UART::instance();
+    auto& interrupts = InterruptController::instance();
+
+    uart.println("[test_interrupts] Checking if the UART's transmit interrupt is delivered...");
+
+    auto dispatches = interrupts.dispatch_count(IRQ::UART);
+
+    // This is more than the UART's FIFO holds, so the rest has to be sent from the interrupt handler.
+    uart.println("[test_interrupts] 0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz");
+
+    // A few milliseconds is plenty, even at 115200 baud.
+    Timeout timeout(100 * Time::Millisecond);
+    while (interrupts.dispatch_count(IRQ::UART) == dispatches && !timeout.has_expired()) {
+    }
+
+    if (interrupts.dispatch_count(IRQ::UART) == dispatches) {
+        uart.println("[test_interrupts] ERROR: The UART's interrupt never fired!");
+        return;
+    }
+
+    uart.println("[test_interrupts] Checking if bad registrations are turned away...");
+
+    auto handler = [](void*) {};
+    if (interrupts.register_handler(IRQ::UART, handler, nullptr) || interrupts.register_handler(InterruptController::MaxIRQCount, handler, nullptr)) {
+        uart.println("[test_interrupts] ERROR: A handler was registered for an IRQ that is taken, or doesn't exist!");
+        return;
+    }
+
+    uart.println("[test_interrupts] It appears that interrupts are working as expected!");
+    interrupts.print_stats();
+}
+
+struct TimerTest {
+    u32 order[4];
+    u32 count;
+};
+
+struct TimerTestEntry {
+    TimerTest* test;
+    u32 id;
+};
+
+static void record_timer(void* argument)
+{
+    auto entry = (TimerTestEntry*)argument;
+    entry->test->order[entry->test->count++ % 4] = entry->id;
+}
+
+static void count_timer(void* argument)
+{
+    ((TimerTest*)argument)->count++;
+}
+
+void test_timers()
+{
+    auto& uart = UART::instance();
+    auto& timer_wheel = TimerWheel::instance();
+
+    uart.println("[test_timers] Checking if sleeping takes as long as it should...");
+
+    auto before = Time::now();
+    timer_wheel.sleep(2 * Time::Millisecond);
+    auto slept = Time::now() - before;
+
+    if (slept < 2 * Time::Millisecond) {
+        uart.println("[test_timers] ERROR: Sleeping for 2000000 ns only took {i} ns!", slept);
+        return;
+    }
+
+    uart.println("[test_timers] Slept for {i} ns", slept);
+    uart.println("[test_timers] Checking if one-shot timers fire in order, and cancelled ones don't...");
+
+    static TimerTest test;
+    static Timer timers[5];
+    static TimerTestEntry entries[5];
+
+    // The last two are far enough away to start off in the wheel's higher levels.
+    u64 delays[] = { 3 * Time::Millisecond, 1 * Time::Millisecond, 2 * Time::Millisecond, 500 * Time::Millisecond, 2 * 3600 * Time::Second };
+    u32 ids[] = { 2, 0, 1, 3, 4 };
+
+    auto now = Time::now();
+    for (size_t i = 0; i < 5; i++) {
+        entries[i] = { &test, ids[i] };
+        timer_wheel.start_one_shot(timers[i], now + delays[i], record_timer, &entries[i]);
+    }
+
+    if (!timer_wheel.cancel(timers[3]) || !timer_wheel.cancel(timers[4]) || timer_wheel.cancel(timers[4])) {
+        uart.println("[test_timers] ERROR: cancel() doesn't agree with which timers are pending!");
+        return;
+    }
+
+    timer_wheel.sleep(5 * Time::Millisecond);
+
+    if (test.count != 3 || test.order[0] != 0 || test.order[1] != 1 || test.order[2] != 2) {
+        uart.println("[test_timers] ERROR: Expected timers 0, 1 and 2 to fire, but {i} fired ({i}, {i}, {i})!", test.count, test.order[0], test.order[1], test.order[2]);
+        return;
+    }
+
+    uart.println("[test_timers] Checking if periodic timers keep firing until they're cancelled...");
+
+    static TimerTest periodic;
+    timer_wheel.start_periodic(timers[0], Time::Millisecond, count_timer, &periodic);
+    timer_wheel.sleep(10 * Time::Millisecond + TimerWheel::Resolution);
+    timer_wheel.cancel(timers[0]);
+
+    // Periods that are missed (e.g. because QEMU didn't get to run for a while) are skipped, not made up for.
+    auto fired = periodic.count;
+    if (fired == 0 || fired > 10) {
+        uart.println("[test_timers] ERROR: A 1 ms timer fired {i} times in 10 ms!", fired);
+        return;
+    }
+
+    timer_wheel.sleep(3 * Time::Millisecond);
+
+    if (periodic.count != fired) {
+        uart.println("[test_timers] ERROR: A periodic timer kept firing after it was cancelled!");
+        return;
+    }
+
+    uart.println("[test_timers] A 1 ms timer fired {i} times in 10 ms", fired);
+    uart.println("[test_timers] It appears that timers are working as expected!");
+    timer_wheel.print_stats();
+}
+
+void test_log()
+{
+    auto& uart = UART::instance();
+    auto& log = Log::instance();
+
+    static constexpr Logger<LogLevel::Info, "test_log"> logger {};
+
+    uart.println("[test_log] Checking if writing more records than the log can hold drops them, without waiting...");
+
+    // The ring starts out empty, and the timer can't drain it while we fill it up.
+    log.drain();
+    auto state = Interrupts::disable();
+
+    auto records_dropped = log.records_dropped();
+    auto start = Time::now();
+
+    for (size_t i = 0; i < 2 * Log::RecordCount; i++) {
+        logger.info("Record {i}"_log, i + 1);
+    }
+
+    auto elapsed = Time::now() - start;
+    auto dropped = log.records_dropped() - records_dropped;
+
+    Interrupts::restore(state);
+
+    // Another core may have gone idle, and drained some of them in the meantime.
+    if (dropped == 0 || dropped > Log::RecordCount) {
+        uart.println("[test_log] ERROR: {i} out of {i} records were dropped!", dropped, 2 * Log::RecordCount);
+        return;
+    }
+
+    // Sending what did fit would take the UART more than half a second.
+    if (elapsed > 100 * Time::Millisecond) {
+        uart.println("[test_log] ERROR: Writing {i} records took {i} ns!", 2 * Log::RecordCount, elapsed);
+        return;
+    }
+
+    uart.println("[test_log] {i} out of {i} records were dropped, writing them took {i} ns", dropped, 2 * Log::RecordCount, elapsed);
+
+    uart.println("[test_log] Checking if the log takes new records once it has been drained...");
+
+    log.drain();
+    records_dropped = log.records_dropped();
+    logger.info("Drained"_log);
+
+    if (log.records_dropped() != records_dropped) {
+        uart.println("[test_log] ERROR: The log was still full after it was drained!");
+        return;
+    }
+
+    uart.println("[test_log] It appears that the log drops what it can't hold, and says so!");
+}
+
 }
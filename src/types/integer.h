@@ -1,5 +1,10 @@
 typedef __UINT64_TYPE__ u64;
 typedef __UINT32_TYPE__ u32;
+typedef __UINT16_TYPE__ u16;
 typedef __UINT8_TYPE__ u8;
+typedef __INT64_TYPE__ i64;
+typedef __INT32_TYPE__ i32;
+typedef __INT16_TYPE__ i16;
+typedef __INT8_TYPE__ i8;
 typedef __SIZE_TYPE__ size_t;
-typedef __UINTPTR_TYPE__ uintptr_t;
\ No newline at end of file
+typedef __UINTPTR_TYPE__ uintptr_t;